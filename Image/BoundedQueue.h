@@ -0,0 +1,128 @@
+/* ***************************************************************
+\\ File Name:  BoundedQueue.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: A fixed-capacity, thread-safe FIFO queue. Producers
+\\ block while the queue is full, so the number of items in flight
+// (e.g. decoded Images) between pipeline stages stays capped.
+\\
+// ***************************************************************/
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+
+/* *************************************************
+\\ A blocking FIFO queue holding at most capacity
+// items. Once closed, push fails, and pop drains
+\\ the remaining items before failing.
+//
+\\ *************************************************/
+template <typename T>
+class BoundedQueue
+{
+  public:
+
+    // Initializes an empty queue. A capacity of 0 is treated as 1.
+    explicit BoundedQueue(size_t capacity) :
+    capacity(capacity ? capacity : 1), closed(false) { return; }
+
+    // Adds an item, blocking while the queue is full.
+    // False (item dropped) if the queue is closed.
+    bool push(T item)
+    {
+      std::unique_lock<std::mutex> guard(lock);
+
+      // Wait for room, or for the queue to be closed.
+      not_full.wait(guard, [this] { return closed || items.size() < capacity; });
+
+      if(closed) return false;
+
+      items.push_back(std::move(item));
+      not_empty.notify_one();
+      return true;
+    }
+
+    // Adds an item if there is room, without blocking. False
+    // (item dropped) if the queue is full or closed.
+    bool tryPush(T item)
+    {
+      std::lock_guard<std::mutex> guard(lock);
+
+      if(closed || items.size() >= capacity) return false;
+
+      items.push_back(std::move(item));
+      not_empty.notify_one();
+      return true;
+    }
+
+    // Removes the oldest item, blocking while the queue is
+    // empty. False once the queue is closed and drained.
+    bool pop(T & item)
+    {
+      std::unique_lock<std::mutex> guard(lock);
+
+      // Wait for an item, or for the queue to be closed.
+      not_empty.wait(guard, [this] { return closed || !items.empty(); });
+
+      if(items.empty()) return false;
+
+      item = std::move(items.front());
+      items.pop_front();
+      not_full.notify_one();
+      return true;
+    }
+
+    // Removes the oldest item if there is one, without
+    // blocking. False if the queue is empty.
+    bool tryPop(T & item)
+    {
+      std::lock_guard<std::mutex> guard(lock);
+
+      if(items.empty()) return false;
+
+      item = std::move(items.front());
+      items.pop_front();
+      not_full.notify_one();
+      return true;
+    }
+
+    // Stops accepting items, and wakes every waiting thread.
+    void close(void)
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      closed = true;
+      not_full.notify_all();
+      not_empty.notify_all();
+    }
+
+    // Returns the number of queued items.
+    size_t size(void) const
+    { std::lock_guard<std::mutex> guard(lock); return items.size(); }
+
+  private:
+
+    // The queued items, oldest first.
+    std::deque<T> items;
+
+    // The maximum number of queued items.
+    const size_t capacity;
+
+    // True once close has been called.
+    bool closed;
+
+    // Guards every member above.
+    mutable std::mutex lock;
+
+    // Signaled when an item is removed / added.
+    std::condition_variable not_full, not_empty;
+};
+
+#endif // BOUNDED_QUEUE_H
@@ -0,0 +1,291 @@
+/* ***************************************************************
+\\ File Name:  DecodeCache.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation of the decode cache. Entries live in a
+\\ list, most recently used first, indexed by a hash map on the
+// file name, so a lookup, a hit's move to the front and an
+\\ eviction from the back are all constant time.
+//
+\\ An entry is only handed out if the file's FileStamp still
+// matches the one taken before it was decoded, so a file that has
+\\ been rewritten (or replaced) since is decoded afresh. Images
+// share the cached cv::Mat itself; as the cache's reference counts
+\\ towards the Image's, copy-on-write keeps the cached pixels intact.
+//
+\\ ***************************************************************/
+
+#include "DecodeCache.h"
+
+#include <sys/stat.h>
+
+
+// ***************************** |
+// FileStamp Implementation      |
+// ***************************** V
+
+/* ****************************************************
+\\ Initializes the stamp of an unknown file.
+//
+\\ ****************************************************/
+FileStamp :: FileStamp(void) :
+size(-1), mtime_ns(0), inode(0), device(0)
+{
+  return;
+}
+
+
+/* ****************************************************
+\\ Takes the stamp of a file with a single stat.
+//
+\\ @param path: The name of the file.
+//
+\\ @return: False if the file can't be stat'ed (the
+// stamp is then unchanged).
+\\
+// ****************************************************/
+bool FileStamp :: read(const std::string & path)
+{
+  struct stat st;
+  if(stat(path.c_str(), &st) != 0) return false;
+
+  size = static_cast<long long>(st.st_size);
+
+  // Use the nanoseconds where they are recorded, so that a
+  // rewrite within the same second is still noticed.
+#if defined(__APPLE__)
+  mtime_ns = static_cast<long long>(st.st_mtimespec.tv_sec) * 1000000000LL + st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+  mtime_ns = static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+  mtime_ns = static_cast<long long>(st.st_mtime) * 1000000000LL;
+#endif
+
+  inode = static_cast<unsigned long long>(st.st_ino);
+  device = static_cast<unsigned long long>(st.st_dev);
+  return true;
+}
+
+
+// True if both stamps are of the same file contents.
+bool FileStamp :: operator==(const FileStamp & other) const
+{
+  return size == other.size && mtime_ns == other.mtime_ns &&
+         inode == other.inode && device == other.device;
+}
+
+
+// ***************************** |
+// DecodeCache Implementation    |
+// ***************************** V
+
+/* ****************************************************
+\\ Initializes cache counters to 0.
+//
+\\ ****************************************************/
+DecodeCacheStats :: DecodeCacheStats(void) :
+hits(0), misses(0), evictions(0), entries(0), bytes(0), budget(0)
+{
+  return;
+}
+
+
+/* ****************************************************
+\\ Initializes an empty cache.
+//
+\\ @param budget: The most bytes of pixels to hold.
+// 0 disables the cache.
+\\
+// ****************************************************/
+DecodeCache :: DecodeCache(size_t budget)
+{
+  counts.budget = budget;
+}
+
+
+/* ****************************************************
+\\ Looks up the pixels of a file.
+//
+\\ @param path: The name the file was cached under.
+//
+\\ @param stamp: The file's stamp now. An entry with
+// another stamp is stale, and is dropped.
+\\
+// @return: The cached pixels, or null (a miss).
+\\
+// ****************************************************/
+std::shared_ptr<cv::Mat> DecodeCache :: find( const std::string & path,
+                                              const FileStamp & stamp )
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  std::unordered_map<std::string, std::list<Entry>::iterator>::iterator found = by_path.find(path);
+
+  // If there is no entry, or the file has changed since, report a miss.
+  if(found == by_path.end() || !(found->second->stamp == stamp))
+  {
+    if(found != by_path.end()) erase(found->second);
+    ++counts.misses;
+    return std::shared_ptr<cv::Mat>();
+  }
+
+  // Move the entry to the front, as the most recently used.
+  lru.splice(lru.begin(), lru, found->second);
+  ++counts.hits;
+  return found->second->pixels;
+}
+
+
+/* ****************************************************
+\\ Caches a file's decoded pixels.
+//
+\\ @param path: The name of the file.
+//
+\\ @param stamp: The file's stamp, taken before it was
+// decoded (so a write during the decode isn't missed).
+\\
+// @param pixels: The decoded pixels. Shared with the
+\\ caller, who must not modify them.
+//
+\\ ****************************************************/
+void DecodeCache :: insert( const std::string & path,
+                            const FileStamp & stamp,
+                            const std::shared_ptr<cv::Mat> & pixels )
+{
+  if(!pixels || pixels->empty()) return;
+
+  const size_t BYTES = pixels->total() * pixels->elemSize();
+
+  std::lock_guard<std::mutex> guard(lock);
+
+  // Forget any older entry for the file.
+  std::unordered_map<std::string, std::list<Entry>::iterator>::iterator found = by_path.find(path);
+  if(found != by_path.end()) erase(found->second);
+
+  // If the pixels would fill more than the whole budget,
+  // don't evict everything else for them.
+  if(BYTES > counts.budget) return;
+
+  Entry entry;
+  entry.path = path;
+  entry.stamp = stamp;
+  entry.pixels = pixels;
+  entry.bytes = BYTES;
+
+  lru.push_front(entry);
+  by_path[path] = lru.begin();
+  ++counts.entries;
+  counts.bytes += BYTES;
+
+  trim();
+}
+
+
+// Drops the entry for path, if there is one.
+void DecodeCache :: forget(const std::string & path)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  std::unordered_map<std::string, std::list<Entry>::iterator>::iterator found = by_path.find(path);
+  if(found != by_path.end()) erase(found->second);
+}
+
+
+// Drops every entry.
+void DecodeCache :: clear(void)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  lru.clear();
+  by_path.clear();
+  counts.entries = 0;
+  counts.bytes = 0;
+}
+
+
+/* ****************************************************
+\\ Sets the byte budget, evicting the least recently
+// used entries until it is met.
+\\
+// @param budget: The most bytes of pixels to hold.
+\\ 0 disables the cache.
+//
+\\ ****************************************************/
+void DecodeCache :: setBudget(size_t budget)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  counts.budget = budget;
+  trim();
+}
+
+
+// True if the cache has a byte budget.
+bool DecodeCache :: enabled(void) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return counts.budget != 0;
+}
+
+
+// Returns the counters, and the current size.
+DecodeCacheStats DecodeCache :: stats(void) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return counts;
+}
+
+
+// Sets the hit, miss and eviction counters to 0.
+void DecodeCache :: resetStats(void)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  counts.hits = counts.misses = counts.evictions = 0;
+}
+
+
+/* ****************************************************
+\\ Returns the cache shared by every Image. It lives
+// until the program exits (never destroyed, so Images
+\\ opened from static destructors still find it).
+//
+\\ ****************************************************/
+DecodeCache & DecodeCache :: shared(void)
+{
+  static DecodeCache * cache = new DecodeCache();
+  return *cache;
+}
+
+
+/* ****************************************************
+\\ (Private) - Removes an entry from the list and the
+// map. Its pixels stay alive while Images share them.
+\\ Expects lock.
+//
+\\ ****************************************************/
+void DecodeCache :: erase(std::list<Entry>::iterator entry)
+{
+  counts.bytes -= entry->bytes;
+  --counts.entries;
+
+  by_path.erase(entry->path);
+  lru.erase(entry);
+}
+
+
+/* ****************************************************
+\\ (Private) - Evicts entries from the back (the least
+// recently used) until the bytes held are within the
+\\ budget. Expects lock.
+//
+\\ ****************************************************/
+void DecodeCache :: trim(void)
+{
+  while(counts.bytes > counts.budget && !lru.empty())
+  {
+    erase(--lru.end());
+    ++counts.evictions;
+  }
+}
@@ -0,0 +1,169 @@
+/* ***************************************************************
+\\ File Name:  DecodeCache.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Declarations for a process-wide cache of decoded image
+\\ files. While it has a byte budget, Image::openImage looks files
+// up here first, and a repeat open of an unchanged file shares the
+\\ cached pixels (copy-on-write) instead of decoding again. See
+// DecodeCache.cpp for more information.
+\\
+// ***************************************************************/
+
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "opencv2/core/core.hpp"
+
+
+/* *************************************************
+\\ The identity of a file's contents, as far as stat
+// can tell: a rewrite, or a replacement by rename,
+\\ changes at least one field.
+//
+\\ *************************************************/
+struct FileStamp
+{
+  // Initialize all fields as an unknown file.
+  FileStamp(void);
+
+  // Fills in the stamp of path. False if it can't be stat'ed.
+  bool read(const std::string & path);
+
+  bool operator==(const FileStamp & other) const;
+
+  // The file's size in bytes, and its modification
+  // time in nanoseconds (seconds where that's all
+  // the platform records).
+  long long size, mtime_ns;
+
+  // The file's inode and device.
+  unsigned long long inode, device;
+};
+
+
+/* *************************************************
+\\ A snapshot of a DecodeCache's counters.
+//
+\\ *************************************************/
+struct DecodeCacheStats
+{
+  // Initialize all counters to 0.
+  DecodeCacheStats(void);
+
+         // Lookups that found an unchanged file's pixels,
+  size_t hits,
+         // and lookups that didn't (absent, or stale).
+         misses,
+         // Entries dropped to stay within the budget.
+         evictions,
+         // The entries held, and the bytes of their pixels.
+         entries,
+         bytes,
+         // The byte budget (0 when disabled).
+         budget;
+};
+
+
+/* *************************************************
+\\ A least-recently-used cache of decoded pixels,
+// keyed by file name and FileStamp. Cached pixels are
+\\ never modified: an Image sharing them takes its own
+// copy before its first write (see Image::detach).
+\\
+// The pixels of entries stay alive while any Image
+\\ shares them, evicted or not; the budget only counts
+// what the cache itself holds. Safe to use from any
+\\ number of threads.
+//
+\\ *************************************************/
+class DecodeCache
+{
+  public:
+
+    // Initializes an empty cache holding at most budget bytes
+    // of pixels. A budget of 0 disables it.
+    explicit DecodeCache(size_t budget = 0);
+
+    // Returns the cached pixels of path, if they were cached
+    // with the same stamp (and marks them most recently used).
+    // Null otherwise; a stale entry is dropped.
+    std::shared_ptr<cv::Mat> find( const std::string & path,
+                                   const FileStamp & stamp );
+
+    // Caches the pixels decoded from path when it had stamp,
+    // replacing any older entry, and evicts the least recently
+    // used entries until the budget is met. Pixels larger than
+    // the whole budget aren't cached.
+    void insert( const std::string & path,
+                 const FileStamp & stamp,
+                 const std::shared_ptr<cv::Mat> & pixels );
+
+    // Drops the entry for path, if there is one (e.g. once the
+    // file has been written).
+    void forget(const std::string & path);
+
+    // Drops every entry.
+    void clear(void);
+
+    // Sets the byte budget, evicting entries to meet it.
+    // 0 disables the cache, and empties it.
+    void setBudget(size_t budget);
+
+    // True if the cache has a byte budget.
+    bool enabled(void) const;
+
+    // Returns the counters, and the current size.
+    DecodeCacheStats stats(void) const;
+
+    // Sets the hit, miss and eviction counters to 0.
+    void resetStats(void);
+
+    // Returns the cache Image::openImage uses. Disabled until
+    // given a budget. Never destroyed, like WorkPool::shared.
+    static DecodeCache & shared(void);
+
+  private:
+
+    // A cached file.
+    struct Entry
+    {
+      std::string path;
+      FileStamp stamp;
+      std::shared_ptr<cv::Mat> pixels;
+      size_t bytes;
+    };
+
+    // Not copyable.
+    DecodeCache(const DecodeCache &) = delete;
+    DecodeCache & operator=(const DecodeCache &) = delete;
+
+    // Removes an entry. Expects lock.
+    void erase(std::list<Entry>::iterator entry);
+
+    // Evicts least recently used entries until
+    // the budget is met. Expects lock.
+    void trim(void);
+
+    // The entries, most recently used first, and
+    // the same entries by path.
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> by_path;
+
+    // The counters, the bytes held and the budget.
+    DecodeCacheStats counts;
+
+    // Guards every member above.
+    mutable std::mutex lock;
+};
+
+#endif // DECODE_CACHE_H
@@ -12,6 +12,23 @@
 
 #include "Image.h"
 
+// For telling missing files apart from undecodable ones.
+#include <sys/stat.h>
+
+// For the headless mode flag.
+#include <atomic>
+#include <cstdlib>
+
+// For extension lookup and format sniffing.
+#include <cctype>
+#include <cstdint>
+
+// For parallelForRows.
+#include "WorkPool.h"
+
+// For sharing the pixels of repeat opens.
+#include "DecodeCache.h"
+
 
 // *************************** |
 // Global Constant Definitions |
@@ -21,7 +38,8 @@
 // Size of the VALID_EXTENSIONS array.
 const static uint EXTENSION_COUNT = 6;
 
-// An array containing the valid formats and their attributes.
+// An array containing the valid formats and their attributes,
+// in ImageFormat order (see also findExtension).
 const static FormatTrip VALID_EXTENSIONS[EXTENSION_COUNT] = {
   // Portable Network Graphics.
   FormatTrip(".png",  CV_IMWRITE_PNG_COMPRESSION, 9),
@@ -34,6 +52,429 @@ const static FormatTrip VALID_EXTENSIONS[EXTENSION_COUNT] = {
   FormatTrip(".ppm",  CV_IMWRITE_PXM_BINARY, 1)
 };
 
+static_assert(EXTENSION_COUNT == FORMAT_PPM + 1, "VALID_EXTENSIONS must match ImageFormat");
+
+// The channel values a band of rows should hold, and the bands
+// each thread should get, in a parallel pass (see rowGrain).
+const static size_t BAND_VALUES = 1 << 15;
+const static size_t BANDS_PER_THREAD = 4;
+
+
+// ********************* |
+// Helper Functions      |
+// ********************* V
+
+/* ****************************************************
+\\ Called after a file failed to load. A single stat
+// tells whether the file is missing, or exists but
+\\ could not be decoded.
+//
+\\ @param FILENAME: The name of the file that failed.
+//
+\\ ****************************************************/
+static ImageStatus failureStatus(const std::string & FILENAME)
+{
+  struct stat st;
+  return (stat(FILENAME.c_str(), &st) == 0) ? IMG_UNDECODABLE : IMG_FILE_MISSING;
+}
+
+
+/* ****************************************************
+\\ Decodes a whole image file, as it is stored (any
+// depth, with alpha). Times the decode, and counts the
+\\ bytes decoded.
+//
+\\ @return: The pixels. Empty if the file could not be
+// opened or decoded.
+\\
+// ****************************************************/
+static cv::Mat decodeFile(const std::string & FILENAME)
+{
+  cv::Mat decoded;
+  {
+    IMAGE_STAT_TIMER(STAT_DECODE);
+    decoded = cv::imread(FILENAME, cv::IMREAD_UNCHANGED);
+  }
+
+  IMAGE_STAT_ADD(STAT_BYTES_DECODED, decoded.total() * decoded.elemSize());
+  return decoded;
+}
+
+
+/* ****************************************************
+\\ Loads the pixels of an image file. While the shared
+// DecodeCache is enabled, an unchanged file's cached
+\\ pixels are returned without decoding, and freshly
+// decoded ones are cached; either way they may be
+\\ shared, so the Image must detach before writing.
+//
+\\ @return: The pixels. Null if the file could not be
+// opened or decoded.
+\\
+// ****************************************************/
+static std::shared_ptr<cv::Mat> loadPixels(const std::string & FILENAME)
+{
+  DecodeCache & cache = DecodeCache::shared();
+
+  // Stamp the file before decoding it, so that a write
+  // during the decode makes the entry stale, not wrong.
+  FileStamp stamp;
+  const bool CACHED = cache.enabled() && stamp.read(FILENAME);
+
+  if(CACHED)
+  {
+    const std::shared_ptr<cv::Mat> HIT = cache.find(FILENAME, stamp);
+    if(HIT) return HIT;
+  }
+
+  const cv::Mat DECODED = decodeFile(FILENAME);
+  if(DECODED.empty()) return std::shared_ptr<cv::Mat>();
+
+  const std::shared_ptr<cv::Mat> PIXELS = std::make_shared<cv::Mat>(DECODED);
+  if(CACHED) cache.insert(FILENAME, stamp, PIXELS);
+
+  return PIXELS;
+}
+
+
+// True if plane is a CV_8UC1 plane the size of img.
+static bool isPlaneOf( const cv::Mat & plane,
+                       const cv::Mat & img )
+{
+  return plane.type() == CV_8UC1 && plane.rows == img.rows && plane.cols == img.cols;
+}
+
+
+/* ****************************************************
+\\ Returns the calling thread's spare pixel buffer: the
+// pixels of an Image being reopened, offered to the
+\\ decode that replaces them.
+//
+\\ ****************************************************/
+static cv::Mat & spareBuffer(void)
+{
+  static thread_local cv::Mat spare;
+  return spare;
+}
+
+
+/* ****************************************************
+\\ The allocator reopenImage decodes with. A request of
+// exactly the spare buffer's size and type takes the
+\\ spare over, so decoding same-sized images reuses
+// one buffer. Anything else is allocated the way Mat
+\\ allocates by default, so every buffer is freed the
+// same way, whichever route it came from.
+\\
+// ****************************************************/
+#if CV_MAJOR_VERSION < 3
+class RecycleAllocator : public cv::MatAllocator
+{
+  public:
+
+    void allocate( int dims,
+                   const int * sizes,
+                   int type,
+                   int *& refcount,
+                   uchar *& datastart,
+                   uchar *& data,
+                   size_t * step )
+    {
+      cv::Mat & spare = spareBuffer();
+
+      // If the spare fits, and nothing else refers to
+      // it, take over its reference. Its steps match.
+      if( spare.refcount && *spare.refcount == 1 && spare.isContinuous() &&
+          (!spare.allocator || spare.allocator == this) && dims == 2 &&
+          spare.rows == sizes[0] && spare.cols == sizes[1] && spare.type() == CV_MAT_TYPE(type) )
+      {
+        refcount = spare.refcount;
+        datastart = spare.datastart;
+        data = spare.data;
+
+        spare.refcount = nullptr;
+        spare.release();
+        return;
+      }
+
+      // Otherwise allocate a new buffer, with its
+      // reference count at the end, as Mat does.
+      const size_t BYTES = cv::alignSize(step[0] * sizes[0], sizeof(*refcount));
+
+      data = datastart = static_cast<uchar *>(cv::fastMalloc(BYTES + sizeof(*refcount)));
+      refcount = reinterpret_cast<int *>(data + BYTES);
+      *refcount = 1;
+    }
+
+    void deallocate( int *,
+                     uchar * datastart,
+                     uchar * )
+    {
+      cv::fastFree(datastart);
+    }
+};
+#else
+// The type of MatAllocator's access flags (an enum from OpenCV 4).
+#if CV_MAJOR_VERSION < 4
+typedef int RecycleAccess;
+#else
+typedef cv::AccessFlag RecycleAccess;
+#endif
+
+class RecycleAllocator : public cv::MatAllocator
+{
+  public:
+
+    cv::UMatData * allocate( int dims,
+                             const int * sizes,
+                             int type,
+                             void * data0,
+                             size_t * step,
+                             RecycleAccess flags,
+                             cv::UMatUsageFlags usage ) const
+    {
+      const cv::Mat & SPARE = spareBuffer();
+
+      // If the spare fits, and nothing else refers to it,
+      // hand over its data. Mat::create adds the decode's
+      // reference, and the spare's is dropped after the
+      // decode. The data is still freed by its own allocator.
+      if( !data0 && SPARE.u && SPARE.u->refcount == 1 && SPARE.u->urefcount == 0 &&
+          SPARE.isContinuous() && SPARE.datastart == SPARE.u->data && dims == 2 && SPARE.dims == 2 &&
+          SPARE.rows == sizes[0] && SPARE.cols == sizes[1] && SPARE.type() == CV_MAT_TYPE(type) )
+      {
+        step[0] = SPARE.step[0];
+        step[1] = SPARE.step[1];
+        return SPARE.u;
+      }
+
+      // Otherwise allocate as Mat does by default.
+      return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data0, step, flags, usage);
+    }
+
+    bool allocate( cv::UMatData * data,
+                   RecycleAccess flags,
+                   cv::UMatUsageFlags usage ) const
+    {
+      return cv::Mat::getStdAllocator()->allocate(data, flags, usage);
+    }
+
+    void deallocate(cv::UMatData * data) const
+    {
+      cv::Mat::getStdAllocator()->deallocate(data);
+    }
+};
+#endif
+
+
+// Returns the allocator reopenImage decodes with. Never destroyed,
+// since pixels it allocates may outlive other statics.
+static cv::MatAllocator * recycleAllocator(void)
+{
+  static RecycleAllocator * const ALLOCATOR = new RecycleAllocator;
+  return ALLOCATOR;
+}
+
+
+/* ****************************************************
+\\ Reads a whole file into buf, reusing its capacity.
+//
+\\ @return: False if the file could not be read.
+//
+\\ ****************************************************/
+static bool readFile( const std::string & FILENAME,
+                      std::vector<uchar> & buf )
+{
+  std::FILE * in = std::fopen(FILENAME.c_str(), "rb");
+  if(!in) return false;
+
+  // Size the buffer to the file, then fill it.
+  bool ok = std::fseek(in, 0, SEEK_END) == 0;
+  const long LEN = ok ? std::ftell(in) : -1;
+  ok = LEN >= 0 && std::fseek(in, 0, SEEK_SET) == 0;
+
+  if(ok)
+  {
+    buf.resize(static_cast<size_t>(LEN));
+    ok = std::fread(buf.data(), 1, buf.size(), in) == buf.size();
+  }
+
+  std::fclose(in);
+  return ok;
+}
+
+
+// Returns c in lower case, if it is an ASCII letter.
+constexpr char lowerAscii(char c)
+{ return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c; }
+
+// Packs the first len characters of ext (lowercased, 8 bits each)
+// into one integer. Unique for extensions of up to four characters.
+constexpr uint64_t packExtension(const char * ext, size_t len)
+{ return len ? (packExtension(ext, len - 1) << 8) | static_cast<uchar>(lowerAscii(ext[len - 1])) : 0; }
+
+// Returns the lookup key of an extension of len characters (no dot).
+constexpr uint64_t extensionKey(const char * ext, size_t len)
+{ return (static_cast<uint64_t>(len) << 32) | packExtension(ext, len); }
+
+// Returns the lookup key of an extension literal, e.g. "png".
+template <size_t N>
+constexpr uint64_t extensionKey(const char (& ext)[N])
+{ return extensionKey(ext, N - 1); }
+
+
+/* ****************************************************
+\\ Looks up an extension in VALID_EXTENSIONS, ignoring
+// case. Each extension's key is unique and computed at
+\\ compile time, so the lookup is a single switch,
+// without building or comparing strings.
+\\
+// @param ext, len: The extension's characters, not
+\\ including the dot.
+//
+\\ @return: The index of the extension (an ImageFormat),
+// or -1.
+\\
+// ****************************************************/
+static int findExtension( const char * ext,
+                          size_t len )
+{
+  // Longer than any valid extension (or than a key holds).
+  if(len > 4) return -1;
+
+  switch(extensionKey(ext, len))
+  {
+    case extensionKey("png"):  return FORMAT_PNG;
+    case extensionKey("jpg"):  return FORMAT_JPG;
+    case extensionKey("jpeg"): return FORMAT_JPEG;
+    case extensionKey("pbm"):  return FORMAT_PBM;
+    case extensionKey("pgm"):  return FORMAT_PGM;
+    case extensionKey("ppm"):  return FORMAT_PPM;
+
+    // Not a valid extension.
+    default: return -1;
+  }
+}
+
+
+/* ****************************************************
+\\ Finds the dot that begins a filename's extension.
+// Only the last path component is searched, and a dot
+\\ that begins it (e.g. ".png") is part of the name.
+//
+\\ @param FILENAME: The filename, possibly with a path.
+//
+\\ @return: The index of the dot, or npos if FILENAME
+// has no extension.
+\\
+// ****************************************************/
+static size_t extensionDot(const std::string & FILENAME)
+{
+  // The last dot or path separator.
+  const size_t DOT = FILENAME.find_last_of("./\\");
+
+  // If it isn't a dot, there's no extension.
+  if(DOT == std::string::npos || FILENAME[DOT] != '.') return std::string::npos;
+
+  // If the dot begins the name, there's no extension.
+  if(DOT == 0 || FILENAME[DOT - 1] == '/' || FILENAME[DOT - 1] == '\\') return std::string::npos;
+
+  return DOT;
+}
+
+
+/* ****************************************************
+\\ Builds the imwrite/imencode params for a format.
+//
+\\ @param ext_idx: The index of the format in
+// VALID_EXTENSIONS.
+\\
+// @param options: Encoder settings. Negative fields
+\\ fall back to the format's FormatTrip quality, or
+// are left to OpenCV.
+\\
+// ****************************************************/
+static std::vector<int> encodeParams( int ext_idx,
+                                      const EncodeOptions & options )
+{
+  // The matching FormatTrip.
+  const FormatTrip & FORMAT = VALID_EXTENSIONS[ext_idx];
+
+  // Vector of params for image to be saved.
+  std::vector<int> params;
+
+  // Picks the override if set, or the FormatTrip quality.
+  #define OR_DEFAULT(v) static_cast<int>((v) >= 0 ? (v) : FORMAT.quality)
+
+  switch(FORMAT.format)
+  {
+    case CV_IMWRITE_PNG_COMPRESSION:
+      params.push_back(CV_IMWRITE_PNG_COMPRESSION);
+      params.push_back(OR_DEFAULT(options.png_compression));
+      // IMWRITE_PNG_STRATEGY (17) is an enum value in every
+      // OpenCV version, not a macro, so it can't be #ifdef'd.
+      if(options.png_strategy >= 0)
+      { params.push_back(cv::IMWRITE_PNG_STRATEGY); params.push_back(options.png_strategy); }
+      break;
+
+    case CV_IMWRITE_JPEG_QUALITY:
+      params.push_back(CV_IMWRITE_JPEG_QUALITY);
+      params.push_back(OR_DEFAULT(options.jpeg_quality));
+      // These encoder flags were added in OpenCV 3 (as enum
+      // values, so the version is checked instead).
+#if CV_MAJOR_VERSION >= 3
+      if(options.jpeg_progressive >= 0)
+      { params.push_back(cv::IMWRITE_JPEG_PROGRESSIVE); params.push_back(options.jpeg_progressive); }
+      if(options.jpeg_optimize >= 0)
+      { params.push_back(cv::IMWRITE_JPEG_OPTIMIZE); params.push_back(options.jpeg_optimize); }
+#endif
+      break;
+
+    // Initialize params with the compression format and quality.
+    default:
+      params.push_back(FORMAT.format);
+      params.push_back(FORMAT.quality);
+  }
+
+  #undef OR_DEFAULT
+
+  return params;
+}
+
+
+// ***************************** |
+// EncodeOptions Implementation  |
+// ***************************** V
+
+/* ****************************************************
+\\ Initializes encoder settings from a preset.
+//
+\\ @param preset: Fast, balanced or smallest output.
+//
+\\ ****************************************************/
+EncodeOptions :: EncodeOptions(EncodePreset preset) :
+png_compression(9), png_strategy(-1), jpeg_quality(-1),
+jpeg_progressive(-1), jpeg_optimize(-1)
+{
+  switch(preset)
+  {
+    // Least encoder effort.
+    case ENCODE_FAST:
+      png_compression = 1; jpeg_optimize = 0; jpeg_progressive = 0;
+      break;
+    // Most of the size benefit, at a fraction of the time.
+    case ENCODE_BALANCED:
+      png_compression = 3; jpeg_optimize = 1; jpeg_progressive = 0;
+      break;
+    // Smallest output, regardless of encode time.
+    case ENCODE_SMALLEST:
+      png_compression = 9; jpeg_optimize = 1; jpeg_progressive = 1;
+      break;
+  }
+
+  return;
+}
+
 
 // ********************* |
 // Image Implementation  |
@@ -45,10 +486,11 @@ const static FormatTrip VALID_EXTENSIONS[EXTENSION_COUNT] = {
 \\ @param filename: The name of the image's file.
 //
 \\ ****************************************************/
-Image :: Image(const std::string & filename) : super(nullptr)
+Image :: Image(const std::string & filename) : super(nullptr), rgb_order(false), status(IMG_OK),
+                                               view(false)
 {
   // Initialize filename with the filename param.
-  this->filename = filename;
+  setFilename(filename);
 
   // Try to open the image. If that fails, set super to null.
   if(!openImage()) super = nullptr;
@@ -58,23 +500,113 @@ Image :: Image(const std::string & filename) : super(nullptr)
 
 
 /* ****************************************************
-\\ Copies an existing Image.
+\\ Copies an existing Image. The two Images share one
+// pixel buffer until either of them is modified, at
+\\ which point the modified Image takes its own copy.
+// A writable mapping is the exception: its pixels are
+\\ the file, so both Images write to the file.
 //
 \\ @param img_src: The Image to be copied.
 //
 \\ ****************************************************/
-Image :: Image(const Image & img_src) : filename(generateFilename(img_src.filename))
+Image :: Image(const Image & img_src) : filename(generateFilename(img_src.filename)),
+                                        format(hasValidExtension(filename)),
+                                        super(img_src.super),
+                                        rgb_order(img_src.rgb_order),
+                                        status(img_src.status),
+                                        view(false),
+                                        header(img_src.header),
+                                        pending_file(img_src.pending_file)
 {
-  // If the source Image's super pointer isn't null,
-  // initialize super with its copy constructor.
-  if(img_src.super) super = std::unique_ptr<cv::Mat>(new cv::Mat(*img_src.super));
-  // Initialize super to null.
-  else super = nullptr;
+  // Views write through to shared pixels, so a copy of a view,
+  // or of an Image with views, can't share them; it takes its own.
+  // (Checked in this order so a pending source isn't decoded.)
+  if((img_src.view || img_src.hasViews()) && img_src.initialized()) super = std::make_shared<cv::Mat>(super->clone());
+
+  return;
+}
+
 
+/* ****************************************************
+\\ Moves an existing Image. No pixels are copied, and
+// img_src is left uninitialized.
+\\
+// @param img_src: The Image to be moved.
+\\
+// ****************************************************/
+Image :: Image(Image && img_src) noexcept : filename(std::move(img_src.filename)),
+                                            format(img_src.format),
+                                            super(std::move(img_src.super)),
+                                            rgb_order(img_src.rgb_order),
+                                            status(img_src.status),
+                                            view(img_src.view),
+                                            views(std::move(img_src.views)),
+                                            header(img_src.header),
+                                            pending_file(std::move(img_src.pending_file))
+{
+  img_src.pending_file.clear();
   return;
 }
 
 
+/* ****************************************************
+\\ Replaces this Image with a copy of img_src. As with
+// the copy constructor, the pixels are shared until
+\\ either Image is modified, and the filename is a
+// modified version of img_src's.
+\\
+// @param img_src: The Image to be copied.
+\\
+// ****************************************************/
+Image & Image :: operator=(const Image & img_src)
+{
+  // Copying an Image onto itself changes nothing.
+  if(this == &img_src) return *this;
+
+  // Share the source's pixels (or copy them, if views are
+  // involved, as in the copy constructor), and generate a
+  // new filename.
+  setFilename(generateFilename(img_src.filename));
+  const bool DEEP = (img_src.view || img_src.hasViews()) && img_src.initialized();
+  super = DEEP ? std::make_shared<cv::Mat>(img_src.super->clone()) : img_src.super;
+  rgb_order = img_src.rgb_order;
+  status = img_src.status;
+  view = false;
+  views.reset();
+  header = img_src.header;
+  pending_file = img_src.pending_file;
+
+  return *this;
+}
+
+
+/* ****************************************************
+\\ Replaces this Image with the contents of img_src,
+// leaving img_src uninitialized.
+\\
+// @param img_src: The Image to be moved.
+\\
+// ****************************************************/
+Image & Image :: operator=(Image && img_src) noexcept
+{
+  // Take the source's filename and pixels.
+  filename = std::move(img_src.filename);
+  format = img_src.format;
+  super = std::move(img_src.super);
+  rgb_order = img_src.rgb_order;
+  status = img_src.status;
+  view = img_src.view;
+  views = std::move(img_src.views);
+  header = img_src.header;
+  pending_file = std::move(img_src.pending_file);
+
+  // Leave the source uninitialized, not pending.
+  if(this != &img_src) img_src.pending_file.clear();
+
+  return *this;
+}
+
+
 /* ****************************************************
 \\ Deallocates all dynamic Image memory (i.e., Calls
 // the cv::Mat (base class) destructor).
@@ -96,6 +628,9 @@ Image :: ~Image(void)
 \\ ****************************************************/
 uint Image :: getWidth(void) const
 {
+  // A pending Image has the width from its header.
+  if(isPending()) return header.width;
+
   // If the image is not initialized,
   // there is no height. i.e., 0.
   if(!initialized()) return 0;
@@ -111,6 +646,9 @@ uint Image :: getWidth(void) const
 \\ ****************************************************/
 uint Image :: getHeight(void) const
 {
+  // A pending Image has the height from its header.
+  if(isPending()) return header.height;
+
   // If the image is not initialized,
   // there is no height. i.e., 0.
   if(!initialized()) return 0;
@@ -120,6 +658,64 @@ uint Image :: getHeight(void) const
 }
 
 
+/* ****************************************************
+\\ Returns a unique pointer to an array of unsigned
+// integers, containing the channel values for the
+\\ pixel at the specified row and column.
+//
+\\ @param row: The row number for the pixel to be
+// retrieved.
+\\
+// @param col: The column number for the pixel to be
+\\ retrieved.
+//
+\\ ****************************************************/
+std::unique_ptr<uint[]> Image :: getArrColors_int( uint row,
+                                                   uint col ) const
+{
+  // If no image is loaded, return an empty unique pointer.
+  if(!initialized()) return std::unique_ptr<uint[]>();
+
+  // Create an int array for storing the colors.
+  std::unique_ptr<uint[]> arr_clrs_int(new uint[super->channels()]);
+
+  // Fill the int array directly. If that fails (pixel out of
+  // range, or unsupported channel count), return nullptr.
+  if(!getArrColors_dispatch(row, col, arr_clrs_int.get()))
+    return std::unique_ptr<uint[]>();
+
+  // Return the integer array of channel values.
+  return arr_clrs_int;
+}
+
+
+/* ****************************************************
+\\ Copies the channel values for the pixel at the
+// specified row and column into c_arr, without any
+\\ heap allocation.
+//
+\\ @param row: The row number for the pixel.
+//
+\\ @param col: The column number for the pixel.
+//
+\\ @param c_arr: Destination for the channel values.
+// Must hold at least getChannels() elements.
+\\
+// @return: True if the channel values were copied.
+\\
+// ****************************************************/
+bool Image :: getArrColors_int( uint row,
+                                uint col,
+                                uint c_arr[] ) const
+{
+  // If no destination was given, report failure.
+  if(!c_arr) return false;
+
+  // Copy the channel values.
+  return getArrColors_dispatch(row, col, c_arr);
+}
+
+
 /* ****************************************************
 \\ Returns a unique pointer to an array of unsigned
 // characters, containing the channel values for the
@@ -132,337 +728,1199 @@ uint Image :: getHeight(void) const
 \\ retrieved.
 //
 \\ ****************************************************/
-std::unique_ptr<uint[]> Image :: getArrColors_int( uint row,
-                                                   uint col ) const
+std::unique_ptr<uchar[]> Image :: getArrColors( uint row,
+                                                uint col ) const
+{
+  // If no image is loaded, return an empty unique pointer.
+  if(!initialized()) return std::unique_ptr<uchar[]>();
+
+  // Create a char array for storing the colors.
+  std::unique_ptr<uchar[]> arr_clrs(new uchar[super->channels()]);
+
+  // Fill the array. If that fails (pixel out of range,
+  // or unsupported channel count), return nullptr.
+  if(!getArrColors_dispatch(row, col, arr_clrs.get()))
+    return std::unique_ptr<uchar[]>();
+
+  // Return the character array of channel values.
+  return arr_clrs;
+}
+
+
+/* ****************************************************
+\\ Copies the channel values for the pixel at the
+// specified row and column into c_arr, without any
+\\ heap allocation.
+//
+\\ @param row: The row number for the pixel.
+//
+\\ @param col: The column number for the pixel.
+//
+\\ @param c_arr: Destination for the channel values.
+// Must hold at least getChannels() elements.
+\\
+// @return: True if the channel values were copied.
+\\
+// ****************************************************/
+bool Image :: getArrColors( uint row,
+                            uint col,
+                            uchar c_arr[] ) const
+{
+  // If no destination was given, report failure.
+  if(!c_arr) return false;
+
+  // Copy the channel values.
+  return getArrColors_dispatch(row, col, c_arr);
+}
+
+
+
+/* ****************************************************
+\\ Returns a read-only view of the specified row. The
+// row is validated once, so loops over the view need
+\\ no per-pixel checks.
+//
+\\ @param row_idx: The row number to be viewed.
+//
+\\ @return: A view of every channel value in the row,
+// or an empty view if the row does not exist.
+\\
+// ****************************************************/
+ImageRow<const uchar> Image :: row(uint row_idx) const
+{
+  // If the row does not exist, return an empty view.
+  if(!initialized() || row_idx >= static_cast<uint>(super->rows))
+    return ImageRow<const uchar>();
+
+  // Return a view of the row's pixels.
+  return ImageRow<const uchar>( super->ptr<uchar>(row_idx),
+                                super->cols,
+                                super->channels() );
+}
+
+
+/* ****************************************************
+\\ Returns a writable view of the specified row.
+//
+\\ @param row_idx: The row number to be viewed.
+//
+\\ @return: A view of every channel value in the row,
+// or an empty view if the row does not exist.
+\\
+// ****************************************************/
+ImageRow<uchar> Image :: row(uint row_idx)
+{
+  // If the row does not exist, return an empty view.
+  if(!initialized() || row_idx >= static_cast<uint>(super->rows))
+    return ImageRow<uchar>();
+
+  // The view can modify the row, so take
+  // a private copy of the pixels if shared.
+  detach();
+
+  // Return a view of the row's pixels.
+  return ImageRow<uchar>( super->ptr<uchar>(row_idx),
+                          super->cols,
+                          super->channels() );
+}
+
+
+/* ****************************************************
+\\ Returns a view of a region of the Image. The view's
+// pixels are a cv::Mat ROI of this Image's, so nothing
+\\ is copied: writes through the view land here, and
+// are never detached. This Image takes a private copy
+\\ of its pixels first, if shared, so the view cannot
+// write into another Image's.
+\\
+// The pixels stay alive as long as either Image does.
+\\ Mapped pixels aren't reference counted, so a view of
+// a mapped Image holds on to the whole mapping. Views
+\\ are counted apart (see hasViews), so it isn't cloned.
+//
+\\ @param x, y: The column and row of the region's
+// top-left pixel.
+\\
+// @param width, height: The size of the region.
+\\
+// @return: The view. Uninitialized if the region does
+\\ not fit within the Image.
+//
+\\ ****************************************************/
+Image Image :: subImage( uint x,
+                         uint y,
+                         uint width,
+                         uint height )
+{
+  // The view to be returned.
+  Image sub;
+
+  // If the region does not fit within the Image, return an empty view.
+  if(!regionInRange(y, x, height, width)) return sub;
+
+  // The view writes into the buffer, so it must be ours alone.
+  detach();
+
+  const cv::Mat ROI = (*super)(cv::Rect(x, y, width, height));
+
+  // Refcounted pixels are kept alive by the ROI itself. A
+  // mapping (possibly under a view) is kept alive by holding
+  // on to its Mat.
+  if(isMapped() || view)
+  {
+    const std::shared_ptr<cv::Mat> MAPPING = super;
+    sub.super = std::shared_ptr<cv::Mat>(new cv::Mat(ROI), [MAPPING](cv::Mat * roi) { delete roi; });
+  }
+  else sub.super = std::make_shared<cv::Mat>(ROI);
+
+  // Count the view, against the buffer it views. A view of a
+  // view is counted by the Image they both view.
+  if(!view && !hasViews()) views = std::make_shared<std::weak_ptr<cv::Mat>>(super);
+  sub.views = views;
+
+  sub.setFilename(generateFilename(filename));
+  sub.rgb_order = rgb_order;
+  sub.status = IMG_OK;
+  sub.view = true;
+
+  return sub;
+}
+
+
+/* ****************************************************
+\\ Writes the intensity of every pixel into a single
+// channel plane.
+\\
+// @param dst: Destination plane. (Re)allocated as a
+\\ getHeight() x getWidth() CV_8UC1 Mat if needed.
+//
+\\ @param mode: Mean or luma intensity.
+//
+\\ @return: True if the map was written.
+//
+\\ ****************************************************/
+bool Image :: getIntensityMap( cv::Mat & dst,
+                               IntensityMode mode ) const
+{
+  // Map a region covering the whole Image.
+  return getIntensityMap(dst, 0, 0, getHeight(), getWidth(), mode);
+}
+
+
+/* ****************************************************
+\\ Writes the intensity of every pixel in a region into
+// a single channel plane. Each row is reduced by the
+\\ widest SIMD kernel the CPU supports. The kernels
+// are 8-bit, so other channel types are refused.
+//
+\\ @param dst: Destination plane. (Re)allocated as a
+// height x width CV_8UC1 Mat if needed.
+\\
+// @param row, col: The top-left pixel of the region.
+\\
+// @param height, width: The size of the region.
+\\
+// @param mode: Mean or luma intensity.
+\\
+// @return: True if the map was written.
+\\
+// ****************************************************/
+bool Image :: getIntensityMap( cv::Mat & dst,
+                               uint row,
+                               uint col,
+                               uint height,
+                               uint width,
+                               IntensityMode mode ) const
+{
+  // If the region does not fit within the Image, or
+  // the Image isn't 8-bit, report failure.
+  if(!regionInRange(row, col, height, width) || super->depth() != CV_8U) return false;
+
+  IMAGE_STAT_TIMER(STAT_BULK);
+
+  // Allocate the destination plane (no-op if already correct).
+  dst.create(height, width, CV_8UC1);
+
+  // The number of channels per pixel.
+  const uint CHANS = super->channels();
+
+  // Weight the channels of RGB-ordered pixels (mapped PPMs)
+  // as what they are, not as BGR.
+  if(mode == LUMA_INTENSITY && rgb_order) mode = LUMA_RGB_INTENSITY;
+
+  // Reduce each row of the region.
+  for(uint r = 0; r < height; ++r)
+    intensityRow( super->ptr<uchar>(row + r) + col * CHANS,
+                  dst.ptr<uchar>(r), width, CHANS, mode );
+
+  // Report success.
+  return true;
+}
+
+
+/* ****************************************************
+\\ Splits the Image into one plane per channel. Rows
+// are split in parallel, each by the widest SIMD
+\\ kernel the CPU supports.
+//
+\\ @param planes: Resized to getChannels() planes, each
+// (re)allocated as a height x width CV_8UC1 Mat if
+\\ needed.
+//
+\\ @return: True if the planes were written. False if
+// the Image is uninitialized or isn't 8-bit.
+\\
+// ****************************************************/
+bool Image :: splitChannels(std::vector<cv::Mat> & planes) const
+{
+  // If the Image isn't 8-bit, report failure.
+  if(!initialized() || super->depth() != CV_8U) return false;
+
+  const uint CHANS = super->channels();
+
+  // Allocate the planes (no-op if already correct).
+  planes.resize(CHANS);
+  for(uint clr = 0; clr < CHANS; ++clr) planes[clr].create(super->rows, super->cols, CV_8UC1);
+
+  return parallelForRows([&planes, CHANS](uint r, ImageRow<const uchar> pixels)
+  {
+    uchar * dst[CV_CN_MAX];
+    for(uint clr = 0; clr < CHANS; ++clr) dst[clr] = planes[clr].ptr<uchar>(r);
+
+    splitRow(pixels.data, dst, pixels.width, CHANS);
+  });
+}
+
+
+/* ****************************************************
+\\ Copies one channel of the Image into a plane.
+//
+\\ @param clr: The channel index, in the order the
+// pixels are stored (so channel 0 is red if
+\\ isRGB() is true).
+//
+\\ @param dst: Destination plane. (Re)allocated as a
+// height x width CV_8UC1 Mat if needed.
+\\
+// @return: True if the plane was written. False if the
+\\ Image isn't 8-bit, or has no channel clr.
+//
+\\ ****************************************************/
+bool Image :: getChannel( uint clr,
+                          cv::Mat & dst ) const
+{
+  // If the channel doesn't exist, report failure.
+  if(!initialized() || super->depth() != CV_8U || clr >= getChannels()) return false;
+
+  const uint CHANS = super->channels();
+
+  // Allocate the destination plane (no-op if already correct).
+  dst.create(super->rows, super->cols, CV_8UC1);
+
+  // Split each row, skipping every other channel.
+  return parallelForRows([&dst, clr, CHANS](uint r, ImageRow<const uchar> pixels)
+  {
+    uchar * planes[CV_CN_MAX];
+    for(uint other = 0; other < CHANS; ++other) planes[other] = nullptr;
+    planes[clr] = dst.ptr<uchar>(r);
+
+    splitRow(pixels.data, planes, pixels.width, CHANS);
+  });
+}
+
+
+/* ****************************************************
+\\ Sets the color values for a pixel, using an unsigned
+// character array.
+\\
+// @param row: The row of the pixel to be modified.
+\\
+// @param col: The column of the pixel to be modified.
+\\
+// @param c_arr: The array of new channel values for
+\\ the specified pixel.
+//
+\\ @return: True if pixel was modified successfully.
+// False if the Image isn't 8-bit.
+\\
+// ****************************************************/
+bool Image :: setPixel( uint row,
+                        uint col,
+                        const uchar c_arr[] )
+{
+  return depthIs<uchar>() && setPixelBytes(row, col, c_arr);
+}
+
+
+/* ****************************************************
+\\ (Private) - Sets a pixel from getPixelBytes() raw
+// bytes, in the Image's channel type.
+\\
+// @return: True if pixel was modified successfully.
+\\
+// ****************************************************/
+bool Image :: setPixelBytes( uint row,
+                             uint col,
+                             const uchar c_arr[] )
+{
+  // If the image is uninitialized, or the specified
+  // row and column are out of range, report failure.
+  if(!c_arr || !dimInRange(row, col)) return false;
+
+  IMAGE_STAT_ADD(STAT_PIXEL_WRITES, 1);
+
+  // Take a private copy of the pixels if they are shared.
+  detach();
+
+  // The number of bytes in one pixel.
+  const size_t PX_BYTES = super->elemSize();
+
+  // Every bit pattern of the channel type is a valid
+  // value, so copy the pixel without a per-channel switch.
+  std::memcpy(super->ptr<uchar>(row) + col * PX_BYTES, c_arr, PX_BYTES);
+
+  // Report success.
+  return true;
+}
+
+
+/* ****************************************************
+\\ Sets the color values for a pixel, using an unsigned
+// integer array.
+\\
+// @param row: The row of the pixel to be modified.
+\\
+// @param col: The column of the pixel to be modified.
+\\
+// @param c_arr: The array of new channel values for
+\\ the specified pixel. Each must be less than 256
+// (8-bit Images) or 65536 (16-bit Images).
+\\
+// @return: True if pixel was modified successfully.
+\\ False for other channel types.
+//
+\\ ****************************************************/
+bool Image :: setPixel( uint row,
+                        uint col,
+                        const uint c_arr[] )
+{
+  // If the image is uninitialized, or the specified
+  // row and column are out of range, report failure.
+  if(!c_arr || !dimInRange(row, col)) return false;
+
+  // The largest value a channel can hold.
+  uint max_value;
+
+  switch(super->depth())
+  {
+    case CV_8U:  max_value = 255;   break;
+    case CV_16U: max_value = 65535; break;
+    default:     return false;
+  }
+
+  IMAGE_STAT_ADD(STAT_PIXEL_WRITES, 1);
+
+      // Index counter for traversing c_arr.
+  int clr = 0,
+      // The number of channels used by
+      // the image. For loop control.
+      chans = super->channels();
+
+  // Verify that the colors specified by
+  // c_arr are within the valid range.
+  while(clr < chans && c_arr[clr] <= max_value) ++clr;
+
+  // If a value out of range was
+  // detected, report failure.
+  if(clr != chans) return false;
+
+  // Take a private copy of the pixels if they are shared.
+  detach();
+
+  // Narrow each value into the pixel.
+  if(max_value == 255)
+  {
+    uchar * px = super->ptr<uchar>(row) + col * chans;
+    for(clr = 0; clr < chans; ++clr) px[clr] = static_cast<uchar>(c_arr[clr]);
+  }
+  else
+  {
+    ushort * px = super->ptr<ushort>(row) + col * chans;
+    for(clr = 0; clr < chans; ++clr) px[clr] = static_cast<ushort>(c_arr[clr]);
+  }
+
+  // Report success.
+  return true;
+}
+
+
+/* ****************************************************
+\\ Overwrites every pixel in a row.
+//
+\\ @param row: The row to be overwritten.
+//
+\\ @param src: getWidth() * getChannels() new channel
+// values, in the Image's interleaved channel order.
+\\
+// @return: True if the row was overwritten.
+\\
+// ****************************************************/
+bool Image :: setRow( uint row,
+                      const uchar src[] )
+{
+  // Overwrite a full-width, single row region.
+  return setRegion(row, 0, 1, getWidth(), src);
+}
+
+
+/* ****************************************************
+\\ Overwrites a rectangle of pixels from a buffer. The
+// bounds are checked once, then each row is a memcpy.
+\\
+// @param row, col: The top-left pixel of the region.
+\\
+// @param height, width: The size of the region.
+\\
+// @param src: The new channel values, row by row.
+\\
+// @param src_step: Bytes between the starts of rows
+\\ in src. 0 means width * getPixelBytes().
+//
+\\ @return: True if the region was overwritten.
+//
+\\ ****************************************************/
+bool Image :: setRegion( uint row,
+                         uint col,
+                         uint height,
+                         uint width,
+                         const uchar src[],
+                         uint src_step )
+{
+  // If there is no source, or the region does
+  // not fit within the Image, report failure.
+  if(!src || !regionInRange(row, col, height, width)) return false;
+
+  IMAGE_STAT_TIMER(STAT_BULK);
+
+  // Take a private copy of the pixels if they are shared.
+  detach();
+
+  // The number of bytes in one row of the region.
+  const size_t ROW_BYTES = width * super->elemSize();
+
+  // Default to a tightly packed source.
+  if(src_step == 0) src_step = ROW_BYTES;
+
+  // If the source rows overlap, report failure.
+  if(src_step < ROW_BYTES) return false;
+
+  // If the region and the Image are both one
+  // contiguous block, copy it all at once.
+  if(col == 0 && width == getWidth() && src_step == ROW_BYTES && super->isContinuous())
+  {
+    std::memcpy(super->ptr<uchar>(row), src, ROW_BYTES * height);
+    return true;
+  }
+
+  // Copy each row of the region.
+  for(uint r = 0; r < height; ++r)
+    std::memcpy( super->ptr<uchar>(row + r) + col * super->elemSize(),
+                 src + r * src_step,
+                 ROW_BYTES );
+
+  // Report success.
+  return true;
+}
+
+
+/* ****************************************************
+\\ Overwrites the entire Image.
+//
+\\ @param src: getHeight() * getWidth() * getChannels()
+// tightly packed, interleaved channel values.
+\\
+// @return: True if the Image was overwritten.
+\\
+// ****************************************************/
+bool Image :: setPixels(const uchar src[])
+{
+  // Overwrite a region covering the whole Image.
+  return setRegion(0, 0, getHeight(), getWidth(), src);
+}
+
+
+/* ****************************************************
+\\ Sets every pixel in a rectangle to the same color.
+//
+\\ @param row, col: The top-left pixel of the region.
+//
+\\ @param height, width: The size of the region.
+//
+\\ @param c_arr: The getChannels() channel values of
+// the fill color.
+\\
+// @return: True if the region was filled.
+\\
+// ****************************************************/
+bool Image :: fillRegion( uint row,
+                          uint col,
+                          uint height,
+                          uint width,
+                          const uchar c_arr[] )
+{
+  // If there is no color, or the region does
+  // not fit within the Image, report failure.
+  if(!c_arr || !regionInRange(row, col, height, width)) return false;
+
+  IMAGE_STAT_TIMER(STAT_BULK);
+
+  // Take a private copy of the pixels if they are shared.
+  detach();
+
+  // The number of bytes in one pixel.
+  const size_t PX_BYTES = super->elemSize();
+
+  // Fill the region's first row one pixel at a time.
+  uchar * first = super->ptr<uchar>(row) + col * PX_BYTES;
+  for(uint c = 0; c < width; ++c)
+    std::memcpy(first + c * PX_BYTES, c_arr, PX_BYTES);
+
+  // Copy the first row into every other row of the region.
+  for(uint r = 1; r < height; ++r)
+    std::memcpy(super->ptr<uchar>(row + r) + col * PX_BYTES, first, width * PX_BYTES);
+
+  // Report success.
+  return true;
+}
+
+
+/* ****************************************************
+\\ Overwrites every channel of the Image from a set of
+// planes. The inverse of splitChannels.
+\\
+// @param planes: getChannels() CV_8UC1 planes, each the
+\\ size of the Image.
+//
+\\ @return: True if the Image was overwritten. False if
+// it isn't 8-bit, or the planes don't match it.
+\\
+// ****************************************************/
+bool Image :: mergeChannels(const std::vector<cv::Mat> & planes)
+{
+  // If the Image isn't 8-bit, or the planes don't match, report failure.
+  if(!initialized() || super->depth() != CV_8U || planes.size() != getChannels()) return false;
+
+  for(size_t clr = 0; clr < planes.size(); ++clr)
+    if(!isPlaneOf(planes[clr], *super)) return false;
+
+  const uint CHANS = super->channels();
+
+  return parallelForRows([&planes, CHANS](uint r, ImageRow<uchar> pixels)
+  {
+    const uchar * src[CV_CN_MAX];
+    for(uint clr = 0; clr < CHANS; ++clr) src[clr] = planes[clr].ptr<uchar>(r);
+
+    mergeRow(src, pixels.data, pixels.width, CHANS);
+  });
+}
+
+
+/* ****************************************************
+\\ Overwrites one channel of the Image from a plane.
+//
+\\ @param clr: The channel index, in the order the
+// pixels are stored (so channel 0 is red if
+\\ isRGB() is true).
+//
+\\ @param src: A CV_8UC1 plane the size of the Image.
+//
+\\ @return: True if the channel was overwritten. False
+// if the Image isn't 8-bit, has no channel clr, or src
+\\ doesn't match it.
+//
+\\ ****************************************************/
+bool Image :: setChannel( uint clr,
+                          const cv::Mat & src )
+{
+  // If the channel doesn't exist, or src doesn't match, report failure.
+  if( !initialized() || super->depth() != CV_8U || clr >= getChannels() ||
+      !isPlaneOf(src, *super) ) return false;
+
+  const uint CHANS = super->channels();
+
+  // Merge each row, leaving every other channel alone.
+  return parallelForRows([&src, clr, CHANS](uint r, ImageRow<uchar> pixels)
+  {
+    const uchar * planes[CV_CN_MAX];
+    for(uint other = 0; other < CHANS; ++other) planes[other] = nullptr;
+    planes[clr] = src.ptr<uchar>(r);
+
+    mergeRow(planes, pixels.data, pixels.width, CHANS);
+  });
+}
+
+
+/* ****************************************************
+\\ Calls a kernel on every row, in parallel. The rows
+// are split into bands of grain rows, which the shared
+\\ WorkPool's threads claim (and steal) until all are
+// done. Each row is passed to exactly one call.
+\\
+// @param kernel: Called as kernel(row, pixels) for each
+\\ row, on any thread. Must only modify its own row.
+//
+\\ @param grain: Rows per band. 0 picks one (rowGrain).
+//
+\\ @return: False if the Image is uninitialized.
+//
+\\ ****************************************************/
+bool Image :: parallelForRows( const RowKernel & kernel,
+                               uint grain )
+{
+  // If there are no rows, report failure.
+  if(!initialized() || !kernel) return false;
+
+  IMAGE_STAT_TIMER(STAT_BULK);
+
+  // Take a private copy of the pixels if they are shared,
+  // once, before the rows are handed out.
+  detach();
+
+  const uint WIDTH = super->cols,
+             CHANS = super->channels();
+  cv::Mat & pixels = *super;
+
+  WorkPool::shared().parallelFor( super->rows, grain ? grain : rowGrain(),
+                                  [&](size_t begin, size_t end)
+  {
+    for(size_t r = begin; r < end; ++r)
+      kernel(static_cast<uint>(r), ImageRow<uchar>(pixels.ptr<uchar>(static_cast<int>(r)), WIDTH, CHANS));
+  });
+
+  // Report success.
+  return true;
+}
+
+
+/* ****************************************************
+\\ Calls a read-only kernel on every row, in parallel.
+// See the writable overload.
+\\
+// ****************************************************/
+bool Image :: parallelForRows( const ConstRowKernel & kernel,
+                               uint grain ) const
+{
+  // If there are no rows, report failure.
+  if(!initialized() || !kernel) return false;
+
+  IMAGE_STAT_TIMER(STAT_BULK);
+
+  const uint WIDTH = super->cols,
+             CHANS = super->channels();
+  const cv::Mat & pixels = *super;
+
+  WorkPool::shared().parallelFor( super->rows, grain ? grain : rowGrain(),
+                                  [&](size_t begin, size_t end)
+  {
+    for(size_t r = begin; r < end; ++r)
+      kernel(static_cast<uint>(r), ImageRow<const uchar>(pixels.ptr<uchar>(static_cast<int>(r)), WIDTH, CHANS));
+  });
+
+  // Report success.
+  return true;
+}
+
+
+/* ****************************************************
+\\ Returns the headless mode flag. It starts on for
+// IMAGE_HEADLESS builds, if CLIMAGE_HEADLESS is set, or
+\\ (on X11/Wayland systems) if there is no display, so
+// HighGUI is never touched there.
+\\
+// ****************************************************/
+static std::atomic<bool> & headlessFlag(void)
+{
+#if defined(IMAGE_HEADLESS)
+  static std::atomic<bool> headless(true);
+#elif defined(__unix__) && !defined(__APPLE__)
+  static std::atomic<bool> headless( std::getenv("CLIMAGE_HEADLESS") ||
+                                     (!std::getenv("DISPLAY") && !std::getenv("WAYLAND_DISPLAY")) );
+#else
+  static std::atomic<bool> headless(std::getenv("CLIMAGE_HEADLESS") != nullptr);
+#endif
+
+  return headless;
+}
+
+
+/* ****************************************************
+\\ Turns headless mode on or off. Has no effect in an
+// IMAGE_HEADLESS build, which has no GUI to turn on.
+\\
+// ****************************************************/
+void Image :: setHeadless(bool headless)
+{
+#if !defined(IMAGE_HEADLESS)
+  headlessFlag() = headless;
+#else
+  (void)headless;
+#endif
+}
+
+
+/* ****************************************************
+\\ True if windows are never opened.
+//
+\\ ****************************************************/
+bool Image :: isHeadless(void)
+{
+  return headlessFlag();
+}
+
+
+/* ****************************************************
+\\ Display the image in a new window, and wait for a
+// key press.
+\\
+// @return: False if headless, or the image is
+\\ uninitialized.
+//
+\\ ****************************************************/
+bool Image :: displayImage(void) const
 {
-  // Try to get the channel values as an array of characters.
-  std::unique_ptr<uchar[]> arr_clrs = getArrColors(row, col);
+  // Show the image, then pause until a key is pressed.
+#if !defined(IMAGE_HEADLESS)
+  if(!previewImage()) return false;
 
-  // If getArrColors failed (image is
-  // uninitialized), return nullptr.
-  if(!arr_clrs) return std::unique_ptr<uint[]>();
+  cv::waitKey();
+  return true;
+#else
+  return false;
+#endif
+}
 
-      // Number of channels for loop control
-  int channels = super->channels(),
-      // Index counter for moving channel
-      // values from char array to int array.
-      clr = 0;
 
-  // Create an int array for storing the colors.
-  std::unique_ptr<uint[]> arr_clrs_int(new uint[channels]);
+/* ****************************************************
+\\ Display the image without waiting for a key. Pending
+// window events (e.g. repaints) are handled for 1 ms,
+\\ so calling this once per processed image keeps the
+// window live without stalling the caller. Like all of
+\\ HighGUI, call it from one thread only.
+//
+\\ @param title: The window's title. Images previewed
+// with the same title replace each other. If empty,
+\\ the filename is used.
+//
+\\ @return: False if headless, or the image is
+// uninitialized.
+\\
+// ****************************************************/
+bool Image :: previewImage(const std::string & title) const
+{
+  // If the image is uninitialized, or headless, report failure.
+  if(!initialized() || isHeadless()) return false;
 
-  // Fill the chnnel int array with the
-  // contents of the channels char array.
-  for(; clr < channels; ++clr)
-    arr_clrs_int[clr] = static_cast<uint>(arr_clrs[clr]);
+#if !defined(IMAGE_HEADLESS)
+  // Open the image in a window. OpenCV
+  // expects BGR, so convert RGB pixels.
+  cv::Mat scratch;
+  cv::imshow(title.empty() ? filename : title, bgrPixels(scratch));
 
-  // Return the integer array of channel values.
-  return std::move(arr_clrs_int);
+  // Handle pending window events.
+  cv::waitKey(1);
+  return true;
+#else
+  (void)title;
+  return false;
+#endif
 }
 
 
 /* ****************************************************
-\\ Returns a unique pointer to an array of unsigned
-// integers, containing the channel values for the
-\\ pixel at the specified row and column. 
-//
-\\ @param row: The row number for the pixel to be
-// retrieved.
+\\ Closes every window opened by displayImage or
+// previewImage.
 \\
-// @param col: The column number for the pixel to be
-\\ retrieved.
-//
-\\ ****************************************************/
-std::unique_ptr<uchar[]> Image :: getArrColors( uint row,
-                                                uint col ) const
+// ****************************************************/
+void Image :: closeWindows(void)
 {
-  // If no image is loaded, return an empty unique pointer.
-  if(!initialized()) return std::unique_ptr<uchar[]>();
-
-  // Depending on the number of channels used by the image,
-  // return one of the getArrColors delegate functions.
-  switch(super->channels())
-  {
-    // Return the 1-channel getArrColors function.
-    case 1: return getArrColors_one(row, col, std::unique_ptr<uchar[]>(new uchar[1]));
-    // Return the 2-channel getArrColors function.
-    case 2: return getArrColors_two(row, col, std::unique_ptr<uchar[]>(new uchar[2]));
-    // Return the 3-channel getArrColors function.
-    case 3: return getArrColors_three(row, col, std::unique_ptr<uchar[]>(new uchar[3]));
-    // Return the 4-channel getArrColors function.
-    case 4: return getArrColors_four(row, col, std::unique_ptr<uchar[]>(new uchar[4]));
-    // Return the 5-channel getArrColors function.
-    case 5: return getArrColors_five(row, col, std::unique_ptr<uchar[]>(new uchar[5]));
-    // Return an empty unique pointer.
-    default: return std::unique_ptr<uchar[]>();
-  }
+#if !defined(IMAGE_HEADLESS)
+  if(!isHeadless()) cv::destroyAllWindows();
+#endif
 }
 
 
-
 /* ****************************************************
-\\ Returns the sum of the rgb integer values for a
-// pixel, divided by 3.
+\\ Open the image with the name specified by filename.
+// The file is not checked up front; imread opens it
+\\ exactly once, and only if that fails is the file
+// stat'ed, to tell a missing file from a bad one.
 \\
-// @param row: The row number for the pixel to be
-\\ retrieved.
+// @param filename_param: The name of the image file to
+\\ be opened. If empty, the filename member is used.
 //
-\\ @param col: The column number for the pixel to be
-// retrieved.
-\\
-// @return: If the specified pixel exists, returns the
-\\ sum of the three (red, blue, green) pixel values,
-// divided by 3. Otherwise, return -1.
+\\ @param lazy: If true, and the file's header can be
+// read (see readImageHeader), only the header is read,
+\\ and decoding is left to the first pixel access (see
+// decodePending). A file that turns out not to decode
+\\ is then reported by that access.
+//
+\\ @return: True unless open failed. On failure,
+// getStatus() reports the reason.
 \\
 // ****************************************************/
-template <uint C>
-double Image :: getPixelIntensity( uint row,
-                                   uint col ) const
+bool Image :: openImage( std::string filename_param,
+                         bool lazy )
 {
-  // If the specified row and column
-  // are out of range, report error code -2.
-  if(!dimInRange(row, col)) return -2.0;
+  // If the image is already defined (or pending), report failure.
+  if(isPending() || initialized()) { status = IMG_ALREADY_OPEN; return false; }
+
+  // Open the filename param if given, or the filename member.
+  if(filename_param.empty()) filename_param = this->filename;
+
+  // If both filenames are empty, report failure.
+  if(filename_param.empty()) { status = IMG_NO_FILENAME; return false; }
 
-  // If the specified number of C
-  // is incorrect, return error code -1.
-  if(C != super->channels()) return -1.0;
+  IMAGE_STAT_TIMER(STAT_OPEN);
 
-       // Sum of the pixel's channel values
-       // at the specified row & column.
-  uint px_sum = 0,
-       // Index counter for traversing
-       // the pixel channel values.
-       px_clr = 0;
+  // If lazy, read just the header, and decode later.
+  if(lazy && readImageHeader(filename_param, header))
+  {
+    super.reset();
+    pending_file = filename_param;
+    rgb_order = false;
+    view = false;
+    setFilename(filename_param);
+
+    status = IMG_OK;
+    return true;
+  }
 
-  // Get the pixel at the specified row & column.
-  cv::Vec<uchar, C> pixel = super->at< cv::Vec<uchar, C> >(row, col);
+  // Try to decode the image (or find it in the decode cache).
+  // imread's failure is the existence check.
+  const std::shared_ptr<cv::Mat> PIXELS = loadPixels(filename_param);
 
-  // For each channel..
-  for(; px_clr < C; ++px_clr)
-    // Get the current pixel color, convert to int and add to sum.
-    px_sum += static_cast<uint>(pixel[px_clr]);
+  // If nothing was decoded, find out why, and report failure.
+  if(!PIXELS)
+  { status = failureStatus(filename_param); return false; }
 
-  // Return the average value.
-  return px_sum / C;
+  // Initialize super with the decoded image, and
+  // remember the name of the file it came from.
+  super = PIXELS;
+  rgb_order = false;
+  view = false;
+  setFilename(filename_param);
+
+  // Report success.
+  status = IMG_OK;
+  return true;
 }
 
 
 /* ****************************************************
-\\ Sets the red value for a pixel.
-//
-\\ @param col: The column of the pixel to be modified.
-//
-\\ @param col: The row of the pixel to be modified.
+\\ Replaces the Image's pixels with those of a file. Made
+// for loading many same-sized images in turn (e.g. one
+\\ Image per batch worker): if nothing else refers to the
+// current buffer, and it is the size and type of the new
+\\ pixels, they are decoded straight into it, with no
+// allocation. Otherwise the file is opened as usual.
+\\
+// @param filename_param: The name of the image file to
+\\ be opened. If empty, the filename member is used.
 //
-\\ @param c_arr: The array of new channel values for
-// the specified pixel.
+\\ @return: True unless open failed. On failure, the
+// Image is uninitialized, and getStatus() reports why.
 \\
-// @return: True if pixel was modified successfully.
+// ****************************************************/
+bool Image :: reopenImage(std::string filename_param)
+{
+  // Open the filename param if given, or the filename member.
+  if(filename_param.empty()) filename_param = this->filename;
+
+  // If both filenames are empty, report failure.
+  if(filename_param.empty()) { status = IMG_NO_FILENAME; return false; }
+
+  // If the buffer is this Image's alone, decode into it.
+  // Mapped pixels are the file itself, and a view's are its
+  // parent's, so neither is reused. (A pending Image has no
+  // buffer, and isn't decoded just to reuse one.)
+  if( !isPending() && reusesBuffers() && initialized() && super.use_count() == 1 &&
+      !isMapped() && !view && !hasViews() )
+    return redecodeImage(filename_param);
+
+  // Otherwise, drop the old pixels and open the file afresh.
+  super.reset();
+  view = false;
+  pending_file.clear();
+  return openImage(filename_param);
+}
+
+
+/* ****************************************************
+\\ Confirms whether reopenImage can decode into the
+// buffer of the Image being reopened. While the decode
+\\ cache is on, a lookup beats any decode, and the
+// pixels it returns are shared, so never.
 \\
 // ****************************************************/
-template<int C>
-bool Image :: setPixel( uint row,
-                        uint col,
-                        const cv::Vec<uchar, C> & c_vec )
+bool Image :: reusesBuffers(void)
 {
-  // If the image is uninitialized, or the specified
-  // row and column are out of range, report failure.
-  if(!initialized() || !dimInRange(row, col)) return false;
+  return !DecodeCache::shared().enabled();
+}
 
-  // Index counter for traversing c_vec.
-  int clr = 0;
 
-  // Verify that the colors specified by
-  // c_vec are within the valid range.
-  while(clr < C && c_vec[clr] < 256) ++clr;
+/* ****************************************************
+\\ (Private) - Decodes a file into super, offering the
+// current buffer to the decode. OpenCV leaves a passed
+\\ in destination untouched when a file isn't decodable
+// at all, so the decode starts from an empty Mat, whose
+\\ allocator hands it the old buffer if it fits (see
+// RecycleAllocator). Failures are still detected.
+\\
+// @param FILENAME: The name of the image file.
+\\
+// @return: True if the file was decoded.
+\\
+// ****************************************************/
+bool Image :: redecodeImage(const std::string & FILENAME)
+{
+  IMAGE_STAT_TIMER(STAT_OPEN);
+
+  // As in detach: another thread (e.g. a SaveQueue encoder or
+  // a prefetcher) may just have dropped its reference; its
+  // reads of the pixels must complete before the decode writes.
+  std::atomic_thread_fence(std::memory_order_acquire);
 
-  // If a value greater than 255
-  // was detected, report failure.
-  if(clr != C) return false;
+  // Offer the old pixels, and let go of them.
+  spareBuffer() = *super;
+  super.reset();
+  view = false;
 
-  // Reset c_vec index counter.
-  clr = 0;
+  // The encoded file, reused between loads on this thread.
+  static thread_local std::vector<uchar> encoded;
 
-  // Add all of the values in c_vec to the
-  // corresponding channel of the specified pixel.
-  while(clr < C)
+  // If the file can't be read, find out why, and report failure.
+  if(!readFile(FILENAME, encoded))
   {
-    // Set the current value at the
-    // specified pixel to the new color.
-    super->at< cv::Vec<uchar, C> >(row, col)[clr] = c_vec[clr];
+    spareBuffer().release();
+    status = failureStatus(FILENAME);
+    return false;
+  }
 
-    // Increment the color index counter.
-    ++clr;
+  // Decode, allocating through the recycling allocator.
+  cv::Mat decoded;
+  decoded.allocator = recycleAllocator();
+
+  if(!encoded.empty())
+  {
+    IMAGE_STAT_TIMER(STAT_DECODE);
+    cv::imdecode( cv::Mat(1, static_cast<int>(encoded.size()), CV_8UC1, encoded.data()),
+                  cv::IMREAD_UNCHANGED, &decoded );
   }
 
+  // If the spare wasn't taken, free it now.
+  spareBuffer().release();
+
+  // If nothing was decoded, report failure.
+  if(decoded.empty()) { status = IMG_UNDECODABLE; return false; }
+
+  IMAGE_STAT_ADD(STAT_BYTES_DECODED, decoded.total() * decoded.elemSize());
+
+  // Initialize super with the decoded image, and
+  // remember the name of the file it came from.
+  super = std::make_shared<cv::Mat>(decoded);
+  rgb_order = false;
+  view = false;
+  setFilename(FILENAME);
+
   // Report success.
+  status = IMG_OK;
   return true;
 }
 
 
 /* ****************************************************
-\\ Sets the color values for a pixel, using an unsigned
-// character array.
-\\
-// @param col: The column of the pixel to be modified.
+\\ Memory-maps a binary 8-bit PGM (P5) or PPM (P6) file.
+// The Image's pixels are the file's payload, so
+\\ nothing is decoded or copied, and only the pages that
+// are touched are read. See MappedPxm.cpp.
 \\
-// @param col: The row of the pixel to be modified.
-\\
-// @param c_arr: The array of new channel values for
-\\ the specified pixel.
+// @param filename_param: The name of the file to be
+\\ mapped. If empty, the filename member is used.
 //
-\\ @return: True if pixel was modified successfully.
+\\ @param writable: If true, pixel modifications are
+// written to the file, and saveImage flushes them.
+\\ Otherwise, modifications stay in memory.
+//
+\\ @return: True if the file was mapped. False if the
+// Image is already initialized, or the file is not a
+\\ binary 8-bit PGM/PPM (use openImage instead).
 //
 \\ ****************************************************/
-bool Image :: setPixel( uint row,
-                        uint col,
-                        const uchar c_arr[] )
+bool Image :: mapImage( std::string filename_param,
+                        bool writable )
 {
-  // If the image is uninitialized, or the specified
-  // row and column are out of range, report failure.
-  if(!initialized() || !dimInRange(row, col)) return false;
+  // If the image is already defined (or pending), report failure.
+  if(isPending() || initialized()) { status = IMG_ALREADY_OPEN; return false; }
 
-      // Index counter for traversing c_vec.
-  int clr = 0,
-      // The number of channels used by
-      // the image. For loop control.
-      chans = super->channels();
+  // Map the filename param if given, or the filename member.
+  if(filename_param.empty()) filename_param = this->filename;
 
-  // Verify that the colors specified by
-  // c_vec are within the valid range.
-  while(clr < chans && static_cast<uint>(c_arr[clr]) < 256) ++clr;
+  // If both filenames are empty, report failure.
+  if(filename_param.empty()) { status = IMG_NO_FILENAME; return false; }
 
-  // If a value greater than 255
-  // was detected, report failure.
-  if(clr != chans) return false;
+  IMAGE_STAT_TIMER(STAT_OPEN);
 
-  // Reset c_vec index counter.
-  clr = 0;
+  // Try to map the file.
+  std::shared_ptr<cv::Mat> mapped = mapPxm(filename_param, writable);
 
-  // Depending on the number of channels used by the
-  // image, add all of the values in c_vec to the
-  // corresponding channel of the specified pixel.
-  switch(super->channels())
-  {
-    case 1: while(clr < chans) { super->at< cv::Vec<uchar, 1> >(row, col)[clr] = c_arr[clr]; ++clr; } break;
-    case 2: while(clr < chans) { super->at< cv::Vec<uchar, 2> >(row, col)[clr] = c_arr[clr]; ++clr; } break;
-    case 3: while(clr < chans) { super->at< cv::Vec<uchar, 3> >(row, col)[clr] = c_arr[clr]; ++clr; } break;
-    case 4: while(clr < chans) { super->at< cv::Vec<uchar, 4> >(row, col)[clr] = c_arr[clr]; ++clr; } break;
-    case 5: while(clr < chans) { super->at< cv::Vec<uchar, 5> >(row, col)[clr] = c_arr[clr]; ++clr; } break;
-    default: return false;
-  }
+  // If the file could not be mapped, find out why, and report failure.
+  if(!mapped)
+  { status = failureStatus(filename_param); return false; }
+
+  // Use the mapping as the Image's pixels. PPM
+  // payloads are RGB, as opposed to OpenCV's BGR.
+  setFilename(filename_param);
+  super = mapped;
+  rgb_order = (super->channels() == 3);
+  view = false;
 
   // Report success.
+  status = IMG_OK;
   return true;
 }
 
 
 /* ****************************************************
-\\ Display the image in a new window.
+\\ (Private) - Decodes the file of a lazily opened Image
+// (see openImage), on the first access to its pixels.
+\\ The Image is no longer pending afterwards, whether or
+// not the decode succeeded; on failure it is left
+\\ uninitialized, and getStatus() reports why.
+//
+\\ Called from initialized(), so const accessors decode
+// too. Like any modification, it must not race with
+\\ other uses of the same Image.
 //
-\\ @return: True unless display failed.
+\\ @return: True if the pixels were decoded.
 //
 \\ ****************************************************/
-bool Image :: displayImage(void) const
+bool Image :: decodePending(void) const
 {
+  IMAGE_STAT_TIMER(STAT_OPEN);
 
-  // If the image is uninitialized, report failure.
-  if(!initialized()) return false;
+  // Take the file, so the Image is no longer pending.
+  std::string source;
+  source.swap(pending_file);
 
-  // Open the image in a new window,
-  // using the filename as a title.
-  cv::imshow(filename, *super);
+  const std::shared_ptr<cv::Mat> PIXELS = loadPixels(source);
 
-  // Pause until the window is closed.
-  cv::waitKey();
+  // If nothing was decoded, find out why, and report failure.
+  if(!PIXELS)
+  { status = failureStatus(source); return false; }
 
-  // Report success.
+  // The decoded pixels are what the getters report from
+  // now on, should they differ from the header.
+  super = PIXELS;
+  status = IMG_OK;
   return true;
 }
 
 
 /* ****************************************************
-\\ Open the image with the name specified by filename.
-// 
-\\ @param filename: The name of the image file to be
-// opened.
+\\ (Private) - Implements copy-on-write. If the pixel
+// buffer is shared with another Image (e.g. after a
+\\ copy), replaces it with a private deep copy, so the
+// modification that follows is not seen by the other.
+\\ Like cv::Mat, sharing an Image between threads that
+// modify it requires external synchronization.
 \\
-// @return: True unless open failed.
+// ****************************************************/
+void Image :: detach(void)
+{
+  // If the buffer is shared, take a private copy. Views
+  // are the exception: their writes go to their parent.
+  // So is an Image with views, whose buffer they share
+  // (its copies are deep, so only views can share it), and
+  // a writable mapping, whose writes must reach its file.
+  const PxmMapping * MAPPING = std::get_deleter<PxmMapping>(super);
+  const bool WRITE_THROUGH = view || hasViews() || (MAPPING && MAPPING->writable);
+
+  if(super && !WRITE_THROUGH && super.use_count() > 1)
+    super = std::make_shared<cv::Mat>(super->clone());
+
+  // Otherwise, another thread (e.g. a SaveQueue encoder) may
+  // just have dropped its reference; its reads of the pixels
+  // must complete before ours writes begin.
+  else std::atomic_thread_fence(std::memory_order_acquire);
+}
+
+
+/* ****************************************************
+\\ (Private) - Confirms whether views made by subImage
+// refer to the pixels. Each view holds a reference to
+\\ views, beyond this Image's own; views of pixels
+// since replaced don't count.
 \\
 // ****************************************************/
-bool Image :: openImage(std::string filename_param)
+bool Image :: hasViews(void) const
 {
-  // If the image is already defined, or both filenames are empty
-  if(initialized() || (filename_param.empty() && this->filename.empty()))
-    // Report failure.
-    return false;
+  return super && views && views.use_count() > 1 &&
+         !views->owner_before(super) && !super.owner_before(*views);
+}
 
-  // If the filename param is not empty, and
-  // the current filename member is empty..
-  if(!filename_param.empty() && this->filename.empty())
-  {
-    // If a file with the name specified by filename param exists,
-    // set the filename member to the value of the filename param.
-    if(std::ifstream(filename_param))
-      this->filename = filename_param;
-    else return false;
-  }
-  // If the filename param is not empty, and
-  // the current filename member is not empty..
-  else if(!filename_param.empty() && !this->filename.empty())
-  {
-    // If the current filename member does not contain the
-    // name of an existing file, and the filename param does,
-    // set the filename member to the value of the filename param.
-    if(!std::ifstream(this->filename) && std::ifstream(filename_param))
-      this->filename = filename_param;
-    else return false;
-  }
-  // If the filename param is empty, and the current
-  // filename member is not empty, and no file with the
-  // name in current filename member exists, report failure.
-  else if(filename_param.empty() && !this->filename.empty() && !std::ifstream(this->filename))
-    return false;
 
-  // Initialize super by opening the image specified by the class filename.
-  super = std::unique_ptr<cv::Mat>(new cv::Mat(imread(this->filename, cv::IMREAD_UNCHANGED)));
+/* ****************************************************
+\\ (Private) - Returns the rows per band for a parallel
+// pass over the Image. A band should hold enough
+\\ channel values (BAND_VALUES) that handing it out is
+// cheap next to processing it, but there should also
+\\ be a few bands per thread (BANDS_PER_THREAD), so
+// threads that finish early have some to steal.
+\\
+// ****************************************************/
+uint Image :: rowGrain(void) const
+{
+  const size_t ROW_VALUES = size_t(getWidth()) * getChannels(),
+               THREADS = WorkPool::shared().size();
+
+  // The rows needed to fill a band, and the rows that
+  // give each thread BANDS_PER_THREAD of them.
+  const size_t BY_SIZE = ROW_VALUES ? (BAND_VALUES + ROW_VALUES - 1) / ROW_VALUES : 1,
+               BY_COUNT = (getHeight() + THREADS * BANDS_PER_THREAD - 1) / (THREADS * BANDS_PER_THREAD);
 
-  // Report success.
-  return true;
+  // Prefer the larger bands: small images stay on one thread.
+  const size_t ROWS = (BY_SIZE > BY_COUNT) ? BY_SIZE : BY_COUNT;
+  return ROWS ? static_cast<uint>(ROWS) : 1;
 }
 
 
 /* ****************************************************
-\\ (Private) - Confirms whether or not row and col are
-// in range of the Image's height and width. This
-\\ function is called by all functions that take row
-// and column parameters.
-\\
-// @param row: A specific row in the Image. Must be
-\\ less than the height in pixels of the image.
+\\ (Private) - Confirms whether or not a rectangle lies
+// entirely within the Image. Used by the bulk writes,
+\\ so that a region is validated once, not per pixel.
 //
-\\ @param col: A specific column in the Image. Must be
-// less than the width in pixels of the image.
-\\
-// @return: True if the specified row and column are
-\\ within range of the Image's dimensions.
+\\ @param row, col: The top-left pixel of the region.
 //
-\\ ****************************************************/
-inline bool Image :: dimInRange( int row,
-                                 int col) const
+\\ @param height, width: The size of the region.
+//
+\\ @return: True if the Image is initialized and the
+// (non-empty) region fits within it.
+\\
+// ****************************************************/
+bool Image :: regionInRange( uint row,
+                             uint col,
+                             uint height,
+                             uint width ) const
 {
   // If super contains no image, report failure.
   if(!initialized()) return false;
 
-  // If the specified row is out of the Image's height range
-  // or the specified column is out of the Image's width range..
-  if( row < 0 || row >= super->rows ||
-      col < 0 || col >= super->cols )
-        // Report dims out of bounds.
-        return false;
-
-  // Report dims within bounds.
-  return true;
+  // Check each dimension without overflowing row + height.
+  return height > 0 && width > 0 &&
+         row < static_cast<uint>(super->rows) &&
+         col < static_cast<uint>(super->cols) &&
+         height <= static_cast<uint>(super->rows) - row &&
+         width  <= static_cast<uint>(super->cols) - col;
 }
 
 
@@ -488,37 +1946,81 @@ inline bool Image :: dimInRange( int row,
 \\ *************************************************/
 int Image :: hasValidExtension(const std::string & FILENAME) const
 {
-    // If the filename is empty, report error code -3.
-    if(FILENAME.empty()) return -3;
+  // If the filename is empty, report error code -3.
+  if(FILENAME.empty()) return -3;
 
-        // Index counter for traversing the FILENAME.
-    int ch = FILENAME.length() - 1,
-        // Index counter for traversing the VALID_EXTENSIONS array.
-        idx = 0;
+  // Locate the dot that begins the extension.
+  const size_t DOT = extensionDot(FILENAME);
 
-    // Locate the dot in FILENAME.
-    while( FILENAME.at(ch) != '.') --ch;
+  // If FILENAME did not contain an
+  // extension, report error code -2.
+  if(DOT == std::string::npos) return -2;
 
-    // If FILENAME did not contain
-    // a dot, report error code -2.
-    if(ch == 0) return -2;
+  // Look up the extension (after the dot).
+  return findExtension(FILENAME.c_str() + DOT + 1, FILENAME.length() - DOT - 1);
+}
 
-    // Get the extension from FILENAME.
-    std::string ext = FILENAME.substr(ch, FILENAME.length() - 1);
 
-    // Check for ext in VALID_EXTENSIONS.
-    while(idx < EXTENSION_COUNT)
-    {
-        // If a match is found, return the index
-        // of the matching file extension.
-        if(!ext.compare(VALID_EXTENSIONS[idx].ext)) return idx;
+/* *************************************************
+\\ Identifies encoded image bytes by their magic
+// number, rather than by a (possibly wrong) name.
+\\
+// @param buf, len: The start of the encoded image.
+\\ Eight bytes are enough for every format.
+//
+\\ @return: The ImageFormat of the bytes (FORMAT_JPG for
+// any JPEG), or -1 if they aren't a PNG, JPEG or Netpbm
+\\ image. OpenCV may still decode other formats.
+//
+\\ *************************************************/
+int Image :: sniffFormat( const uchar * buf,
+                          size_t len )
+{
+  // The PNG signature.
+  const static uchar PNG_MAGIC[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
 
-        // Increment the extension index counter.
-        ++idx;
-    }
+  // If there is nothing to identify, report failure.
+  if(!buf) return -1;
+
+  if(len >= sizeof(PNG_MAGIC) && !std::memcmp(buf, PNG_MAGIC, sizeof(PNG_MAGIC)))
+    return FORMAT_PNG;
+
+  // A JPEG starts with a start-of-image marker, then another marker.
+  if(len >= 3 && buf[0] == 0xFF && buf[1] == 0xD8 && buf[2] == 0xFF)
+    return FORMAT_JPG;
 
-    // Report error code -1.
-    return -1;
+  // Netpbm: "P1".."P6" (ASCII / binary PBM, PGM, PPM), then whitespace.
+  if(len >= 3 && buf[0] == 'P' && buf[1] >= '1' && buf[1] <= '6' && std::isspace(buf[2]))
+  {
+    const static int PNM_FORMATS[3] = { FORMAT_PBM, FORMAT_PGM, FORMAT_PPM };
+    return PNM_FORMATS[(buf[1] - '1') % 3];
+  }
+
+  // Unknown.
+  return -1;
+}
+
+
+/* *************************************************
+\\ Identifies an image file by its magic number. Only
+// the first bytes are read.
+\\
+// @param FILENAME: The name of the image file.
+\\
+// @return: As for sniffFormat. -1 if the file can't
+\\ be read.
+//
+\\ *************************************************/
+int Image :: sniffFile(const std::string & FILENAME)
+{
+  std::FILE * in = std::fopen(FILENAME.c_str(), "rb");
+  if(!in) return -1;
+
+  uchar magic[8];
+  const size_t LEN = std::fread(magic, 1, sizeof(magic), in);
+  std::fclose(in);
+
+  return sniffFormat(magic, LEN);
 }
 
 
@@ -526,47 +2028,75 @@ int Image :: hasValidExtension(const std::string & FILENAME) const
 // Saves the image in a new file, with the name
 \\ specified by this->filename.
 //
-\\ @param filename: The name of the file being saved.
+\\ @param options: Encoder settings. See EncodeOptions.
 //
 \\ @return: True if save is successful.
 //
 \\ *************************************************/
-bool Image :: saveImage(void)
+bool Image :: saveImage(const EncodeOptions & options)
 {
   // If super does not contain a complete image,
   // or the filename is empty, report failure.
   if(!initialized() || this->filename.empty()) return false;
 
-  // Check whether or not filename has a valid extension.
-  int ext_idx = hasValidExtension(filename);
+  IMAGE_STAT_TIMER(STAT_SAVE);
 
-  // If filename does not have a
-  // valid extension, report failure.
-  if(ext_idx < 0 || ext_idx >= EXTENSION_COUNT)
+  // If filename does not have a valid extension..
+  if(format < 0)
   {
-    // Remove the erroneous extension.
-    removeExtension(filename);
-
-    // Try to add a valid extension.
+    // Try to replace it with a valid extension.
     // If that fails, report failure.
-    if(!addExtension(filename)) return false;
+    std::string fixed_name = filename;
+    if(!addExtension(fixed_name)) return false;
+
+    // Use (and look up) the fixed name.
+    setFilename(fixed_name);
   }
 
-              // Get the compression format from
-              // the matching file FormatTrip.
-  const int COMPRESSION_FORMAT = VALID_EXTENSIONS[ext_idx].format,
-              // Get the maximum quality from
-              // the matching FormatTrip
-              QUALITY = VALID_EXTENSIONS[ext_idx].quality;
+  // The file is about to change; drop any cached pixels of it.
+  DecodeCache::shared().forget(filename);
 
-  // Vector of params for image to be saved.
-  std::vector<int> params;
+  // The format the filename names.
+  const int ext_idx = format;
+
+  // Get the compression format and maximum
+  // quality from the matching FormatTrip.
+  const std::vector<int> params = encodeParams(ext_idx, options);
+
+  // If the pixels are a mapping of the file being saved..
+  const PxmMapping * mapping = std::get_deleter<PxmMapping>(super);
+  const bool SAVING_MAPPED_FILE = mapping && mapping->path == filename;
 
-  // Initialize params with the compression format and quality.
-  params.push_back(COMPRESSION_FORMAT); params.push_back(QUALITY);
+  // ..and the mapping is writable, the file already
+  // holds the pixels, so just flush them.
+  if(SAVING_MAPPED_FILE && mapping->writable) return mapping->sync();
+
+  // The file to be written. A privately mapped file must not be
+  // truncated while mapped, so a temporary file replaces it instead.
+  std::string out_name = filename;
+  if(SAVING_MAPPED_FILE) out_name.insert(out_name.rfind('.'), ".tmp");
 
   // Try to save the image.
-  try { cv::imwrite(filename, *super, params); }
+  try
+  {
+    // OpenCV writes BGR, so convert RGB pixels first.
+    cv::Mat scratch;
+
+    const cv::Mat & PIXELS = bgrPixels(scratch);
+
+    // If the image could not be written, report failure.
+    {
+      IMAGE_STAT_TIMER(STAT_ENCODE);
+      if(!cv::imwrite(out_name, PIXELS, params)) return false;
+    }
+
+    IMAGE_STAT_ADD(STAT_BYTES_ENCODED, PIXELS.total() * PIXELS.elemSize());
+
+    // Replace the mapped file. The mapping keeps the old
+    // file's contents alive until it is unmapped.
+    if(SAVING_MAPPED_FILE && std::rename(out_name.c_str(), filename.c_str()) != 0)
+      return false;
+  }
   // If writing failed, catch the error.
   catch (std::runtime_error & ex)
   {
@@ -581,6 +2111,127 @@ bool Image :: saveImage(void)
 }
 
 
+/* ****************************************************
+\\ Decodes an image held in memory. The buffer is read
+// in place; nothing is written to disk.
+\\
+// @param buf: The encoded image (e.g. PNG file bytes).
+\\
+// @param len: The length of buf in bytes.
+\\
+// @return: The decoded Image, with no filename. If the
+\\ buffer could not be decoded, the Image is
+// uninitialized and its status is IMG_UNDECODABLE.
+\\
+// ****************************************************/
+Image Image :: fromBuffer( const uchar * buf,
+                           size_t len )
+{
+  IMAGE_STAT_TIMER(STAT_OPEN);
+
+  // The Image to be returned.
+  Image img;
+
+  // Decode straight from buf, through a non-owning header.
+  if(buf && len > 0)
+  {
+    const cv::Mat ENCODED(1, static_cast<int>(len), CV_8UC1, const_cast<uchar *>(buf));
+    cv::Mat decoded;
+    {
+      IMAGE_STAT_TIMER(STAT_DECODE);
+      decoded = cv::imdecode(ENCODED, cv::IMREAD_UNCHANGED);
+    }
+
+    if(!decoded.empty())
+    {
+      IMAGE_STAT_ADD(STAT_BYTES_DECODED, decoded.total() * decoded.elemSize());
+      img.super = std::make_shared<cv::Mat>(decoded);
+      img.view = false;
+    }
+  }
+
+  // Record whether decoding succeeded.
+  img.status = img.initialized() ? IMG_OK : IMG_UNDECODABLE;
+
+  return img;
+}
+
+
+/* ****************************************************
+\\ Encodes the image in memory, using the same format
+// settings as saveImage.
+\\
+// @param ext: The format's extension, with or without
+\\ the dot. Must be listed in VALID_EXTENSIONS.
+//
+\\ @param options: Encoder settings. See EncodeOptions.
+//
+\\ @return: The encoded bytes. Empty if the Image is
+// uninitialized, ext is invalid, or encoding failed.
+\\
+// ****************************************************/
+std::vector<uchar> Image :: encode( const std::string & ext,
+                                    const EncodeOptions & options ) const
+{
+  // The encoded image.
+  std::vector<uchar> encoded;
+
+  // If there is nothing to encode, report failure.
+  if(!initialized() || ext.empty()) return encoded;
+
+  // Look up the format, adding the dot if needed.
+  const std::string DOT_EXT = (ext[0] == '.') ? ext : "." + ext;
+  const int EXT_IDX = findExtension(DOT_EXT.c_str() + 1, DOT_EXT.length() - 1);
+
+  // If the format is invalid, report failure.
+  if(EXT_IDX < 0) return encoded;
+
+  IMAGE_STAT_TIMER(STAT_SAVE);
+
+  // Try to encode the image.
+  try
+  {
+    // OpenCV encodes BGR, so convert RGB pixels first.
+    cv::Mat scratch;
+    const cv::Mat & PIXELS = bgrPixels(scratch);
+
+    IMAGE_STAT_TIMER(STAT_ENCODE);
+
+    if(cv::imencode(DOT_EXT, PIXELS, encoded, encodeParams(EXT_IDX, options)))
+      IMAGE_STAT_ADD(STAT_BYTES_ENCODED, PIXELS.total() * PIXELS.elemSize());
+    else encoded.clear();
+  }
+  // If encoding failed, catch the error.
+  catch (std::runtime_error & ex)
+  {
+    // Display error message.
+    fprintf(stderr, "Exception encoding image: %s\n", ex.what());
+    encoded.clear();
+  }
+
+  return encoded;
+}
+
+
+/* ****************************************************
+\\ (Private) - Returns the pixels in OpenCV's channel
+// order. Images mapped from PPM files are RGB, so they
+\\ are converted into scratch; others are returned as-is.
+//
+\\ @param scratch: Storage for converted pixels.
+//
+\\ ****************************************************/
+const cv::Mat & Image :: bgrPixels(cv::Mat & scratch) const
+{
+  // BGR pixels need no conversion.
+  if(!rgb_order) return *super;
+
+  // Swap the red and blue channels.
+  cv::cvtColor(*super, scratch, cv::COLOR_RGB2BGR);
+  return scratch;
+}
+
+
 /* ****************************************************
 \\ (Private) - Removes the extension from a filename.
 //
@@ -596,19 +2247,14 @@ bool Image :: removeExtension(std::string & bad_filename) const
   // If the filename is empty, report failure.
   if(bad_filename.empty()) return false;
 
-      // Get the length of the filename for loop control.
-  int s_len = bad_filename.length(),
-      // Index counter for traversing the filename.
-      ch = s_len - 1;
-
   // Locate the file type extension (if there is one).
-  while(ch > 0 && bad_filename.at(ch) != '.') --ch;
+  const size_t DOT = extensionDot(bad_filename);
 
   // If no extension was detected, report failure.
-  if(ch == 0) return false;
+  if(DOT == std::string::npos) return false;
 
   // Remove the extension.
-  bad_filename.erase(ch, (s_len - ch));
+  bad_filename.erase(DOT);
 
   // Report successful removal.
   return true;
@@ -664,10 +2310,9 @@ std::string Image :: generateFilename(std::string seed)
   // is invalid, return an empty string.
   if(seed.empty() || !(hasValidExtension(seed) >= 0) ) return "";
 
-      // Get the length of the filename for loop control.
-  int s_len = seed.length(),
-      // Index counter for locating the filename extension.
-      ext_ch = s_len - 1,
+      // The index of the filename extension's dot. It isn't
+      // the first character, as the extension is valid.
+  int ext_ch = static_cast<int>(extensionDot(seed)),
       // Index counter for locating any preexisting
       // filename modification. e.g. If seed is a filename
       // that was previously generated by this function.
@@ -677,9 +2322,6 @@ std::string Image :: generateFilename(std::string seed)
   // has been previously modified.
   bool first_mod = true;
 
-  // Locate the file type extension (if there is one).
-  while(ext_ch > 0 && seed.at(ext_ch) != '.') --ext_ch;
-
   // Get the index where seed's preexisting
   // modification (if it exists) ends.
   mod_ch = ext_ch - 1;
@@ -730,87 +2372,3 @@ std::string Image :: generateFilename(std::string seed)
   return seed;
 }
 
-
-// PRIVATE getArrColors DELEGATE FUNCTIONS!
-// |                  |                   |
-// V                  V                   V
-
-// (Private) - Delegate of getArrColors. (1 Channel).
-std::unique_ptr<uchar[]> Image :: getArrColors_one( uint row,
-                                                    uint col,
-                                                    std::unique_ptr<uchar[]> channel_arr ) const
-{
-  // Get the pixel at the specified row & column.
-  cv::Vec<uchar, 1> pixel = super->at< cv::Vec<uchar, 1> >(row, col);
-
-  // Add the only channel value
-  // to the channel value array.
-  channel_arr[0] = pixel[0];
-
-  // Return the channel value.
-  return std::move(channel_arr);
-}
-// (Private) - Delegate of getArrColors. (2 Channels).
-std::unique_ptr<uchar[]> Image :: getArrColors_two( uint row,
-                                                    uint col,
-                                                    std::unique_ptr<uchar[]> channel_arr ) const
-{
-  // Get the pixel at the specified row & column.
-  cv::Vec<uchar, 2> pixel = super->at< cv::Vec<uchar, 2> >(row, col);
-
-  // Fill the chnnel array with the channel
-  // values at the specified pixel.
-  for(uint clr_idx = 0; clr_idx < 2; ++clr_idx)
-    channel_arr[clr_idx] = pixel[clr_idx];
-
-  // Return the character array of channel values.
-  return std::move(channel_arr);
-}
-// (Private) - Delegate of getArrColors (3 Channels).
-std::unique_ptr<uchar[]> Image :: getArrColors_three( uint row,
-                                                      uint col,
-                                                      std::unique_ptr<uchar[]> channel_arr ) const
-{
-  // Get the pixel at the specified row & column.
-  cv::Vec<uchar, 3> pixel = super->at< cv::Vec<uchar, 3> >(row, col);
-
-  // Fill the chnnel array with the channel
-  // values at the specified pixel.
-  for(uint clr_idx = 0; clr_idx < 3; ++clr_idx)
-    channel_arr[clr_idx] = pixel[clr_idx];
-
-  // Return the character array of channel values.
-  return std::move(channel_arr);
-}
-// (Private) - Delegate of getArrColors (4 Channels).
-std::unique_ptr<uchar[]> Image :: getArrColors_four( uint row,
-                                                     uint col,
-                                                     std::unique_ptr<uchar[]> channel_arr ) const
-{
-  // Get the pixel at the specified row & column.
-  cv::Vec<uchar, 4> pixel = super->at< cv::Vec<uchar, 4> >(row, col);
-
-  // Fill the chnnel array with the channel
-  // values at the specified pixel.
-  for(uint clr_idx = 0; clr_idx < 4; ++clr_idx)
-    channel_arr[clr_idx] = pixel[clr_idx];
-
-  // Return the character array of channel values.
-  return std::move(channel_arr);
-}
-// (Private) - Delegate of getArrColors (5 Channels).
-std::unique_ptr<uchar[]> Image :: getArrColors_five( uint row,
-                                                     uint col,
-                                                     std::unique_ptr<uchar[]> channel_arr ) const
-{
-  // Get the pixel at the specified row & column.
-  cv::Vec<uchar, 5> pixel = super->at< cv::Vec<uchar, 5> >(row, col);
-
-  // Fill the chnnel array with the channel
-  // values at the specified pixel.
-  for(uint clr_idx = 0; clr_idx < 5; ++clr_idx)
-    channel_arr[clr_idx] = pixel[clr_idx];
-
-  // Return the character array of channel values.
-  return std::move(channel_arr);
-}
@@ -15,16 +15,293 @@
 
 // For cv::Mat params.
 #include <vector>
-// For verifying the existence of files.
-#include <fstream>
 #include <memory>
 #include <cstring>
 #include <string>
 #include <cmath>
+#include <cstdio>
+#include <type_traits>
+#include <limits>
+#include <functional>
 
-// Import the OpenCV library.
+// Import the OpenCV library. Building with -DIMAGE_HEADLESS leaves
+// out the GUI (displayImage shows nothing). OpenCV 3+ has its codecs
+// outside HighGUI, so a headless build doesn't load it at all.
+#include "opencv2/core/version.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
-#include "opencv2/highgui/highgui.hpp"
+#if defined(IMAGE_HEADLESS) && CV_MAJOR_VERSION >= 3
+  #include "opencv2/imgcodecs/imgcodecs.hpp"
+#else
+  #include "opencv2/highgui/highgui.hpp"
+#endif
+
+// Row kernels for whole-image operations.
+#include "PixelKernels.h"
+// Zero-copy loading of PGM/PPM files.
+#include "MappedPxm.h"
+// Header-only reads, for lazy opens.
+#include "ImageHeader.h"
+// Optional timers and counters (-DIMAGE_STATS).
+#include "ImageStats.h"
+
+
+/* *************************************************
+\\ A bounds-checked-once view of a single scanline
+// in an Image. The pixels in a row are contiguous,
+\\ so the view is just a pointer, a width, and the
+// number of interleaved channels per pixel. T is
+\\ uchar for a writable row, const uchar otherwise.
+// For 16-bit and float Images, data points at the
+\\ row's raw bytes; use Image::typed<C, T> instead.
+//
+\\ An empty view (data == nullptr) is returned for
+// rows that don't exist.
+\\
+// *************************************************/
+template <typename T>
+struct ImageRow
+{
+  // Constructs an empty row view.
+  ImageRow(void) : data(nullptr), width(0), channels(0) { return; }
+
+  // Constructs a view over width pixels of chans channels.
+  ImageRow(T * row_data, uint row_width, uint chans) :
+  data(row_data), width(row_width), channels(chans) { return; }
+
+  // True if the view does not refer to any pixels.
+  bool empty(void) const { return !data || !width; }
+
+  // The number of channel values in the row.
+  uint size(void) const { return width * channels; }
+
+  // The channel value at idx; e.g. row[col * channels + clr].
+  T & operator[](uint idx) const { return data[idx]; }
+
+  // Pointer to the first channel value of the pixel at col.
+  T * pixel(uint col) const { return data + col * channels; }
+
+  // Iterators over every channel value in the row.
+  T * begin(void) const { return data; }
+  T * end(void) const { return data + size(); }
+
+  // First channel value of the row.
+  T * data;
+
+       // Number of pixels in the row.
+  uint width,
+       // Number of channel values per pixel.
+       channels;
+};
+
+
+/* *************************************************
+\\ The OpenCV depth (CV_8U, ..) of each supported
+// channel value type.
+\\
+// *************************************************/
+template <typename T> struct DepthOf;
+template <> struct DepthOf<uchar>  { static const int value = CV_8U;  };
+template <> struct DepthOf<ushort> { static const int value = CV_16U; };
+template <> struct DepthOf<float>  { static const int value = CV_32F; };
+
+
+/* *************************************************
+\\ True if every value of channel type S can be
+// stored in a T without loss (e.g. uchar in uint,
+\\ ushort in float, but not float in uint).
+//
+\\ *************************************************/
+template <typename S, typename T>
+struct ChannelFits
+{
+  static const bool value = std::numeric_limits<T>::digits >= std::numeric_limits<S>::digits &&
+                            (std::numeric_limits<S>::is_integer || !std::numeric_limits<T>::is_integer);
+};
+
+
+// Returns the mean of a pixel's channel values.
+template <typename T, int C>
+inline double pixelMean(const cv::Vec<T, C> & px)
+{
+  double sum = 0;
+  for(int clr = 0; clr < C; ++clr) sum += px[clr];
+  return sum / C;
+}
+
+
+/* *************************************************
+\\ A view of a whole Image with C channels, fixed at
+// compile time. The channel count is checked once,
+\\ when the view is made (Image::typed<C, T>), so every
+// accessor here is branch-free and inlinable; use it
+\\ in hot loops. T is the channel type (uchar, ushort
+// or float), const for a read-only view.
+\\
+// at() and rowPtr() are unchecked; the rest check
+\\ bounds like the matching Image methods. Like
+// ImageRow, a view is valid until its Image is
+\\ modified through another path, copied, or destroyed.
+//
+\\ An invalid view (data == nullptr) is returned when
+// the Image doesn't have C channels of type T.
+\\
+// *************************************************/
+template <int C, typename T = uchar>
+class TypedImage
+{
+  public:
+
+    // The type of one pixel, and of a (const) pixel in the view.
+    typedef cv::Vec<typename std::remove_const<T>::type, C> Pixel;
+    typedef typename std::conditional<std::is_const<T>::value, const Pixel, Pixel>::type ViewPixel;
+
+    // Constructs an invalid view.
+    TypedImage(void) : data(nullptr), step(0), width(0), height(0) { return; }
+
+    // Constructs a view of height rows of width pixels,
+    // with rows step bytes apart.
+    TypedImage(T * img_data, size_t row_step, uint img_width, uint img_height) :
+    data(img_data), step(row_step), width(img_width), height(img_height) { return; }
+
+    // True if the view refers to an Image.
+    bool valid(void) const { return data != nullptr; }
+
+    // The number of channels per pixel.
+    static constexpr int channels(void) { return C; }
+
+    // The size of the viewed Image.
+    uint getWidth(void) const { return width; }
+    uint getHeight(void) const { return height; }
+
+    // True if row, col is a pixel in the view.
+    bool inRange(uint row, uint col) const { return row < height && col < width; }
+
+    // Returns the first pixel of a row. Unchecked.
+    ViewPixel * rowPtr(uint row) const
+    { return reinterpret_cast<ViewPixel *>(reinterpret_cast<Byte *>(data) + row * step); }
+
+    // Returns the pixel at row, col. Unchecked.
+    ViewPixel & at(uint row, uint col) const { return rowPtr(row)[col]; }
+
+    // Copies the pixel at row, col into c_vec.
+    // False if the pixel is out of range.
+    bool getArrColors(uint row, uint col, Pixel & c_vec) const
+    { if(!inRange(row, col)) return false; c_vec = at(row, col); return true; }
+
+    // Returns the mean of the pixel's channel values,
+    // or -2 if the pixel is out of range.
+    double getPixelIntensity(uint row, uint col) const
+    { return inRange(row, col) ? pixelMean(at(row, col)) : -2.0; }
+
+    // Sets the pixel at row, col. False if it is out of
+    // range. Only compiles for writable views.
+    bool setPixel(uint row, uint col, const Pixel & c_vec) const
+    { if(!inRange(row, col)) return false; at(row, col) = c_vec; return true; }
+
+  private:
+
+    // A (const) byte, for stepping between rows.
+    typedef typename std::conditional<std::is_const<T>::value, const uchar, uchar>::type Byte;
+
+    // The first channel value of the first row.
+    T * data;
+
+    // The number of bytes between the starts of rows.
+    size_t step;
+
+         // The size of the viewed Image, in pixels.
+    uint width,
+         height;
+};
+
+
+// A kernel applied to one row of an Image by parallelForRows:
+// the row's index, and a view of its pixels.
+typedef std::function<void(uint row, ImageRow<uchar> pixels)> RowKernel;
+typedef std::function<void(uint row, ImageRow<const uchar> pixels)> ConstRowKernel;
+
+
+/* *************************************************
+\\ The result of the last open operation on an
+// Image. Lets callers tell a missing file apart
+\\ from one that exists but could not be decoded.
+//
+\\ *************************************************/
+enum ImageStatus
+{
+  // The last operation succeeded.
+  IMG_OK,
+  // The Image was already initialized.
+  IMG_ALREADY_OPEN,
+  // No filename was given or stored.
+  IMG_NO_FILENAME,
+  // The file does not exist or is not accessible.
+  IMG_FILE_MISSING,
+  // The file exists, but could not be decoded
+  // (or, for mapImage, is not a mappable PGM/PPM).
+  IMG_UNDECODABLE
+};
+
+
+/* *************************************************
+\\ The file formats an Image can be saved as. These
+// are the values hasValidExtension, getFormat and
+\\ sniffFormat return for each.
+//
+\\ *************************************************/
+enum ImageFormat
+{
+  FORMAT_PNG,
+  FORMAT_JPG,
+  FORMAT_JPEG,
+  FORMAT_PBM,
+  FORMAT_PGM,
+  FORMAT_PPM
+};
+
+
+/* *************************************************
+\\ Encoder speed/size trade-offs. The presets only
+// change lossless settings (compression effort),
+\\ so the decoded pixels are the same for each.
+//
+\\ *************************************************/
+enum EncodePreset
+{
+  // PNG level 1, no JPEG Huffman optimization.
+  ENCODE_FAST,
+  // PNG level 3, optimized JPEG Huffman tables.
+  ENCODE_BALANCED,
+  // PNG level 9, optimized progressive JPEG.
+  ENCODE_SMALLEST
+};
+
+
+/* *************************************************
+\\ Per-call encoder settings for saveImage and
+// encode. Initialized from a preset; any field can
+\\ then be overridden. A negative value leaves the
+// setting to the FormatTrip (or OpenCV) default.
+\\
+// *************************************************/
+struct EncodeOptions
+{
+  // Initialize all fields from the specified preset.
+  EncodeOptions(EncodePreset preset = ENCODE_SMALLEST);
+
+      // PNG zlib level, 0 (fastest) to 9 (smallest).
+  int png_compression,
+      // PNG zlib strategy (CV_IMWRITE_PNG_STRATEGY_*).
+      png_strategy,
+      // JPEG quality, 0 to 100.
+      jpeg_quality,
+      // 1 to write progressive JPEG, 0 for baseline.
+      // OpenCV 3+ only; ignored by 2.4.
+      jpeg_progressive,
+      // 1 to compute optimal JPEG Huffman tables.
+      // OpenCV 3+ only; ignored by 2.4.
+      jpeg_optimize;
+};
 
 
 /* *************************************************
@@ -38,8 +315,17 @@ typedef class Image
 
     // Initializes the Image.
     Image(const std::string & filename = "");
-    // Copies the contents of another Image.
+    // Copies the contents of another Image. The pixel buffer
+    // is shared until either Image is modified (copy-on-write),
+    // unless views are involved (see subImage). Copies of a
+    // writable mapping share it for good (see mapImage).
     Image(const Image & img_src);
+    // Takes the contents of another Image, leaving it empty.
+    Image(Image && img_src) noexcept;
+    // Replaces this Image with a copy-on-write copy of img_src.
+    Image & operator=(const Image & img_src);
+    // Replaces this Image with the contents of img_src.
+    Image & operator=(Image && img_src) noexcept;
     // Deallocates all dynamic Image memory.
     ~Image(void);
 
@@ -55,22 +341,109 @@ typedef class Image
     // Returns a unique pointer to an array of unsigned
     // characters, containing the channel values for
     // the pixel at the specified row and column.
+    // 8- and 16-bit Images only.
     std::unique_ptr<uint[]> getArrColors_int( uint row,
                                               uint col ) const;
+    // Copies the channel values for the pixel at the specified
+    // row and column into a caller-supplied array of at least
+    // getChannels() unsigned integers. Does not allocate.
+    // 8- and 16-bit Images only.
+    bool getArrColors_int( uint row,
+                           uint col,
+                           uint c_arr[] ) const;
 
-    // Returns one of the getArrColors_X functions, depending
-    // on the number of channels used in the image. The delegate
-    // function returns a unique pointer to an array of unsigned
-    // integers, which contain the channel values.
+    // Returns a unique pointer to an array of unsigned
+    // characters, which contain the channel values.
+    // 8-bit Images only.
     std::unique_ptr<uchar[]> getArrColors( uint row,
                                            uint col ) const;
+    // Copies the channel values for the pixel at the specified
+    // row and column into a caller-supplied array of at least
+    // getChannels() unsigned characters. Does not allocate.
+    // 8-bit Images only.
+    bool getArrColors( uint row,
+                       uint col,
+                       uchar c_arr[] ) const;
+    // Copies the channel values for the pixel at the specified
+    // row and column into getChannels() values of type T
+    // (ushort or float). False if the Image's values don't
+    // all fit in a T (see ChannelFits).
+    template <typename T>
+    bool getArrColors( uint row,
+                       uint col,
+                       T c_arr[] ) const;
+    // Copies the channel values for the pixel at the specified
+    // row and column into a cv::Vec. T and C must match the
+    // Image's channel type and count.
+    template <typename T, int C>
+    bool getArrColors( uint row,
+                       uint col,
+                       cv::Vec<T, C> & c_vec ) const;
 
-    // Returns the sum of the channel values for
-    // a pixel, divided by the number of channels.
+    // Returns a read-only view of every pixel in the
+    // specified row. Empty if the row doesn't exist.
+    ImageRow<const uchar> row(uint row_idx) const;
+    // Returns a writable view of every pixel in the
+    // specified row. Empty if the row doesn't exist.
+    ImageRow<uchar> row(uint row_idx);
+
+    // Returns a read-only view of the whole Image, with C
+    // channels of type T fixed at compile time, for branch-free
+    // pixel loops. Invalid if the Image doesn't match.
+    template <int C, typename T = uchar>
+    TypedImage<C, const T> typed(void) const;
+    // Returns a writable view of the whole Image, with C
+    // channels of type T fixed at compile time.
+    template <int C, typename T = uchar>
+    TypedImage<C, T> typed(void);
+
+    // Returns a view of the width x height region whose top-left
+    // pixel is at column x, row y. The view shares this Image's
+    // pixels (like a cv::Mat ROI): writes through either are seen
+    // by both, and every accessor and bulk operation works on it.
+    // Copies of a view, or of an Image with views, are deep. The
+    // view is uninitialized if the region doesn't fit.
+    Image subImage( uint x,
+                    uint y,
+                    uint width,
+                    uint height );
+
+    // True if the Image is a view made by subImage.
+    bool isView(void) const { return view; }
+
+    // Returns the sum of the channel values for a pixel,
+    // divided by the number of channels. Any channel type.
     template <uint C>
     double getPixelIntensity( uint row,
                               uint col ) const;
 
+    // Writes the intensity of every pixel into dst, a single
+    // channel (CV_8UC1) plane the size of the Image. 8-bit
+    // Images only. LUMA_INTENSITY weighs each channel by its
+    // color, whether the Image is stored BGR or RGB (isRGB).
+    bool getIntensityMap( cv::Mat & dst,
+                          IntensityMode mode = MEAN_INTENSITY ) const;
+    // Writes the intensity of every pixel in the height x width
+    // region at row, col into dst, a CV_8UC1 plane of that size.
+    bool getIntensityMap( cv::Mat & dst,
+                          uint row,
+                          uint col,
+                          uint height,
+                          uint width,
+                          IntensityMode mode = MEAN_INTENSITY ) const;
+
+    // Copies each channel into its own contiguous plane:
+    // planes[clr] becomes a CV_8UC1 Mat the size of the Image.
+    // Single-channel passes over the planes are then sequential.
+    // 8-bit Images only. Like every channel index, clr is in
+    // the order the pixels are stored (see isRGB).
+    bool splitChannels(std::vector<cv::Mat> & planes) const;
+    // Copies one channel (e.g. 0 for blue, or red if isRGB(),
+    // 3 for alpha) into dst, a CV_8UC1 plane the size of the
+    // Image. 8-bit only.
+    bool getChannel( uint clr,
+                     cv::Mat & dst ) const;
+
     // If the Image was loaded from an external image file, or
     // created and saved during the life of the program in which
     // this function is called, that file's name (with extension) is
@@ -78,55 +451,247 @@ typedef class Image
     // with an asterisk and no extension. e.g. *new_img_file.
     std::string getFilename(void) const { return std::string(filename); }
 
+    // Sets the name of the file that saveImage writes to.
+    void setFilename(const std::string & new_filename)
+    { filename = new_filename; format = hasValidExtension(filename); }
+
+    // Returns the format named by the filename's extension
+    // (an ImageFormat), or hasValidExtension's error code.
+    // Looked up once per filename, not per call.
+    int getFormat(void) const { return format; }
+
     // ***************************************** |
     // Initialization / Modification Operations  |
     // ***************************************** V
 
-    // Open the image with the name specified
-    // by filename True if opened successfully..
-    bool openImage(std::string filename = "");
+    // Open the image with the name specified by filename.
+    // True if opened successfully. On failure, getStatus()
+    // tells why. If lazy, only the header of a PNG, JPEG or
+    // Netpbm file is read: the size, channel and depth getters
+    // work at once, and the pixels are decoded on first access
+    // (see isPending). Other formats are decoded at once.
+    // While DecodeCache::shared() has a budget, reopening an
+    // unchanged file shares its cached pixels instead.
+    bool openImage( std::string filename = "",
+                    bool lazy = false );
+
+    // True if the Image was opened lazily, and its pixels
+    // haven't been decoded yet. Any pixel access (or a call
+    // to initialized()) decodes them; as that modifies the
+    // Image, it must not race with other uses of it.
+    bool isPending(void) const { return !pending_file.empty(); }
+
+    // Replaces the Image's pixels with those of filename. If
+    // the Image's buffer isn't shared or mapped, and is the
+    // size and type of the new pixels, it is decoded into
+    // rather than reallocated (see reusesBuffers). On failure,
+    // the Image is left uninitialized, and getStatus() tells why.
+    bool reopenImage(std::string filename = "");
+
+    // True if reopenImage can decode into an Image's buffer.
+    // Not while DecodeCache::shared() is enabled, as cached
+    // pixels are shared. Callers that keep Images around for
+    // their buffers (e.g. processBatch) keep none otherwise.
+    static bool reusesBuffers(void);
+
+    // Memory-map a binary 8-bit PGM/PPM file, without decoding
+    // or copying its pixels. If writable, pixel writes go to the
+    // file, and saveImage flushes them; they aren't copied on
+    // write, so copies of the Image (e.g. queued in a SaveQueue)
+    // see them too. PPM pixels stay in the file's RGB order.
+    // False if the file can't be mapped.
+    bool mapImage( std::string filename = "",
+                   bool writable = false );
+
+    // True if the Image's pixels are a mapping of its file.
+    bool isMapped(void) const
+    { return std::get_deleter<PxmMapping>(super) != nullptr; }
+
+    // Returns the result of the last openImage/mapImage.
+    ImageStatus getStatus(void) const { return status; }
+
+    // True if color pixels are stored RGB, rather than
+    // OpenCV's BGR. Only the case for mapped PPM files.
+    // Channel indices (getArrColors, setPixel, getChannel,
+    // splitChannels, ..) follow the stored order, so channel
+    // 0 of such an Image is red.
+    bool isRGB(void) const { return rgb_order; }
 
     // Save the image to a new/existing file.
-    bool saveImage(void);
+    bool saveImage(void) { return saveImage(EncodeOptions()); }
+    // Save the image to a new/existing file,
+    // with the specified encoder settings.
+    bool saveImage(const EncodeOptions & options);
+
+    // Decodes an image held in memory (e.g. the body of a
+    // network request), without touching the filesystem. On
+    // failure, the returned Image is uninitialized.
+    static Image fromBuffer( const uchar * buf,
+                             size_t len );
 
-    // Sets the color values for
-    // a pixel, using a cv::Vec.
-    template<int C>
+    // Encodes the image in memory, in the format given by ext
+    // (e.g. ".png" or "jpg"). Empty if encoding failed.
+    std::vector<uchar> encode( const std::string & ext,
+                               const EncodeOptions & options = EncodeOptions() ) const;
+
+    // Sets the color values for a pixel, using a cv::Vec.
+    // T and C must match the Image's channel type and count.
+    template <typename T, int C>
     bool setPixel( uint row,
                    uint col,
-                   const cv::Vec<uchar, C> & c_vec );
+                   const cv::Vec<T, C> & c_vec );
     // Sets the color values for a pixel,
     // using an unsigned character array.
+    // 8-bit Images only.
     bool setPixel( uint row,
                    uint col,
                    const uchar c_arr[] );
-    // Sets the color values for a pixel,
-    // using an unsigned integer array.
+    // Sets the color values for a pixel, using an unsigned
+    // integer array. 8- and 16-bit Images only.
     bool setPixel( uint row,
                    uint col,
-                   const uint c_arr[] )
-    { return setPixel(row, col, reinterpret_cast<const uchar *>(c_arr)); }
+                   const uint c_arr[] );
+    // Sets the color values for a pixel, using an array of
+    // T (ushort or float). T must match the Image's channel type.
+    template <typename T>
+    bool setPixel( uint row,
+                   uint col,
+                   const T c_arr[] );
+
+    // The bulk writes below take raw pixels: getPixelBytes()
+    // bytes per pixel, in the Image's channel type. Overloads
+    // for ushort and float sources check that type as well.
+
+    // Overwrites every pixel in a row with the
+    // getWidth() * getChannels() values in src.
+    bool setRow( uint row,
+                 const uchar src[] );
+    template <typename T>
+    bool setRow( uint row,
+                 const T src[] );
+
+    // Overwrites a height x width rectangle whose top-left
+    // pixel is at row, col. Rows of src are src_step bytes
+    // apart; 0 means tightly packed (width * getPixelBytes()).
+    bool setRegion( uint row,
+                    uint col,
+                    uint height,
+                    uint width,
+                    const uchar src[],
+                    uint src_step = 0 );
+    template <typename T>
+    bool setRegion( uint row,
+                    uint col,
+                    uint height,
+                    uint width,
+                    const T src[],
+                    uint src_step = 0 );
+
+    // Overwrites the entire image with the tightly packed
+    // getHeight() * getWidth() * getChannels() values in src.
+    bool setPixels(const uchar src[]);
+    template <typename T>
+    bool setPixels(const T src[]);
+
+    // Sets every pixel in a height x width rectangle whose
+    // top-left pixel is at row, col to the color in c_arr.
+    bool fillRegion( uint row,
+                     uint col,
+                     uint height,
+                     uint width,
+                     const uchar c_arr[] );
+    template <typename T>
+    bool fillRegion( uint row,
+                     uint col,
+                     uint height,
+                     uint width,
+                     const T c_arr[] );
+
+    // Overwrites every channel from planes, one CV_8UC1 plane
+    // the size of the Image per channel (see splitChannels).
+    bool mergeChannels(const std::vector<cv::Mat> & planes);
+    // Overwrites one channel from src, a CV_8UC1 plane the size
+    // of the Image. The other channels are unchanged.
+    bool setChannel( uint clr,
+                     const cv::Mat & src );
+
+    // Calls kernel on every row, with the rows split into bands
+    // run in parallel on the shared WorkPool. Kernels must only
+    // touch their own row. grain is rows per band; 0 picks one
+    // from the row width and channel count.
+    bool parallelForRows( const RowKernel & kernel,
+                          uint grain = 0 );
+    // Calls a read-only kernel on every row, in parallel.
+    bool parallelForRows( const ConstRowKernel & kernel,
+                          uint grain = 0 ) const;
+
+    // Replaces every pixel px with op(px), in parallel. The
+    // Image must have C channels of type T; op takes and returns
+    // a cv::Vec<T, C>.
+    template <int C, typename T = uchar, typename Op>
+    bool transform( Op op,
+                    uint grain = 0 );
 
     // ************************ |
     // Miscelaneous Operations  |
     // ************************ V
 
-    // Display the image in a new window.
+    // Display the image in a new window, and wait for a key
+    // press. False (nothing shown) when headless.
     bool displayImage(void) const;
 
-    // Verifies whether a filename contains
-    // an extension for a valid file type.
+    // Display the image without waiting: shows (or updates) the
+    // window titled title (the filename if empty), and returns
+    // after handling pending window events. False when headless.
+    bool previewImage(const std::string & title = "") const;
+
+    // Closes every window opened by displayImage/previewImage.
+    static void closeWindows(void);
+
+    // Turns headless mode on or off. The default is on for
+    // IMAGE_HEADLESS builds, when CLIMAGE_HEADLESS is set in
+    // the environment, or when there is no display to use.
+    static void setHeadless(bool headless);
+
+    // True if windows are never opened.
+    static bool isHeadless(void);
+
+    // Verifies whether a filename contains an extension for
+    // a valid file type (in any case, e.g. ".PNG").
     int hasValidExtension(const std::string & FILENAME) const;
 
-    // Confirms whether or not an
-    // Image has been initialized.
+    // Identifies encoded image bytes by their magic number.
+    // Returns an ImageFormat, or -1 if the bytes aren't PNG,
+    // JPEG or Netpbm (OpenCV may still decode them).
+    static int sniffFormat( const uchar * buf,
+                            size_t len );
+    // Identifies an image file by its first bytes, as
+    // sniffFormat does. -1 if it can't be read.
+    static int sniffFile(const std::string & filename);
+
+    // Confirms whether or not an Image has been initialized.
+    // Decodes the pixels of a pending Image (see isPending);
+    // false if that fails.
     bool initialized(void) const
-    { return (super && super->data); }
+    { return (pending_file.empty() || decodePending()) && super && super->data; }
 
     // Returns the number of
     // channels in the image.
     uint getChannels(void) const
-    { if(super) return super->channels(); return 0; }
+    { if(isPending()) return header.channels; if(super) return super->channels(); return 0; }
+
+    // Returns the OpenCV depth of each channel value
+    // (CV_8U, CV_16U, CV_32F, ..). -1 if uninitialized.
+    int getDepth(void) const
+    { if(isPending()) return header.depth; if(initialized()) return super->depth(); return -1; }
+
+    // Returns the number of bytes in one pixel.
+    size_t getPixelBytes(void) const
+    {
+      if(isPending()) return header.channels * CV_ELEM_SIZE1(header.depth);
+      if(initialized()) return super->elemSize();
+      return 0;
+    }
 
   private:
 
@@ -141,40 +706,492 @@ typedef class Image
     inline bool dimInRange( int row,
                             int col ) const;
 
+    // Returns true if the height x width rectangle at
+    // row, col lies entirely within the Image.
+    bool regionInRange( uint row,
+                        uint col,
+                        uint height,
+                        uint width ) const;
+
+    // Returns the pixels in OpenCV's BGR order, converting
+    // into scratch only if they are stored RGB.
+    const cv::Mat & bgrPixels(cv::Mat & scratch) const;
+
+    // Decodes filename into super, offering super's buffer
+    // for reuse. Used by reopenImage.
+    bool redecodeImage(const std::string & filename);
+
+    // Decodes the file of a pending Image into super. False
+    // (and the Image uninitialized) if it can't be decoded.
+    bool decodePending(void) const;
+
+    // Gives this Image its own copy of the pixel buffer
+    // if it is shared with another Image (unless writes go
+    // through to it: see subImage and mapImage). Called before
+    // every modification, to implement copy-on-write.
+    void detach(void);
+
+    // True if views made by subImage refer to the pixels.
+    bool hasViews(void) const;
+
+    // Returns the rows per band parallelForRows uses
+    // when no grain is given.
+    uint rowGrain(void) const;
+
     // Generates a modified filename,
     // for the copy constructor.
     std::string generateFilename(std::string seed);
 
-    // Delegate of getArrColors. (1 Channel).
-    std::unique_ptr<uchar[]> getArrColors_one( uint row,
-                                               uint col,
-                                               std::unique_ptr<uchar[]> channel_arr ) const;
-    // Delegate of getArrColors. (2 Channels).
-    std::unique_ptr<uchar[]> getArrColors_two( uint row,
-                                               uint col,
-                                               std::unique_ptr<uchar[]> channel_arr ) const;
-    // Delegate of getArrColors. (3 Channels).
-    std::unique_ptr<uchar[]> getArrColors_three( uint row,
-                                                 uint col,
-                                                 std::unique_ptr<uchar[]> channel_arr ) const;
-    // Delegate of getArrColors. (4 Channels).
-    std::unique_ptr<uchar[]> getArrColors_four( uint row,
-                                                uint col,
-                                                std::unique_ptr<uchar[]> channel_arr ) const;
-    // Delegate of getArrColors (5 Channels).
-    std::unique_ptr<uchar[]> getArrColors_five( uint row,
-                                                uint col,
-                                                std::unique_ptr<uchar[]> channel_arr ) const;
+    // True if the Image's channels are of type T.
+    template <typename T>
+    bool depthIs(void) const
+    { return initialized() && super->depth() == DepthOf<T>::value; }
+
+    // Sets a pixel from getPixelBytes() raw bytes. Used by
+    // setPixel once the channel type has been checked.
+    bool setPixelBytes( uint row,
+                        uint col,
+                        const uchar px[] );
+
+    // Delegate of getArrColors. Copies the C channel values
+    // (of type S) of the pixel at row, col into channel_arr.
+    // No checks.
+    template <int C, typename S, typename T>
+    void getArrColors_n( uint row,
+                         uint col,
+                         T channel_arr[] ) const;
+
+    // Dispatches to getArrColors_n based on the number of
+    // channels in the image. False if the count is unsupported.
+    template <typename S, typename T>
+    bool getArrColors_chans( uint row,
+                             uint col,
+                             T channel_arr[] ) const;
+
+    // Dispatches to getArrColors_chans based on the channel
+    // type. False if the type's values don't all fit in a T.
+    template <typename T>
+    bool getArrColors_dispatch( uint row,
+                                uint col,
+                                T channel_arr[] ) const;
 
     // The name of the image file.
     std::string filename;
 
-    // Pointer to the Image's parent class.
-    //cv::Mat * super;
-    std::unique_ptr<cv::Mat> super;
+    // hasValidExtension(filename), kept up to date
+    // whenever the filename changes.
+    int format;
+
+    // Pointer to the Image's parent class. Shared
+    // between copies of an Image until one of them
+    // is modified (see detach). Null while pending;
+    // set on first access (see decodePending).
+    mutable std::shared_ptr<cv::Mat> super;
+
+    // True if super's color pixels are in RGB order (see
+    // mapImage). Converted to BGR when saved or displayed.
+    bool rgb_order;
+
+    // The result of the last open operation (or of
+    // decoding a pending Image).
+    mutable ImageStatus status;
+
+    // True if super is a region of another Image's pixels
+    // (see subImage). Views are never detached.
+    bool view;
+
+    // Tracks the views subImage made of the pixels: each view
+    // (and the Image viewed) holds a reference to it. It refers
+    // to the buffer viewed, so it lapses once super is replaced
+    // (see hasViews). A view's refers to the outermost Image's.
+    std::shared_ptr<std::weak_ptr<cv::Mat>> views;
+
+    // The header of a lazily opened file, and the file to
+    // decode on first access. pending_file is empty once the
+    // pixels are decoded, and for Images not opened lazily.
+    ImageHeader header;
+    mutable std::string pending_file;
 
 } Img;
 
+
+// ************************************** |
+// Inline and Template Member Definitions |
+// ************************************** V
+
+/* ****************************************************
+\\ (Private) - Confirms whether or not row and col are
+// in range of the Image's height and width. This
+\\ function is called by all functions that take row
+// and column parameters.
+\\
+// @param row: A specific row in the Image. Must be
+\\ less than the height in pixels of the image.
+//
+\\ @param col: A specific column in the Image. Must be
+// less than the width in pixels of the image.
+\\
+// @return: True if the specified row and column are
+\\ within range of the Image's dimensions.
+//
+\\ ****************************************************/
+inline bool Image :: dimInRange( int row,
+                                 int col) const
+{
+  // If super contains no image, report failure.
+  if(!initialized()) return false;
+
+  // If the specified row is out of the Image's height range
+  // or the specified column is out of the Image's width range..
+  if( row < 0 || row >= super->rows ||
+      col < 0 || col >= super->cols )
+        // Report dims out of bounds.
+        return false;
+
+  // Report dims within bounds.
+  return true;
+}
+
+
+/* ****************************************************
+\\ Copies the channel values for the pixel at the
+// specified row and column into c_vec.
+\\
+// @return: True unless the Image is uninitialized, the
+\\ pixel is out of range, or T and C don't match the
+// Image's channel type and count.
+\\
+// ****************************************************/
+template <typename T, int C>
+bool Image :: getArrColors( uint row,
+                            uint col,
+                            cv::Vec<T, C> & c_vec ) const
+{
+  // If the pixel does not exist, or the channel
+  // type or count is wrong, report failure.
+  if(!dimInRange(row, col) || super->type() != CV_MAKETYPE(DepthOf<T>::value, C)) return false;
+
+  IMAGE_STAT_ADD(STAT_PIXEL_READS, 1);
+
+  // Copy the pixel in a single load.
+  c_vec = super->at< cv::Vec<T, C> >(row, col);
+
+  // Report success.
+  return true;
+}
+
+
+/* ****************************************************
+\\ Copies the channel values for the pixel at the
+// specified row and column into c_arr, which must
+\\ hold at least getChannels() values.
+//
+\\ @return: True unless the Image is uninitialized, the
+// pixel is out of range, or the Image's channel values
+\\ don't all fit in a T.
+//
+\\ ****************************************************/
+template <typename T>
+bool Image :: getArrColors( uint row,
+                            uint col,
+                            T c_arr[] ) const
+{
+  return getArrColors_dispatch(row, col, c_arr);
+}
+
+
+/* ****************************************************
+\\ Returns a read-only view of the Image, with C and T
+// fixed at compile time. The channel type and count
+\\ are checked here, once, instead of in every pixel
+// access.
+\\
+// @return: The view. Invalid if the Image is
+\\ uninitialized, or doesn't have C channels of type T.
+//
+\\ ****************************************************/
+template <int C, typename T>
+TypedImage<C, const T> Image :: typed(void) const
+{
+  // If the Image doesn't match, return an invalid view.
+  if(!initialized() || super->type() != CV_MAKETYPE(DepthOf<T>::value, C))
+    return TypedImage<C, const T>();
+
+  return TypedImage<C, const T>( super->ptr<T>(0), super->step,
+                                 super->cols, super->rows );
+}
+
+
+/* ****************************************************
+\\ Returns a writable view of the Image, with C and T
+// fixed at compile time.
+\\
+// @return: The view. Invalid if the Image is
+\\ uninitialized, or doesn't have C channels of type T.
+//
+\\ ****************************************************/
+template <int C, typename T>
+TypedImage<C, T> Image :: typed(void)
+{
+  // If the Image doesn't match, return an invalid view.
+  if(!initialized() || super->type() != CV_MAKETYPE(DepthOf<T>::value, C))
+    return TypedImage<C, T>();
+
+  // The view can modify the pixels, so take
+  // a private copy of the pixels if shared.
+  detach();
+
+  return TypedImage<C, T>( super->ptr<T>(0), super->step,
+                           super->cols, super->rows );
+}
+
+
+/* ****************************************************
+\\ Returns the sum of the channel values for a pixel,
+// divided by the number of channels.
+\\
+// @param row: The row number for the pixel to be
+\\ retrieved.
+//
+\\ @param col: The column number for the pixel to be
+// retrieved.
+\\
+// @return: If the specified pixel exists, returns the
+\\ (unrounded) average of its C channel values. If the
+// pixel is out of range, returns -2. If C is not the
+\\ number of channels in the Image, or the channel type
+// is unsupported, returns -1.
+\\
+// ****************************************************/
+template <uint C>
+double Image :: getPixelIntensity( uint row,
+                                   uint col ) const
+{
+  // If the specified row and column
+  // are out of range, report error code -2.
+  if(!dimInRange(row, col)) return -2.0;
+
+  // If the specified number of C
+  // is incorrect, return error code -1.
+  if(C != static_cast<uint>(super->channels())) return -1.0;
+
+  IMAGE_STAT_ADD(STAT_PIXEL_READS, 1);
+
+  // Average the pixel in its own channel type.
+  switch(super->depth())
+  {
+    case CV_8U:  return pixelMean(super->at< cv::Vec<uchar, C> >(row, col));
+    case CV_16U: return pixelMean(super->at< cv::Vec<ushort, C> >(row, col));
+    case CV_32F: return pixelMean(super->at< cv::Vec<float, C> >(row, col));
+    default:     return -1.0;
+  }
+}
+
+
+/* ****************************************************
+\\ Sets the color values for a pixel, using a cv::Vec.
+//
+\\ @param row: The row of the pixel to be modified.
+//
+\\ @param col: The column of the pixel to be modified.
+//
+\\ @param c_vec: The new channel values for the pixel.
+//
+\\ @return: True if pixel was modified successfully.
+//
+\\ ****************************************************/
+template <typename T, int C>
+bool Image :: setPixel( uint row,
+                        uint col,
+                        const cv::Vec<T, C> & c_vec )
+{
+  // If the image is uninitialized, the specified row and column
+  // are out of range, or T or C is wrong, report failure.
+  if(!dimInRange(row, col) || super->type() != CV_MAKETYPE(DepthOf<T>::value, C)) return false;
+
+  IMAGE_STAT_ADD(STAT_PIXEL_WRITES, 1);
+
+  // Take a private copy of the pixels if they are shared.
+  detach();
+
+  // Every T is a valid channel value,
+  // so store the whole pixel at once.
+  super->at< cv::Vec<T, C> >(row, col) = c_vec;
+
+  // Report success.
+  return true;
+}
+
+
+// Sets a pixel from getChannels() values of the Image's channel type.
+template <typename T>
+bool Image :: setPixel( uint row,
+                        uint col,
+                        const T c_arr[] )
+{
+  return depthIs<T>() && setPixelBytes(row, col, reinterpret_cast<const uchar *>(c_arr));
+}
+
+
+// Overwrites a row with pixels of the Image's channel type.
+template <typename T>
+bool Image :: setRow( uint row,
+                      const T src[] )
+{
+  return depthIs<T>() && setRow(row, reinterpret_cast<const uchar *>(src));
+}
+
+
+// Overwrites a region with pixels of the Image's channel type.
+// src_step is in bytes, as for the uchar overload.
+template <typename T>
+bool Image :: setRegion( uint row,
+                         uint col,
+                         uint height,
+                         uint width,
+                         const T src[],
+                         uint src_step )
+{
+  return depthIs<T>() &&
+         setRegion(row, col, height, width, reinterpret_cast<const uchar *>(src), src_step);
+}
+
+
+// Overwrites the Image with pixels of its channel type.
+template <typename T>
+bool Image :: setPixels(const T src[])
+{
+  return depthIs<T>() && setPixels(reinterpret_cast<const uchar *>(src));
+}
+
+
+// Fills a region with a color of the Image's channel type.
+template <typename T>
+bool Image :: fillRegion( uint row,
+                          uint col,
+                          uint height,
+                          uint width,
+                          const T c_arr[] )
+{
+  return depthIs<T>() &&
+         fillRegion(row, col, height, width, reinterpret_cast<const uchar *>(c_arr));
+}
+
+
+/* ****************************************************
+\\ Replaces every pixel with the result of an operation
+// on it, with the rows split into bands run in parallel
+\\ (see parallelForRows).
+//
+\\ @param op: Called as op(px) for each pixel, on any
+// thread. Must return the new cv::Vec<T, C>.
+\\
+// @param grain: Rows per band. 0 picks one.
+\\
+// @return: False if the Image is uninitialized, or
+\\ doesn't have C channels of type T.
+//
+\\ ****************************************************/
+template <int C, typename T, typename Op>
+bool Image :: transform( Op op,
+                         uint grain )
+{
+  typedef cv::Vec<T, C> Pixel;
+
+  // If the Image doesn't match, report failure.
+  if(!initialized() || super->type() != CV_MAKETYPE(DepthOf<T>::value, C)) return false;
+
+  // Rows are contiguous runs of Pixels.
+  return parallelForRows([&op](uint, ImageRow<uchar> pixels)
+  {
+    Pixel * px = reinterpret_cast<Pixel *>(pixels.data);
+    for(uint col = 0; col < pixels.width; ++col) px[col] = op(px[col]);
+  }, grain);
+}
+
+
+/* ****************************************************
+\\ (Private) - Copies the C channel values (of type S)
+// for the pixel at row, col into channel_arr. Callers
+\\ must have validated the Image and pixel already.
+//
+\\ ****************************************************/
+template <int C, typename S, typename T>
+void Image :: getArrColors_n( uint row,
+                              uint col,
+                              T channel_arr[] ) const
+{
+  // Get the pixel at the specified row & column.
+  const cv::Vec<S, C> & pixel = super->at< cv::Vec<S, C> >(row, col);
+
+  // Fill the channel array with the channel
+  // values at the specified pixel.
+  for(int clr_idx = 0; clr_idx < C; ++clr_idx)
+    channel_arr[clr_idx] = static_cast<T>(pixel[clr_idx]);
+}
+
+
+/* ****************************************************
+\\ (Private) - Dispatches to getArrColors_n, depending
+// on the number of channels in the image.
+\\
+// @return: False if the number of channels
+\\ is unsupported.
+//
+\\ ****************************************************/
+template <typename S, typename T>
+bool Image :: getArrColors_chans( uint row,
+                                  uint col,
+                                  T channel_arr[] ) const
+{
+  // Depending on the number of channels used by the
+  // image, call the matching getArrColors_n instance.
+  switch(super->channels())
+  {
+    case 1: getArrColors_n<1, S>(row, col, channel_arr); return true;
+    case 2: getArrColors_n<2, S>(row, col, channel_arr); return true;
+    case 3: getArrColors_n<3, S>(row, col, channel_arr); return true;
+    case 4: getArrColors_n<4, S>(row, col, channel_arr); return true;
+    case 5: getArrColors_n<5, S>(row, col, channel_arr); return true;
+    default: return false;
+  }
+}
+
+
+/* ****************************************************
+\\ (Private) - Dispatches to getArrColors_chans,
+// depending on the Image's channel type. Types whose
+\\ values don't all fit in a T are refused, rather
+// than silently truncated.
+\\
+// @return: False if the Image is uninitialized, the
+\\ pixel is out of range, or the channel type or
+// number of channels is unsupported.
+\\
+// ****************************************************/
+template <typename T>
+bool Image :: getArrColors_dispatch( uint row,
+                                     uint col,
+                                     T channel_arr[] ) const
+{
+  // If the pixel does not exist, report failure.
+  if(!dimInRange(row, col)) return false;
+
+  IMAGE_STAT_ADD(STAT_PIXEL_READS, 1);
+
+  switch(super->depth())
+  {
+    case CV_8U:
+      return ChannelFits<uchar, T>::value && getArrColors_chans<uchar>(row, col, channel_arr);
+    case CV_16U:
+      return ChannelFits<ushort, T>::value && getArrColors_chans<ushort>(row, col, channel_arr);
+    case CV_32F:
+      return ChannelFits<float, T>::value && getArrColors_chans<float>(row, col, channel_arr);
+    default:
+      return false;
+  }
+}
+
 struct FormatTrip
 {
   // Initialize all fields with the specified format into.
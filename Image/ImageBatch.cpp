@@ -0,0 +1,296 @@
+/* ***************************************************************
+\\ File Name:  ImageBatch.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation of batch processing. The batch runs as
+\\ a two stage pipeline:
+//
+\\   decode threads -> BoundedQueue -> transform + encode threads
+//
+\\ Decoding is usually I/O bound and encoding CPU bound, so the two
+// overlap. Decoders block once queue_depth Images are waiting, so
+\\ at most queue_depth + 2 * threads Images are in memory at once,
+// plus up to threads finished Images kept for their buffers:
+\\ decoders reopen those rather than allocating new ones (unless
+// Image::reusesBuffers() is false, in which case none are kept).
+//
+\\ ***************************************************************/
+
+#include "ImageBatch.h"
+#include "BoundedQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+  #define IMAGE_BATCH_GLOB 1
+  #include <glob.h>
+#endif
+
+
+// The clock used to time each file.
+typedef std::chrono::steady_clock BatchClock;
+
+
+/* *************************************************
+\\ A decoded Image waiting to be transformed.
+//
+\\ *************************************************/
+struct BatchJob
+{
+  // The index of the input in the batch.
+  size_t idx;
+
+  // The decoded Image.
+  Image img;
+
+  // When decoding of the input began.
+  BatchClock::time_point start;
+};
+
+
+/* ****************************************************
+\\ Initializes batch settings with their defaults.
+//
+\\ ****************************************************/
+BatchOptions :: BatchOptions(void) :
+threads(0), queue_depth(8), encode(ENCODE_SMALLEST), preview(false)
+{
+  return;
+}
+
+
+/* ****************************************************
+\\ Returns the name the output of input is saved as.
+//
+\\ @param img: The decoded input.
+//
+\\ @param OUTPUT_DIR: The output directory. If empty,
+// the output is a copy beside the input.
+\\
+// @return: A copy of img, named for saving.
+\\
+// ****************************************************/
+static Image outputImage( const Image & img,
+                          const std::string & OUTPUT_DIR )
+{
+  // Copy-on-write: shares img's pixels. The copy
+  // constructor names it e.g. x_1.png.
+  Image out(img);
+
+  // If there is an output directory, keep the input's
+  // file name, but write it into that directory.
+  if(!OUTPUT_DIR.empty())
+  {
+    const std::string IN_NAME = img.getFilename();
+    const size_t SLASH = IN_NAME.find_last_of("/\\");
+    const std::string BASE = (SLASH == std::string::npos) ? IN_NAME : IN_NAME.substr(SLASH + 1);
+
+    out.setFilename(OUTPUT_DIR + "/" + BASE);
+  }
+
+  // The copy constructor only names copies of formats that
+  // can be saved; name a copy of any other (e.g. x.tif) by
+  // its stem, saving it as a PNG (x_1.png).
+  else if(out.getFilename().empty())
+  {
+    const std::string IN_NAME = img.getFilename();
+    const size_t SLASH = IN_NAME.find_last_of("/\\");
+    const size_t DOT = IN_NAME.find_last_of('.');
+    const bool HAS_EXT = DOT != std::string::npos && (SLASH == std::string::npos || DOT > SLASH + 1);
+
+    out.setFilename((HAS_EXT ? IN_NAME.substr(0, DOT) : IN_NAME) + "_1.png");
+  }
+
+  return out;
+}
+
+
+/* ****************************************************
+\\ Decodes, transforms and saves every input. See the
+// overview at the top of this file.
+\\
+// @param inputs: The names of the image files.
+\\
+// @param transform: Applied to each Image before it is
+\\ saved. May be empty, to just re-encode each input.
+//
+\\ @param options: Thread count, queue depth, output
+// location and encoder settings.
+\\
+// @return: One result per input, in input order.
+\\
+// ****************************************************/
+std::vector<BatchResult> processBatch( const std::vector<std::string> & inputs,
+                                       const ImageTransform & transform,
+                                       const BatchOptions & options )
+{
+  // One result per input. Each is written by exactly one thread.
+  std::vector<BatchResult> results(inputs.size());
+
+  // If there is nothing to do, return.
+  if(inputs.empty()) return results;
+
+  // The number of threads per stage.
+  uint threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+  if(threads == 0) threads = 1;
+  if(threads > inputs.size()) threads = static_cast<uint>(inputs.size());
+
+  // Decoded Images, waiting to be transformed.
+  BoundedQueue<BatchJob> decoded(options.queue_depth);
+
+  // Saved Images, waiting to be previewed. Holds just one, and
+  // is never waited on by the workers, which skip the preview
+  // while it's full. HighGUI must stay on the calling thread.
+  const bool PREVIEW = options.preview && !Image::isHeadless();
+  BoundedQueue<Image> previews(1);
+
+  // Processed Images, waiting to be reopened by a decoder,
+  // so same-sized inputs reuse their buffers. None are kept
+  // if reopenImage can't reuse them (see reusesBuffers).
+  BoundedQueue<Image> spares(threads);
+  const bool KEEP_SPARES = Image::reusesBuffers();
+
+  // The index of the next input to decode.
+  std::atomic<size_t> next_input(0);
+
+  // The number of decoders / processors still running. The
+  // last of each to finish closes the queue it feeds.
+  std::atomic<uint> decoders_left(threads),
+                    processors_left(threads);
+
+  // Decode stage: claims inputs in order, and queues the decoded Images.
+  auto decode = [&](void)
+  {
+    for(size_t idx; (idx = next_input++) < inputs.size(); )
+    {
+      BatchResult & result = results[idx];
+      result.input = inputs[idx];
+
+      BatchJob job;
+      job.idx = idx;
+      job.start = BatchClock::now();
+
+      // Decode into a spare Image if there is one. If the
+      // input could not be opened, record why.
+      spares.tryPop(job.img);
+      try
+      {
+        if(!job.img.reopenImage(inputs[idx]))
+        {
+          result.status = job.img.getStatus();
+          result.error = (result.status == IMG_FILE_MISSING) ? "file not found" : "could not decode";
+          continue;
+        }
+      }
+      // Report OpenCV errors per file, as the processors do;
+      // escaping, they'd end the program before the queue closes.
+      catch(std::exception & ex)
+      {
+        result.status = IMG_UNDECODABLE;
+        result.error = ex.what();
+        continue;
+      }
+
+      // Blocks while the queue is full.
+      decoded.push(std::move(job));
+    }
+
+    if(--decoders_left == 0) decoded.close();
+  };
+
+  // Transform + encode stage: drains the queue until decoding is done.
+  auto process = [&](void)
+  {
+    for(BatchJob job; decoded.pop(job); )
+    {
+      BatchResult & result = results[job.idx];
+      result.status = IMG_OK;
+
+      try
+      {
+        // Apply the transform, if there is one.
+        if(transform && !transform(job.img))
+          result.error = "transform failed";
+        else
+        {
+          // Name the output, and save it.
+          Image out = outputImage(job.img, options.output_dir);
+
+          result.ok = out.saveImage(options.encode);
+          result.output = out.getFilename();
+          if(!result.ok) result.error = "could not save";
+
+          // Offer it for preview (sharing its pixels).
+          else if(PREVIEW) previews.tryPush(out);
+        }
+      }
+      // Report OpenCV (or transform) errors per file.
+      catch(std::exception & ex) { result.ok = false; result.error = ex.what(); }
+
+      result.seconds = std::chrono::duration<double>(BatchClock::now() - job.start).count();
+
+      // Keep the Image for a decoder to reuse, if there's room.
+      if(KEEP_SPARES) spares.tryPush(std::move(job.img));
+    }
+
+    if(--processors_left == 0) previews.close();
+  };
+
+  // Start both stages.
+  std::vector<std::thread> pool;
+  for(uint t = 0; t < threads; ++t) pool.push_back(std::thread(decode));
+  for(uint t = 0; t < threads; ++t) pool.push_back(std::thread(process));
+
+  // While the batch runs, preview its outputs.
+  if(PREVIEW)
+  {
+    for(Image shown; previews.pop(shown); ) shown.previewImage("CLImage batch");
+    Image::closeWindows();
+  }
+
+  // Wait for every input to be processed.
+  for(size_t t = 0; t < pool.size(); ++t) pool[t].join();
+
+  return results;
+}
+
+
+/* ****************************************************
+\\ Expands wildcard patterns into file names, using the
+// platform's glob where available.
+\\
+// @param patterns: File names and/or patterns.
+\\
+// @return: The matching file names, in pattern order.
+\\
+// ****************************************************/
+std::vector<std::string> expandInputs(const std::vector<std::string> & patterns)
+{
+  // The expanded file names.
+  std::vector<std::string> names;
+
+  for(size_t p = 0; p < patterns.size(); ++p)
+  {
+#ifdef IMAGE_BATCH_GLOB
+    // Expand the pattern. GLOB_NOCHECK keeps patterns
+    // that match nothing, so they surface as missing.
+    glob_t matches;
+    if(glob(patterns[p].c_str(), GLOB_NOCHECK, nullptr, &matches) == 0)
+    {
+      for(size_t m = 0; m < matches.gl_pathc; ++m) names.push_back(matches.gl_pathv[m]);
+      globfree(&matches);
+    }
+    // If globbing failed, use the name as-is.
+    else names.push_back(patterns[p]);
+#else
+    // No glob support; use the name as-is.
+    names.push_back(patterns[p]);
+#endif
+  }
+
+  return names;
+}
@@ -0,0 +1,98 @@
+/* ***************************************************************
+\\ File Name:  ImageBatch.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Declarations for processing many images in one run.
+\\ Decoding overlaps with transforming/encoding across a pool of
+// threads, with a bounded queue between the two stages so memory
+\\ stays capped. See ImageBatch.cpp for more information.
+//
+\\ ***************************************************************/
+
+#ifndef IMAGE_BATCH_H
+#define IMAGE_BATCH_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Image.h"
+
+
+// An operation applied to each decoded Image before it is
+// saved. Returning false marks the file as failed (not saved).
+typedef std::function<bool(Image &)> ImageTransform;
+
+
+/* *************************************************
+\\ Settings for processBatch.
+//
+\\ *************************************************/
+struct BatchOptions
+{
+  // Initialize all fields with their defaults.
+  BatchOptions(void);
+
+       // Threads per stage (decode, transform + encode).
+       // 0 means one per hardware thread.
+  uint threads,
+       // Maximum number of decoded Images waiting
+       // to be transformed. Caps memory use.
+       queue_depth;
+
+  // If set, outputs are written to this directory
+  // with their input's name. Otherwise each output
+  // is saved beside its input, as a copy (e.g. x_1.png).
+  std::string output_dir;
+
+  // Encoder settings for every output.
+  EncodeOptions encode;
+
+  // If true (and not headless), outputs are previewed in a
+  // window by the calling thread as they are saved. Outputs
+  // arriving while the window is busy aren't shown, so the
+  // preview never slows the batch down.
+  bool preview;
+};
+
+
+/* *************************************************
+\\ The outcome of processing one input file.
+//
+\\ *************************************************/
+struct BatchResult
+{
+  // Initialize all fields as a failure.
+  BatchResult(void) : ok(false), status(IMG_OK), seconds(0) { return; }
+
+  // The input file, and the file that was written.
+  std::string input, output;
+
+  // True if the file was decoded, transformed and saved.
+  bool ok;
+
+  // The result of opening the input.
+  ImageStatus status;
+
+  // Describes the failure, if any.
+  std::string error;
+
+  // Wall time from the start of decode to the end of save.
+  double seconds;
+};
+
+
+// Decodes, transforms and saves every input in parallel.
+// Returns one result per input, in input order.
+std::vector<BatchResult> processBatch( const std::vector<std::string> & inputs,
+                                       const ImageTransform & transform,
+                                       const BatchOptions & options = BatchOptions() );
+
+// Expands shell-style wildcard patterns (e.g. "scans/*.png")
+// into file names. Patterns matching nothing are kept as-is,
+// so they are reported as missing files.
+std::vector<std::string> expandInputs(const std::vector<std::string> & patterns);
+
+#endif // IMAGE_BATCH_H
@@ -0,0 +1,286 @@
+/* ***************************************************************
+\\ File Name:  ImageDiff.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation of Image comparison. Both functions run
+\\ over the rows of the first Image in parallel (parallelForRows),
+// comparing each with the same row of the second:
+\\
+//   - imagesEqual compares raw row bytes with firstDiff, which
+\\     skips equal 16-byte blocks with SIMD. Once any row differs,
+//     the rows still to be compared are skipped.
+\\   - diffImages finds each row's RowDiff (diffRow for 8-bit
+//     rows, a scalar loop for 16-bit ones), writing the mask row
+\\     in the same pass. The per-row results are then reduced into
+//     the count, bounding box, errors and PSNR.
+\\
+// Pixels are compared by color, not by storage order: when just one
+\\ Image is stored RGB (a mapped PPM, see Image::isRGB), each row of
+// the other is compared with its red and blue swapped.
+\\
+// Nothing is allocated per pixel, and for views only the viewed
+\\ region is read.
+//
+\\ ***************************************************************/
+
+#include "ImageDiff.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+
+/* ****************************************************
+\\ Initializes the result of comparing equal Images.
+//
+\\ ****************************************************/
+ImageDiff :: ImageDiff(void) :
+comparable(false), mismatches(0), bounds(), max_error(0),
+mse(0.0), psnr(std::numeric_limits<double>::infinity())
+{
+  return;
+}
+
+
+// ********************* |
+// Helper Functions      |
+// ********************* V
+
+/* ****************************************************
+\\ Checks whether two Images can be compared pixel for
+// pixel.
+\\
+// @return: True if both are initialized, with the same
+\\ size, channel count and depth.
+//
+\\ ****************************************************/
+static bool sameLayout( const Image & a,
+                        const Image & b )
+{
+  return a.initialized() && b.initialized() &&
+         a.getWidth() == b.getWidth() && a.getHeight() == b.getHeight() &&
+         a.getChannels() == b.getChannels() && a.getDepth() == b.getDepth();
+}
+
+
+/* ****************************************************
+\\ Compares two rows of 16-bit channel values. The
+// scalar counterpart of diffRow.
+\\
+// @param a, b: The rows, of width * chans values.
+\\
+// @param mask: If not null, receives width values: each
+\\ pixel's largest channel difference, saturated to 255.
+//
+\\ @return: The differences found.
+//
+\\ ****************************************************/
+static RowDiff diffRow16( const ushort * a,
+                          const ushort * b,
+                          uchar * mask,
+                          uint width,
+                          uint chans )
+{
+  RowDiff diff;
+
+  for(uint px = 0; px < width; ++px, a += chans, b += chans)
+  {
+    // The pixel's largest channel difference.
+    uint worst = 0;
+
+    for(uint clr = 0; clr < chans; ++clr)
+    {
+      const uint ERR = (a[clr] > b[clr]) ? a[clr] - b[clr] : b[clr] - a[clr];
+      diff.squared_error += static_cast<unsigned long long>(ERR) * ERR;
+      if(ERR > worst) worst = ERR;
+    }
+
+    if(mask) mask[px] = static_cast<uchar>(worst > 255 ? 255 : worst);
+    if(!worst) continue;
+
+    if(!diff.mismatches) diff.first = px;
+    diff.last = px;
+    ++diff.mismatches;
+    if(worst > diff.max_error) diff.max_error = worst;
+  }
+
+  return diff;
+}
+
+
+/* ****************************************************
+\\ Returns a row of b in a's channel order. Rows of
+// Images stored in the same order are returned as is;
+\\ otherwise (one is a mapped PPM, see Image::isRGB)
+// channels 0 and 2 of each pixel are swapped into buf.
+\\
+// @param a, b: The Images being compared.
+\\
+// @param r: The row of b.
+\\
+// @param buf: Receives the swapped row, when one is
+\\ needed.
+//
+\\ ****************************************************/
+static const uchar * rowInOrderOf( const Image & a,
+                                   const Image & b,
+                                   uint r,
+                                   std::vector<uchar> & buf )
+{
+  const uchar * row = b.row(r).data;
+  if(a.isRGB() == b.isRGB()) return row;
+
+  const uint WIDTH = b.getWidth(),
+             CHANS = b.getChannels();
+  const size_t PIXEL = b.getPixelBytes(),
+               VALUE = PIXEL / CHANS;
+
+  buf.assign(row, row + WIDTH * PIXEL);
+  for(uchar * px = &buf[0], * end = px + WIDTH * PIXEL; px < end; px += PIXEL)
+    std::swap_ranges(px, px + VALUE, px + 2 * VALUE);
+
+  return &buf[0];
+}
+
+
+// ********************* |
+// Comparisons           |
+// ********************* V
+
+/* ****************************************************
+\\ Checks whether two Images hold the same pixels. Rows
+// are compared in parallel, and no more rows are
+\\ started once one differs.
+//
+\\ @param a, b: The Images (or views) to compare. An
+// Image stored RGB (isRGB) and one stored BGR are
+\\ compared color by color.
+//
+\\ @return: True if both are initialized, with the same
+// size, channel count and depth, and bit-for-bit equal
+\\ channel values.
+//
+\\ ****************************************************/
+bool imagesEqual( const Image & a,
+                  const Image & b )
+{
+  if(!sameLayout(a, b)) return false;
+
+  const uint HEIGHT = a.getHeight();
+  const size_t ROW_BYTES = size_t(a.getWidth()) * a.getPixelBytes();
+
+  // Images sharing their pixels (copies not yet written to, or
+  // the same view twice) are equal without reading any. Rows
+  // 0 and the last pin down both the start and the step.
+  if( a.isRGB() == b.isRGB() && a.row(0).data == b.row(0).data &&
+      a.row(HEIGHT - 1).data == b.row(HEIGHT - 1).data ) return true;
+
+  // Set by the first row found to differ.
+  std::atomic<bool> differs(false);
+
+  a.parallelForRows([&](uint r, ImageRow<const uchar> pixels)
+  {
+    if(differs.load(std::memory_order_relaxed)) return;
+
+    std::vector<uchar> swapped;
+    if(firstDiff(pixels.data, rowInOrderOf(a, b, r, swapped), ROW_BYTES) != ROW_BYTES)
+      differs.store(true, std::memory_order_relaxed);
+  });
+
+  return !differs.load();
+}
+
+
+/* ****************************************************
+\\ Compares every pixel of two Images in one pass.
+//
+\\ @param a, b: The Images (or views) to compare. Both
+// must be 8- or 16-bit, with the same size and type.
+\\ An Image stored RGB (isRGB) and one stored BGR are
+// compared color by color.
+\\
+// @param mask: If not null, receives a CV_8UC1 Mat of
+\\ the Images' size: each pixel's largest absolute
+// channel difference, saturated to 255 (0 where the
+\\ pixels are equal). Unchanged if not comparable.
+//
+\\ @return: The differences. comparable is false (and
+// nothing else set) if the Images don't match, or are
+\\ neither 8- nor 16-bit.
+//
+\\ ****************************************************/
+ImageDiff diffImages( const Image & a,
+                      const Image & b,
+                      cv::Mat * mask )
+{
+  ImageDiff result;
+
+  if(!sameLayout(a, b) || (a.getDepth() != CV_8U && a.getDepth() != CV_16U))
+    return result;
+
+  const uint WIDTH = a.getWidth(),
+             HEIGHT = a.getHeight(),
+             CHANS = a.getChannels();
+  const bool WIDE = (a.getDepth() == CV_16U);
+
+  if(mask) mask->create(static_cast<int>(HEIGHT), static_cast<int>(WIDTH), CV_8UC1);
+
+  // Each row's differences, reduced once every row is done.
+  std::vector<RowDiff> rows(HEIGHT);
+
+  a.parallelForRows([&](uint r, ImageRow<const uchar> pixels)
+  {
+    uchar * mask_row = mask ? mask->ptr<uchar>(static_cast<int>(r)) : nullptr;
+
+    std::vector<uchar> swapped;
+    const uchar * other = rowInOrderOf(a, b, r, swapped);
+
+    if(WIDE)
+      rows[r] = diffRow16( reinterpret_cast<const ushort *>(pixels.data),
+                           reinterpret_cast<const ushort *>(other),
+                           mask_row, WIDTH, CHANS );
+    else
+      rows[r] = diffRow(pixels.data, other, mask_row, WIDTH, CHANS);
+  });
+
+  // The columns and rows of the differing pixels' extremes.
+  uint left = WIDTH, right = 0,
+       top = HEIGHT, bottom = 0;
+
+  // Summed in floating point: a large 16-bit Image's total
+  // could overflow 64 bits.
+  double squared_error = 0.0;
+
+  for(uint r = 0; r < HEIGHT; ++r)
+  {
+    const RowDiff & row = rows[r];
+    squared_error += static_cast<double>(row.squared_error);
+    if(!row.mismatches) continue;
+
+    result.mismatches += row.mismatches;
+    if(row.max_error > result.max_error) result.max_error = row.max_error;
+    if(row.first < left) left = row.first;
+    if(row.last > right) right = row.last;
+    if(r < top) top = r;
+    bottom = r;
+  }
+
+  result.comparable = true;
+
+  if(result.mismatches)
+  {
+    result.bounds = cv::Rect( static_cast<int>(left), static_cast<int>(top),
+                              static_cast<int>(right - left + 1),
+                              static_cast<int>(bottom - top + 1) );
+
+    const double PEAK = WIDE ? 65535.0 : 255.0;
+    result.mse = squared_error / (double(WIDTH) * HEIGHT * CHANS);
+    result.psnr = 10.0 * std::log10(PEAK * PEAK / result.mse);
+  }
+
+  return result;
+}
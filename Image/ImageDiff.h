@@ -0,0 +1,70 @@
+/* ***************************************************************
+\\ File Name:  ImageDiff.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Declarations for comparing the pixels of two Images: a
+\\ fast equality check that stops at the first difference, and a
+// full diff reporting where and by how much they differ. To compare
+\\ regions, pass views made by Image::subImage. See ImageDiff.cpp
+// for more information.
+\\
+// ***************************************************************/
+
+#ifndef IMAGE_DIFF_H
+#define IMAGE_DIFF_H
+
+#include "Image.h"
+
+
+/* *************************************************
+\\ How two Images differ, as found by diffImages.
+//
+\\ *************************************************/
+struct ImageDiff
+{
+  // Initialize all fields as for equal Images.
+  ImageDiff(void);
+
+  // False if the Images couldn't be compared (either
+  // is uninitialized, or their sizes, channel counts
+  // or depths differ). The other fields are then unset.
+  bool comparable;
+
+  // The number of pixels with any channel differing.
+  size_t mismatches;
+
+  // The smallest rectangle holding every differing
+  // pixel. Empty if there are none.
+  cv::Rect bounds;
+
+  // The largest absolute difference of any channel value.
+  uint max_error;
+
+         // The mean squared difference of every channel
+         // value, and the peak signal-to-noise ratio in
+         // dB (infinity when the Images are equal).
+  double mse,
+         psnr;
+};
+
+
+// True if both Images are initialized, have the same size,
+// channel count and depth, and the same pixels (compared bit
+// for bit). Stops at the first difference. Any depth. Pixels
+// are compared by color, so a mapped PPM (stored RGB, see
+// Image::isRGB) equals a decoded copy of the same file.
+bool imagesEqual( const Image & a,
+                  const Image & b );
+
+// Compares every pixel of two 8- or 16-bit Images of the same
+// size and type in one pass. If mask isn't null, it is set to a
+// CV_8UC1 Mat of the Images' size holding each pixel's largest
+// channel difference (saturated to 255 for 16-bit Images).
+// Like imagesEqual, it compares RGB and BGR Images by color.
+ImageDiff diffImages( const Image & a,
+                      const Image & b,
+                      cv::Mat * mask = nullptr );
+
+#endif // IMAGE_DIFF_H
@@ -0,0 +1,320 @@
+/* ***************************************************************
+\\ File Name:  ImageHeader.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation of header-only image inspection. The
+\\ format is sniffed from the first bytes, and then:
+//
+\\   - PNG:    the IHDR chunk (always first) gives the size, bit
+//             depth and color type. OpenCV 3+ also decodes a tRNS
+\\             chunk as alpha, so chunks are walked up to IDAT.
+//   - JPEG:   markers are skipped, by their lengths, up to the
+\\             frame header (SOFn), which gives the size and the
+//             component count.
+\\   - Netpbm: the text header gives the size and maxval.
+//
+\\ The channel count and depth are mapped the way OpenCV's decoders
+// map them, so that they match what cv::imread would return.
+\\
+// ***************************************************************/
+
+#include "ImageHeader.h"
+#include "Image.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+
+// The bytes of a file read up front: enough for the PNG IHDR
+// chunk, and for any Netpbm header short of very long comments.
+const static size_t HEAD_BYTES = 512;
+
+
+/* ****************************************************
+\\ Initializes an empty header.
+//
+\\ ****************************************************/
+ImageHeader :: ImageHeader(void) :
+width(0), height(0), channels(0), depth(-1), format(-1)
+{
+  return;
+}
+
+
+// ********************* |
+// Helper Functions      |
+// ********************* V
+
+// Reads a big-endian 16- or 32-bit value.
+static uint bigEndian16(const uchar * p) { return (uint(p[0]) << 8) | p[1]; }
+static uint bigEndian32(const uchar * p) { return (bigEndian16(p) << 16) | bigEndian16(p + 2); }
+
+
+/* ****************************************************
+\\ Reads a PNG header. The IHDR chunk must come first.
+//
+\\ @param in: The file, positioned after the bytes in
+// head.
+\\
+// @param head, len: The first bytes of the file.
+\\
+// @return: True if header was filled in.
+\\
+// ****************************************************/
+static bool readPngHeader( std::FILE * in,
+                           const uchar * head,
+                           size_t len,
+                           ImageHeader & header )
+{
+  // Signature (8), chunk length (4), "IHDR" (4), then the
+  // width (4), height (4), bit depth (1) and color type (1).
+  if(len < 33 || bigEndian32(head + 8) != 13 || std::memcmp(head + 12, "IHDR", 4)) return false;
+
+  const uint BIT_DEPTH = head[24],
+             COLOR_TYPE = head[25];
+
+  header.width = bigEndian32(head + 16);
+  header.height = bigEndian32(head + 20);
+  header.depth = (BIT_DEPTH == 16) ? CV_16U : CV_8U;
+
+  // Color types: 0 gray, 2 RGB, 3 palette, 4 gray + alpha, 6 RGBA.
+  switch(COLOR_TYPE)
+  {
+    case 2: case 3: header.channels = 3; break;
+    case 6:         header.channels = 4; break;
+#if CV_MAJOR_VERSION >= 3
+    case 4:         header.channels = 4; break;
+#endif
+    default:        header.channels = 1; break;
+  }
+
+#if CV_MAJOR_VERSION >= 3
+  // OpenCV 3+ decodes RGB and palette images with a
+  // transparency chunk as BGRA. tRNS precedes IDAT.
+  if(COLOR_TYPE == 2 || COLOR_TYPE == 3)
+  {
+    // Move to the chunk after IHDR (8 + 8 + 13 + 4 crc).
+    if(std::fseek(in, 33, SEEK_SET) != 0) return false;
+
+    uchar chunk[8];
+    while(std::fread(chunk, 1, sizeof(chunk), in) == sizeof(chunk))
+    {
+      if(!std::memcmp(chunk + 4, "tRNS", 4)) { header.channels = 4; break; }
+      if(!std::memcmp(chunk + 4, "IDAT", 4)) break;
+
+      // Skip the chunk's data and crc.
+      if(std::fseek(in, long(bigEndian32(chunk)) + 4, SEEK_CUR) != 0) break;
+    }
+  }
+#else
+  (void)in;
+#endif
+
+  return true;
+}
+
+
+/* ****************************************************
+\\ Reads a JPEG header: walks the markers from the start
+// of the file until the frame header. Only the 4-byte
+\\ marker headers are read; segments are seeked past.
+//
+\\ @param in: The file.
+//
+\\ @return: True if header was filled in.
+//
+\\ ****************************************************/
+static bool readJpegHeader( std::FILE * in,
+                            ImageHeader & header )
+{
+  // Start after the start-of-image marker.
+  if(std::fseek(in, 2, SEEK_SET) != 0) return false;
+
+  while(true)
+  {
+    // Find the next marker. Any number of 0xFF fill bytes
+    // may precede its code.
+    int c = std::fgetc(in);
+    if(c != 0xFF) return false;
+    while((c = std::fgetc(in)) == 0xFF) continue;
+    if(c == EOF) return false;
+
+    const int MARKER = c;
+
+    // Standalone markers (TEM, RSTn) have no length.
+    if(MARKER == 0x01 || (MARKER >= 0xD0 && MARKER <= 0xD7)) continue;
+
+    // The image data (SOS) or the end (EOI) came before any
+    // frame header.
+    if(MARKER == 0xD9 || MARKER == 0xDA) return false;
+
+    uchar len_bytes[2];
+    if(std::fread(len_bytes, 1, 2, in) != 2) return false;
+    const uint LEN = bigEndian16(len_bytes);
+    if(LEN < 2) return false;
+
+    // SOF0..SOF15, except DHT (C4), JPG (C8) and DAC (CC):
+    // precision (1), height (2), width (2), components (1).
+    if(MARKER >= 0xC0 && MARKER <= 0xCF && MARKER != 0xC4 && MARKER != 0xC8 && MARKER != 0xCC)
+    {
+      uchar frame[6];
+      if(LEN < 8 || std::fread(frame, 1, sizeof(frame), in) != sizeof(frame)) return false;
+
+      header.height = bigEndian16(frame + 1);
+      header.width = bigEndian16(frame + 3);
+
+      // OpenCV decodes any color JPEG (YCbCr, CMYK) as BGR.
+      header.channels = (frame[5] > 1) ? 3 : 1;
+      header.depth = CV_8U;
+      return true;
+    }
+
+    // Skip the rest of the segment.
+    if(std::fseek(in, long(LEN) - 2, SEEK_CUR) != 0) return false;
+  }
+}
+
+
+/* ****************************************************
+\\ Reads a Netpbm header: the magic number, width,
+// height, and (except for bitmaps) maxval.
+\\
+// @param head, len: The first bytes of the file.
+\\
+// @return: True if header was filled in.
+\\
+// ****************************************************/
+static bool readPnmHeader( const uchar * head,
+                           size_t len,
+                           ImageHeader & header )
+{
+  // P1/P4 bitmaps have no maxval; P3/P6 are color.
+  const bool BITMAP = (head[1] == '1' || head[1] == '4'),
+             COLOR = (head[1] == '3' || head[1] == '6');
+
+  size_t pos = 2;
+  const size_t WIDTH  = parsePnmField(head, len, pos),
+               HEIGHT = WIDTH ? parsePnmField(head, len, pos) : 0,
+               MAXVAL = BITMAP ? 1 : (HEIGHT ? parsePnmField(head, len, pos) : 0);
+
+  // If a field is missing (or cut off by a very long
+  // comment), let the decoder sort it out.
+  if(!HEIGHT || !MAXVAL || pos >= len) return false;
+
+  header.width = static_cast<uint>(WIDTH);
+  header.height = static_cast<uint>(HEIGHT);
+  header.channels = COLOR ? 3 : 1;
+  header.depth = (MAXVAL > 255) ? CV_16U : CV_8U;
+  return true;
+}
+
+
+// ********************* |
+// Header Parsing        |
+// ********************* V
+
+/* ****************************************************
+\\ Reads the size and pixel type of an image file from
+// its header, without decoding any pixels.
+\\
+// @param path: The name of the image file.
+\\
+// @param header: Receives the header. Unchanged on
+\\ failure.
+//
+\\ @return: True if the file is a PNG, JPEG or Netpbm
+// image with a valid, non-empty header.
+\\
+// ****************************************************/
+bool readImageHeader( const std::string & path,
+                      ImageHeader & header )
+{
+  std::FILE * in = std::fopen(path.c_str(), "rb");
+  if(!in) return false;
+
+  uchar head[HEAD_BYTES];
+  const size_t LEN = std::fread(head, 1, sizeof(head), in);
+
+  ImageHeader read;
+  read.format = Image::sniffFormat(head, LEN);
+
+  bool ok = false;
+  switch(read.format)
+  {
+    case FORMAT_PNG: ok = readPngHeader(in, head, LEN, read); break;
+    case FORMAT_JPG: ok = readJpegHeader(in, read); break;
+    case FORMAT_PBM:
+    case FORMAT_PGM:
+    case FORMAT_PPM: ok = readPnmHeader(head, LEN, read); break;
+  }
+
+  std::fclose(in);
+
+  // cv::Mat dimensions are ints; anything larger is invalid.
+  const uint MAX_DIM = static_cast<uint>(std::numeric_limits<int>::max());
+  if( !ok || read.width == 0 || read.height == 0 ||
+      read.width > MAX_DIM || read.height > MAX_DIM ) return false;
+
+  header = read;
+  return true;
+}
+
+
+/* ****************************************************
+\\ Skips whitespace and '#' comments in a PNM header.
+//
+\\ @param hdr, len: The header bytes.
+//
+\\ @param pos: The current position. Advanced past
+// the whitespace and comments.
+\\
+// ****************************************************/
+void skipPnmSpace( const uchar * hdr,
+                   size_t len,
+                   size_t & pos )
+{
+  while(pos < len)
+  {
+    // A comment runs to the end of the line.
+    if(hdr[pos] == '#')
+      while(pos < len && hdr[pos] != '\n' && hdr[pos] != '\r') ++pos;
+    // Skip whitespace.
+    else if(isspace(hdr[pos])) ++pos;
+    // Any other character ends the run.
+    else return;
+  }
+}
+
+
+/* ****************************************************
+\\ Parses an unsigned decimal field of a PNM header.
+//
+\\ @param hdr, len: The header bytes.
+//
+\\ @param pos: The current position. Advanced past
+// the field.
+\\
+// @return: The value, or 0 if there is no valid field.
+\\
+// ****************************************************/
+size_t parsePnmField( const uchar * hdr,
+                      size_t len,
+                      size_t & pos )
+{
+  // Skip the separator before the field.
+  skipPnmSpace(hdr, len, pos);
+
+  // The value of the field.
+  size_t value = 0;
+
+  // Accumulate digits. Reject absurd values
+  // rather than overflow.
+  while(pos < len && isdigit(hdr[pos]) && value < (1u << 30))
+    value = value * 10 + (hdr[pos++] - '0');
+
+  return value;
+}
@@ -0,0 +1,64 @@
+/* ***************************************************************
+\\ File Name:  ImageHeader.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Declarations for reading the dimensions and pixel type
+\\ of an image file from its header alone, without decoding any
+// pixels. Used by Image::openImage's lazy mode. See ImageHeader.cpp
+\\ for more information.
+//
+\\ ***************************************************************/
+
+#ifndef IMAGE_HEADER_H
+#define IMAGE_HEADER_H
+
+#include <string>
+
+#include "opencv2/core/core.hpp"
+
+
+/* *************************************************
+\\ What an image file's header says about its pixels,
+// given as cv::imread(IMREAD_UNCHANGED) would decode
+\\ them (e.g. 3 channels for a palette PNG).
+//
+\\ *************************************************/
+struct ImageHeader
+{
+  // Initialize all fields as an empty header.
+  ImageHeader(void);
+
+       // The size of the image in pixels.
+  uint width,
+       height,
+       // The number of channels per pixel.
+       channels;
+
+      // The OpenCV depth of each channel value (CV_8U or CV_16U).
+  int depth,
+      // The file's ImageFormat (FORMAT_JPG for any JPEG).
+      format;
+};
+
+
+// Reads the header of a PNG, JPEG or Netpbm file into header.
+// Only the header is read (for JPEG, the markers up to the
+// frame header). False if the file can't be read, is of another
+// format (OpenCV may still decode it), or its header is invalid.
+bool readImageHeader( const std::string & path,
+                      ImageHeader & header );
+
+// Skips whitespace and '#' comments in a PNM header, from pos.
+void skipPnmSpace( const uchar * hdr,
+                   size_t len,
+                   size_t & pos );
+
+// Parses an unsigned decimal field of a PNM header at pos, and
+// advances pos past it. 0 if there is no valid field.
+size_t parsePnmField( const uchar * hdr,
+                      size_t len,
+                      size_t & pos );
+
+#endif // IMAGE_HEADER_H
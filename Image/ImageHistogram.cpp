@@ -0,0 +1,415 @@
+/* ***************************************************************
+\\ File Name:  ImageHistogram.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation of Image histograms and statistics.
+\\
+// The rows are split into one stripe per WorkPool thread, and each
+\\ stripe is counted into its own private bins, so the threads never
+// write to shared memory until the final reduction (a single merge
+\\ per stripe).
+//
+\\ Within a stripe, consecutive values are counted into different
+// tables (value i into table i % tables, each table holding one
+\\ channel), with the loop unrolled by the table count. Repeated
+// values (flat regions, or a single channel) would otherwise make
+\\ every increment wait on the store of the one before it. The 8-bit
+// kernels use at least 4 tables (6 for 3 channels), 16-bit ones one
+\\ per channel: their tables are 256 times larger, their values varied.
+//
+\\ The statistics are computed from the histogram, exactly, rather
+// than from another pass over the pixels.
+\\
+// ***************************************************************/
+
+#include "ImageHistogram.h"
+#include "WorkPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <stdint.h>
+
+
+// *************************** |
+// Global Constant Definitions |
+// *************************** V
+
+// The fewest tables an 8-bit stripe counts into.
+const static uint MIN_TABLES_8U = 4;
+
+// The smallest expected count of a value pair for it to be tested
+// by lsbChiSquare (the usual validity rule of the chi-square test).
+const static double MIN_EXPECTED = 5.0;
+
+
+// ********************* |
+// Counting Kernels      |
+// ********************* V
+
+/* ****************************************************
+\\ Counts len values into TABLES (1 to 6) tables of
+// levels counts, value i into table i % TABLES. The
+\\ table count is fixed at compile time, so the loop
+// body is one increment per table, with no inner loop.
+\\
+// @param src: The values.
+\\
+// @param counts: The tables, one after another.
+\\
+// ****************************************************/
+template <typename T, uint TABLES>
+static void countValues( const T * src,
+                         size_t len,
+                         uint32_t * counts,
+                         size_t levels )
+{
+  static_assert(TABLES >= 1 && TABLES <= 6, "countValues unrolls at most 6 tables");
+
+  uint32_t * const T0 = counts,
+           * const T1 = counts + (TABLES > 1 ? levels : 0),
+           * const T2 = counts + (TABLES > 2 ? 2 * levels : 0),
+           * const T3 = counts + (TABLES > 3 ? 3 * levels : 0),
+           * const T4 = counts + (TABLES > 4 ? 4 * levels : 0),
+           * const T5 = counts + (TABLES > 5 ? 5 * levels : 0);
+
+  size_t i = 0;
+  for(; i + TABLES <= len; i += TABLES)
+  {
+    ++T0[src[i]];
+    if(TABLES > 1) ++T1[src[i + 1]];
+    if(TABLES > 2) ++T2[src[i + 2]];
+    if(TABLES > 3) ++T3[src[i + 3]];
+    if(TABLES > 4) ++T4[src[i + 4]];
+    if(TABLES > 5) ++T5[src[i + 5]];
+  }
+
+  for(uint t = 0; i < len; ++i, ++t) ++counts[t * levels + src[i]];
+}
+
+
+/* ****************************************************
+\\ Counts len values into any number of tables. The
+// fallback for table counts without an unrolled
+\\ kernel.
+//
+\\ ****************************************************/
+template <typename T>
+static void countValues( const T * src,
+                         size_t len,
+                         uint32_t * counts,
+                         size_t levels,
+                         uint tables )
+{
+  switch(tables)
+  {
+    case 1: countValues<T, 1>(src, len, counts, levels); return;
+    case 2: countValues<T, 2>(src, len, counts, levels); return;
+    case 3: countValues<T, 3>(src, len, counts, levels); return;
+    case 4: countValues<T, 4>(src, len, counts, levels); return;
+    case 5: countValues<T, 5>(src, len, counts, levels); return;
+    case 6: countValues<T, 6>(src, len, counts, levels); return;
+  }
+
+  for(size_t i = 0; i < len; )
+    for(uint t = 0; t < tables && i < len; ++t, ++i) ++counts[t * levels + src[i]];
+}
+
+
+/* ****************************************************
+\\ Counts the values of an Image with channels of type
+// T into hist, which has been sized for it.
+\\
+// @param img: The Image (or view).
+\\
+// @param hist: Receives the counts. Its bins must be
+\\ zeroed.
+//
+\\ ****************************************************/
+template <typename T>
+static void countImage( const Image & img,
+                        ImageHistogram & hist )
+{
+  const uint WIDTH = img.getWidth(),
+             HEIGHT = img.getHeight(),
+             CHANS = img.getChannels();
+  const size_t LEVELS = hist.levels,
+               ROW_VALUES = size_t(WIDTH) * CHANS;
+
+  // A multiple of the channel count, so every table holds
+  // values of one channel (table t, channel t % CHANS).
+  uint tables = CHANS;
+  if(sizeof(T) == 1) while(tables < MIN_TABLES_8U) tables += CHANS;
+
+  // One stripe of rows per thread.
+  const uint STRIPES = std::min(HEIGHT, WorkPool::shared().size());
+
+  // Guards hist during the reduction.
+  std::mutex merge_lock;
+
+  WorkPool::shared().parallelFor(STRIPES, 1, [&](size_t begin, size_t end)
+  {
+    // The stripe's private bins. 32-bit, to halve their
+    // footprint; merged before they could overflow.
+    std::vector<uint32_t> counts(tables * LEVELS, 0);
+
+    // Adds the private bins to hist, and zeroes them.
+    auto flush = [&]()
+    {
+      std::lock_guard<std::mutex> guard(merge_lock);
+      for(uint t = 0; t < tables; ++t)
+      {
+        unsigned long long * bins = &hist.bins[(t % CHANS) * LEVELS];
+        const uint32_t * table = &counts[t * LEVELS];
+        for(size_t v = 0; v < LEVELS; ++v) bins[v] += table[v];
+      }
+      std::fill(counts.begin(), counts.end(), 0);
+    };
+
+    for(size_t stripe = begin; stripe < end; ++stripe)
+    {
+      const uint FIRST = static_cast<uint>(stripe * HEIGHT / STRIPES),
+                 LAST = static_cast<uint>((stripe + 1) * HEIGHT / STRIPES);
+
+      // The values counted since the last flush; no single
+      // count can exceed it.
+      size_t pending = 0;
+
+      for(uint r = FIRST; r < LAST; ++r)
+      {
+        if(pending + ROW_VALUES > std::numeric_limits<uint32_t>::max())
+        {
+          flush();
+          pending = 0;
+        }
+
+        countValues(reinterpret_cast<const T *>(img.row(r).data), ROW_VALUES,
+                    &counts[0], LEVELS, tables);
+        pending += ROW_VALUES;
+      }
+
+      flush();
+    }
+  });
+}
+
+
+/* ****************************************************
+\\ Returns Q(a, x), the regularized upper incomplete
+// gamma function: the series for x < a + 1, and the
+\\ continued fraction (modified Lentz) otherwise.
+//
+\\ ****************************************************/
+static double upperGammaQ( double a,
+                           double x )
+{
+  const int MAX_TERMS = 1000;
+  const double EPS = 1e-14,
+               TINY = 1e-300;
+
+  if(x <= 0.0) return 1.0;
+
+  const double LOG_PREFIX = a * std::log(x) - x - std::lgamma(a);
+
+  if(x < a + 1.0)
+  {
+    double term = 1.0 / a, sum = term;
+    for(int n = 1; n < MAX_TERMS && std::fabs(term) > std::fabs(sum) * EPS; ++n)
+    {
+      term *= x / (a + n);
+      sum += term;
+    }
+    return 1.0 - sum * std::exp(LOG_PREFIX);
+  }
+
+  double b = x + 1.0 - a,
+         c = 1.0 / TINY,
+         d = 1.0 / b,
+         h = d;
+  for(int n = 1; n < MAX_TERMS; ++n)
+  {
+    const double AN = -n * (n - a);
+    b += 2.0;
+    d = AN * d + b;
+    if(std::fabs(d) < TINY) d = TINY;
+    c = b + AN / c;
+    if(std::fabs(c) < TINY) c = TINY;
+    d = 1.0 / d;
+    const double DELTA = d * c;
+    h *= DELTA;
+    if(std::fabs(DELTA - 1.0) < EPS) break;
+  }
+  return std::exp(LOG_PREFIX) * h;
+}
+
+
+// ********************* |
+// Histograms            |
+// ********************* V
+
+/* ****************************************************
+\\ Counts every channel value of an Image.
+//
+\\ @param img: The Image (or view). 8- or 16-bit.
+//
+\\ @param hist: Receives the histogram: 256 levels per
+// channel for 8-bit Images, 65536 for 16-bit ones.
+\\ Unchanged on failure.
+//
+\\ @return: False if the Image is uninitialized, or
+// neither 8- nor 16-bit.
+\\
+// ****************************************************/
+bool computeHistogram( const Image & img,
+                       ImageHistogram & hist )
+{
+  const int DEPTH = img.getDepth();
+  if(!img.initialized() || (DEPTH != CV_8U && DEPTH != CV_16U)) return false;
+
+  ImageHistogram counted;
+  counted.channels = img.getChannels();
+  counted.levels = (DEPTH == CV_8U) ? 256 : 65536;
+  counted.pixels = static_cast<unsigned long long>(img.getWidth()) * img.getHeight();
+  counted.bins.assign(size_t(counted.channels) * counted.levels, 0);
+
+  if(DEPTH == CV_8U) countImage<uchar>(img, counted);
+  else countImage<ushort>(img, counted);
+
+  hist.channels = counted.channels;
+  hist.levels = counted.levels;
+  hist.pixels = counted.pixels;
+  hist.bins.swap(counted.bins);
+  return true;
+}
+
+
+/* ****************************************************
+\\ Computes the statistics of one channel from its
+// counts. The variance is taken about the mean (two
+\\ passes over the levels), which keeps it accurate
+// for 16-bit values.
+\\
+// @param hist: The histogram.
+\\
+// @param clr: The channel.
+\\
+// @return: The channel's statistics. All 0 if the
+\\ channel doesn't exist, or has no values.
+//
+\\ ****************************************************/
+ChannelStats channelStats( const ImageHistogram & hist,
+                           uint clr )
+{
+  ChannelStats stats;
+
+  const unsigned long long * bins = hist.channel(clr);
+  if(!bins) return stats;
+
+  double sum = 0.0;
+  for(uint v = 0; v < hist.levels; ++v)
+  {
+    if(!bins[v]) continue;
+
+    if(!stats.count) stats.min = v;
+    stats.max = v;
+    stats.count += bins[v];
+    sum += static_cast<double>(bins[v]) * v;
+  }
+
+  if(!stats.count) return stats;
+  stats.mean = sum / static_cast<double>(stats.count);
+
+  double squares = 0.0;
+  for(uint v = stats.min; v <= stats.max; ++v)
+  {
+    const double DEV = v - stats.mean;
+    squares += static_cast<double>(bins[v]) * DEV * DEV;
+  }
+  stats.variance = squares / static_cast<double>(stats.count);
+
+  return stats;
+}
+
+
+/* ****************************************************
+\\ Computes the statistics of every channel of an Image.
+//
+\\ @param img: The Image (or view). 8- or 16-bit.
+//
+\\ @param stats: Receives one entry per channel.
+// Unchanged on failure.
+\\
+// @return: False if the Image can't be counted (see
+\\ computeHistogram).
+//
+\\ ****************************************************/
+bool channelStats( const Image & img,
+                   std::vector<ChannelStats> & stats )
+{
+  ImageHistogram hist;
+  if(!computeHistogram(img, hist)) return false;
+
+  std::vector<ChannelStats> found(hist.channels);
+  for(uint clr = 0; clr < hist.channels; ++clr) found[clr] = channelStats(hist, clr);
+
+  stats.swap(found);
+  return true;
+}
+
+
+/* ****************************************************
+\\ Runs the LSB pair (Westfeld-Pfitzmann) chi-square
+// test. Each pair of values (2k, 2k + 1) is a category:
+\\ its expected count is the mean of the two, and the
+// observed one the count of 2k. Pairs expected fewer
+\\ than MIN_EXPECTED times are skipped.
+//
+\\ @param hist: The histogram.
+//
+\\ @param channel_mask: Bit i set means channel i is
+// tested. The counts of tested channels are pooled.
+\\
+// @return: The statistic, its degrees of freedom, and
+\\ the probability of embedding. All 0 if fewer than
+// two pairs could be tested.
+\\
+// ****************************************************/
+LsbChiSquare lsbChiSquare( const ImageHistogram & hist,
+                           uint channel_mask )
+{
+  LsbChiSquare result;
+
+  // The count of each value, over the tested channels.
+  std::vector<unsigned long long> pooled(hist.levels, 0);
+  for(uint clr = 0; clr < hist.channels && clr < 32; ++clr)
+  {
+    if(!(channel_mask & (1u << clr))) continue;
+
+    const unsigned long long * bins = hist.channel(clr);
+    for(uint v = 0; v < hist.levels; ++v) pooled[v] += bins[v];
+  }
+
+  uint pairs = 0;
+  for(uint v = 0; v + 1 < hist.levels; v += 2)
+  {
+    const double EXPECTED = (static_cast<double>(pooled[v]) + pooled[v + 1]) / 2.0;
+    if(EXPECTED < MIN_EXPECTED) continue;
+
+    const double DEV = pooled[v] - EXPECTED;
+    result.chi_square += DEV * DEV / EXPECTED;
+    ++pairs;
+  }
+
+  if(pairs < 2)
+  {
+    result.chi_square = 0.0;
+    return result;
+  }
+
+  result.freedom = pairs - 1;
+  result.p_embedded = upperGammaQ(result.freedom / 2.0, result.chi_square / 2.0);
+  return result;
+}
@@ -0,0 +1,126 @@
+/* ***************************************************************
+\\ File Name:  ImageHistogram.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Declarations for per-channel histograms of 8- and 16-bit
+\\ Images, the statistics that follow from them (mean, variance,
+// range), and the LSB pair chi-square test used to detect (and
+\\ size) least-significant-bit payloads. For a region, pass a view
+// made by Image::subImage. See ImageHistogram.cpp for more
+\\ information.
+//
+\\ ***************************************************************/
+
+#ifndef IMAGE_HISTOGRAM_H
+#define IMAGE_HISTOGRAM_H
+
+#include <vector>
+
+#include "Image.h"
+
+
+/* *************************************************
+\\ The number of times each channel value occurs in
+// an Image, channel by channel.
+\\
+// *************************************************/
+struct ImageHistogram
+{
+  // Initialize all fields as an empty histogram.
+  ImageHistogram(void) : channels(0), levels(0), pixels(0) { return; }
+
+  // Returns the levels counts of a channel, indexed
+  // by value. Null if the channel doesn't exist.
+  const unsigned long long * channel(uint clr) const
+  { return clr < channels ? &bins[size_t(clr) * levels] : nullptr; }
+
+       // The Image's channel count, and the number of
+       // values a channel can take (256 or 65536).
+  uint channels,
+       levels;
+
+  // The number of pixels counted.
+  unsigned long long pixels;
+
+  // The counts of every channel, one after another:
+  // value v of channel clr is bins[clr * levels + v].
+  std::vector<unsigned long long> bins;
+};
+
+
+/* *************************************************
+\\ Summary statistics of one channel's values.
+//
+\\ *************************************************/
+struct ChannelStats
+{
+  // Initialize all fields as for an empty channel.
+  ChannelStats(void) : count(0), min(0), max(0), mean(0.0), variance(0.0) { return; }
+
+  // The number of values.
+  unsigned long long count;
+
+       // The smallest and largest values.
+  uint min,
+       max;
+
+         // The mean of the values, and their (population)
+         // variance.
+  double mean,
+         variance;
+};
+
+
+/* *************************************************
+\\ The result of the LSB pair chi-square test.
+// Embedding random bits in the low bit of values
+\\ evens out the counts of each pair of values that
+// differ only in that bit (2k, 2k + 1); the test
+\\ measures how even they are.
+//
+\\ *************************************************/
+struct LsbChiSquare
+{
+  // Initialize all fields as for an untestable histogram.
+  LsbChiSquare(void) : chi_square(0.0), freedom(0), p_embedded(0.0) { return; }
+
+  // The chi-square statistic of the pairs' counts.
+  double chi_square;
+
+  // The degrees of freedom: the pairs tested, less
+  // one. 0 if too few values could be tested.
+  uint freedom;
+
+  // The probability that the pairs would be at least
+  // this even by chance, if the low bits were random:
+  // near 1 for a carrier filled with payload, near 0
+  // for an untouched Image.
+  double p_embedded;
+};
+
+
+// Counts every channel value of an 8- or 16-bit Image into hist,
+// in parallel. False (hist unchanged) if the Image is uninitialized
+// or of another depth.
+bool computeHistogram( const Image & img,
+                       ImageHistogram & hist );
+
+// Returns the statistics of one channel of a histogram.
+// The count is 0 if the channel doesn't exist, or is empty.
+ChannelStats channelStats( const ImageHistogram & hist,
+                           uint clr );
+
+// Fills stats with the statistics of every channel of an Image.
+// False (stats unchanged) if computeHistogram fails.
+bool channelStats( const Image & img,
+                   std::vector<ChannelStats> & stats );
+
+// Runs the LSB pair chi-square test on the channels of a histogram
+// in channel_mask (bit i for channel i, as in StegoOptions), with
+// the counts of every tested channel pooled.
+LsbChiSquare lsbChiSquare( const ImageHistogram & hist,
+                           uint channel_mask = 0xFF );
+
+#endif // IMAGE_HISTOGRAM_H
@@ -0,0 +1,220 @@
+/* ***************************************************************
+\\ File Name:  ImagePrefetch.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation of read-ahead decoding. Decoder threads
+\\ claim inputs in order, and decode each into its slot in a ring
+// of depth slots; next() empties the slots in the same order. A
+\\ decoder claims another input only while
+//
+\\   - it is within depth inputs of the caller, and
+//   - the bytes held, plus an estimate for each decode in progress
+\\     (the size of the last decoded Image), fit within max_bytes
+//     (until one has been decoded, decodes run one at a time),
+\\
+// except that the input the caller needs next is always claimed,
+\\ so a single oversized image cannot stall the sequence. At most
+// depth decoded Images, plus up to threads spares (none unless
+\\ Image::reusesBuffers()), plus the caller's, are in memory at once.
+//
+\\ ***************************************************************/
+
+#include "ImagePrefetch.h"
+
+
+/* ****************************************************
+\\ Initializes prefetch settings with their defaults.
+//
+\\ ****************************************************/
+PrefetchOptions :: PrefetchOptions(void) :
+threads(2), depth(4), max_bytes(0)
+{
+  return;
+}
+
+
+/* ****************************************************
+\\ Returns options with depth at least 1, and threads
+// between 1 and depth (extra threads would never get
+\\ an input to decode).
+//
+\\ ****************************************************/
+static PrefetchOptions normalized(PrefetchOptions options)
+{
+  if(options.depth == 0) options.depth = 1;
+
+  if(options.threads == 0) options.threads = std::thread::hardware_concurrency();
+  if(options.threads == 0) options.threads = 1;
+  if(options.threads > options.depth) options.threads = options.depth;
+
+  return options;
+}
+
+
+/* ****************************************************
+\\ Starts the decoder threads, which begin decoding the
+// first inputs at once.
+\\
+// @param inputs: The names of the image files, in the
+\\ order they are to be handed out.
+//
+\\ @param options: Thread count, depth and memory cap.
+//
+\\ ****************************************************/
+ImagePrefetcher :: ImagePrefetcher( const std::vector<std::string> & inputs,
+                                    const PrefetchOptions & options ) :
+inputs(inputs), options(normalized(options)),
+slots(this->options.depth), spares(this->options.threads),
+next_decode(0), next_out(0), held_bytes(0), decoding(0), last_bytes(0),
+stopping(false)
+{
+  for(uint t = 0; t < this->options.threads; ++t)
+    workers.push_back(std::thread(&ImagePrefetcher::work, this));
+}
+
+
+/* ****************************************************
+\\ Stops the decoder threads. Decodes in progress are
+// finished (and discarded) first.
+\\
+// ****************************************************/
+ImagePrefetcher :: ~ImagePrefetcher(void)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  changed.notify_all();
+
+  for(size_t t = 0; t < workers.size(); ++t) workers[t].join();
+}
+
+
+/* ****************************************************
+\\ Hands out the next input.
+//
+\\ @param img: Receives the decoded input. Its previous
+// pixels are kept to be decoded into, if unshared.
+\\
+// @return: True if an input was handed out. False once
+\\ every input has been.
+//
+\\ ****************************************************/
+bool ImagePrefetcher :: next(Image & img)
+{
+  // Keep the old pixels for a decoder to reuse, if there's
+  // room (and an input left to use them, and reopenImage
+  // can reuse them at all).
+  if(Image::reusesBuffers() && img.initialized() && remaining()) spares.tryPush(std::move(img));
+
+  std::unique_lock<std::mutex> guard(lock);
+
+  if(next_out >= inputs.size()) return false;
+
+  // Wait for the input to be decoded.
+  Slot & slot = slots[next_out % options.depth];
+  changed.wait(guard, [&slot] { return slot.ready; });
+
+  img = std::move(slot.img);
+  held_bytes -= slot.bytes;
+  slot.ready = false;
+  slot.bytes = 0;
+  ++next_out;
+
+  // The slot, and its bytes, are free for the next input.
+  guard.unlock();
+  changed.notify_all();
+  return true;
+}
+
+
+// Returns the number of inputs not yet handed out.
+size_t ImagePrefetcher :: remaining(void) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return inputs.size() - next_out;
+}
+
+
+// Returns the bytes of decoded pixels waiting to be handed out.
+size_t ImagePrefetcher :: bytesHeld(void) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return held_bytes;
+}
+
+
+/* ****************************************************
+\\ (Private) - Confirms whether a decoder may claim the
+// next input: there is one, it is within depth of the
+\\ caller, and it is expected to fit within max_bytes
+// (or the caller is waiting for it). Expects lock.
+\\
+// ****************************************************/
+bool ImagePrefetcher :: mayDecode(void) const
+{
+  if(next_decode >= inputs.size() || next_decode >= next_out + options.depth)
+    return false;
+
+  if(options.max_bytes == 0 || next_decode == next_out) return true;
+
+  // Until one Image has been decoded, there is nothing to
+  // estimate sizes from; decode one at a time.
+  if(last_bytes == 0) return decoding == 0 && held_bytes == 0;
+
+  return held_bytes + (decoding + 1) * last_bytes <= options.max_bytes;
+}
+
+
+/* ****************************************************
+\\ (Private) - The body of each decoder thread: claims
+// inputs as room allows, and decodes each into its slot,
+\\ until every input is claimed or the prefetcher stops.
+//
+\\ ****************************************************/
+void ImagePrefetcher :: work(void)
+{
+  std::unique_lock<std::mutex> guard(lock);
+
+  while(true)
+  {
+    // Wait for room to decode, or to stop.
+    changed.wait(guard, [this] { return stopping || mayDecode() || next_decode >= inputs.size(); });
+
+    if(stopping || next_decode >= inputs.size()) return;
+
+    const size_t IDX = next_decode++;
+    ++decoding;
+
+    // Decode without the lock, into a spare Image if there is one.
+    guard.unlock();
+
+    Image img;
+    spares.tryPop(img);
+    try { img.reopenImage(inputs[IDX]); }
+    // An OpenCV error (e.g. from a corrupt file) is reported
+    // as an undecodable input, as reopenImage's failures are;
+    // escaping, it would end the program. The slot is filled
+    // either way, so next() never waits on it forever.
+    catch(std::exception &) { img = Image::fromBuffer(nullptr, 0); }
+
+    const size_t BYTES = img.initialized()
+                       ? size_t(img.getWidth()) * img.getHeight() * img.getPixelBytes() : 0;
+
+    guard.lock();
+
+    // Fill the slot. next() can't have passed it, as it waits on it.
+    Slot & slot = slots[IDX % options.depth];
+    slot.img = std::move(img);
+    slot.bytes = BYTES;
+    slot.ready = true;
+
+    held_bytes += BYTES;
+    --decoding;
+    if(BYTES) last_bytes = BYTES;
+
+    changed.notify_all();
+  }
+}
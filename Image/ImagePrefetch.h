@@ -0,0 +1,144 @@
+/* ***************************************************************
+\\ File Name:  ImagePrefetch.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Declarations for reading a sequence of images ahead of
+\\ their use. Background threads decode the next few inputs while
+// the caller processes the current one, so the caller rarely waits
+\\ on the disk. See ImagePrefetch.cpp for more information.
+//
+\\ ***************************************************************/
+
+#ifndef IMAGE_PREFETCH_H
+#define IMAGE_PREFETCH_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Image.h"
+#include "BoundedQueue.h"
+
+
+/* *************************************************
+\\ Settings for ImagePrefetcher.
+//
+\\ *************************************************/
+struct PrefetchOptions
+{
+  // Initialize all fields with their defaults.
+  PrefetchOptions(void);
+
+       // Decoder threads. 0 means one per hardware thread.
+  uint threads,
+       // Maximum number of inputs decoded (or being
+       // decoded) ahead of the caller.
+       depth;
+
+  // Maximum bytes of decoded pixels held ahead of the
+  // caller. 0 means no limit. The input the caller is
+  // waiting for is always decoded, even if it alone
+  // exceeds the limit.
+  size_t max_bytes;
+};
+
+
+/* *************************************************
+\\ Decodes a list of files in the background, and
+// hands them out in order. Decoding runs ahead of
+\\ the caller by at most depth inputs and max_bytes
+// of pixels.
+//
+\\ Images given back to next are kept (up to one per
+// thread) for their buffers, and reopened in place
+\\ for later inputs of the same size and type, while
+// Image::reusesBuffers() is true.
+//
+\\ *************************************************/
+class ImagePrefetcher
+{
+  public:
+
+    // Starts decoding the first inputs.
+    explicit ImagePrefetcher( const std::vector<std::string> & inputs,
+                              const PrefetchOptions & options = PrefetchOptions() );
+
+    // Stops decoding, and waits for the threads to exit.
+    ~ImagePrefetcher(void);
+
+    // Moves the next input into img, waiting for it to be
+    // decoded if need be. img's old pixels are kept for reuse.
+    // If the input could not be opened, img is uninitialized,
+    // and its getStatus() tells why. False once every input
+    // has been handed out.
+    bool next(Image & img);
+
+    // Returns the number of inputs not yet handed out.
+    size_t remaining(void) const;
+
+    // Returns the bytes of decoded pixels waiting to be handed out.
+    size_t bytesHeld(void) const;
+
+  private:
+
+    // A decoded input, waiting to be handed out.
+    struct Slot
+    {
+      Slot(void) : ready(false), bytes(0) { return; }
+
+      // The decoded Image.
+      Image img;
+
+      // True once img has been decoded.
+      bool ready;
+
+      // The size of img's pixels.
+      size_t bytes;
+    };
+
+    // Not copyable; the threads refer to the prefetcher.
+    ImagePrefetcher(const ImagePrefetcher &) = delete;
+    ImagePrefetcher & operator=(const ImagePrefetcher &) = delete;
+
+    // The body of each decoder thread.
+    void work(void);
+
+    // True if a decoder may claim the next input. Expects lock.
+    bool mayDecode(void) const;
+
+    // The files to decode, and the settings.
+    const std::vector<std::string> inputs;
+    const PrefetchOptions options;
+
+    // The inputs ahead of the caller. Input i is in
+    // slots[i % depth].
+    std::vector<Slot> slots;
+
+    // Images given back by the caller, for their buffers.
+    BoundedQueue<Image> spares;
+
+    // The next input to decode, and to hand out.
+    size_t next_decode, next_out;
+
+    // The bytes held in ready slots, the number of
+    // inputs being decoded, and the size of the last
+    // decoded Image (used to estimate theirs).
+    size_t held_bytes, decoding, last_bytes;
+
+    // True once the destructor has been called.
+    bool stopping;
+
+    // Guards every member above except spares. Signaled
+    // when a slot is filled or emptied.
+    mutable std::mutex lock;
+    std::condition_variable changed;
+
+    // The decoder threads.
+    std::vector<std::thread> workers;
+};
+
+#endif // IMAGE_PREFETCH_H
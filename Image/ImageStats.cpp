@@ -0,0 +1,224 @@
+/* ***************************************************************
+\\ File Name:  ImageStats.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation of Image instrumentation. Each thread
+\\ updates its own block of relaxed atomics, so even per-pixel
+// counters cost one uncontended add. Snapshots sum the blocks of
+\\ every thread that has recorded anything, including threads
+// that have since exited.
+\\
+// ***************************************************************/
+
+#include "ImageStats.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+
+// *************************** |
+// Global Constant Definitions |
+// *************************** V
+
+// Stage and counter names, in enum order.
+const static char * STAGE_NAMES[STAT_STAGE_COUNT] = { "open", "decode", "save", "encode", "bulk" };
+const static char * COUNTER_NAMES[STAT_COUNTER_COUNT] = { "bytes_decoded", "bytes_encoded",
+                                                          "pixel_reads", "pixel_writes" };
+
+
+/* ****************************************************
+\\ Returns every thread's block, and the lock guarding
+// the list (not the blocks, which are atomic).
+\\
+// ****************************************************/
+static std::vector<ImageStatsBlock *> & statsBlocks(void)
+{
+  static std::vector<ImageStatsBlock *> blocks;
+  return blocks;
+}
+
+static std::mutex & statsLock(void)
+{
+  static std::mutex lock;
+  return lock;
+}
+
+
+// Zeroes a block.
+static void clearBlock(ImageStatsBlock & block)
+{
+  for(uint s = 0; s < STAT_STAGE_COUNT; ++s)
+  {
+    block.calls[s].store(0, std::memory_order_relaxed);
+    block.total_ns[s].store(0, std::memory_order_relaxed);
+    block.max_ns[s].store(0, std::memory_order_relaxed);
+  }
+
+  for(uint c = 0; c < STAT_COUNTER_COUNT; ++c)
+    block.counters[c].store(0, std::memory_order_relaxed);
+}
+
+
+/* ****************************************************
+\\ Allocates and registers a zeroed block for the
+// calling thread. The first call also arranges the
+\\ exit dump requested by CLIMAGE_STATS_JSON, if any.
+//
+\\ ****************************************************/
+ImageStatsBlock * newImageStatsBlock(void)
+{
+  static std::once_flag env_checked;
+  std::call_once(env_checked, [](void)
+  {
+    const char * PATH = std::getenv("CLIMAGE_STATS_JSON");
+    if(PATH && *PATH) dumpImageStatsAtExit(PATH);
+  });
+
+  ImageStatsBlock * block = new ImageStatsBlock;
+  clearBlock(*block);
+
+  std::lock_guard<std::mutex> guard(statsLock());
+  statsBlocks().push_back(block);
+  return block;
+}
+
+
+/* ****************************************************
+\\ Returns the totals so far, summed over every thread.
+// Stages' max_ns is the longest single call.
+\\
+// ****************************************************/
+ImageStats imageStats(void)
+{
+  ImageStats totals = ImageStats();
+
+  std::lock_guard<std::mutex> guard(statsLock());
+  for(size_t b = 0; b < statsBlocks().size(); ++b)
+  {
+    const ImageStatsBlock & block = *statsBlocks()[b];
+
+    for(uint s = 0; s < STAT_STAGE_COUNT; ++s)
+    {
+      StageStats & stage = totals.stages[s];
+      stage.calls += block.calls[s].load(std::memory_order_relaxed);
+      stage.total_ns += block.total_ns[s].load(std::memory_order_relaxed);
+
+      const uint64_t MAX = block.max_ns[s].load(std::memory_order_relaxed);
+      if(MAX > stage.max_ns) stage.max_ns = MAX;
+    }
+
+    for(uint c = 0; c < STAT_COUNTER_COUNT; ++c)
+      totals.counters[c] += block.counters[c].load(std::memory_order_relaxed);
+  }
+
+  return totals;
+}
+
+
+/* ****************************************************
+\\ Zeroes every stage and counter. Updates made by other
+// threads during the reset may be lost.
+\\
+// ****************************************************/
+void resetImageStats(void)
+{
+  std::lock_guard<std::mutex> guard(statsLock());
+  for(size_t b = 0; b < statsBlocks().size(); ++b) clearBlock(*statsBlocks()[b]);
+}
+
+
+// Returns a stage's name, as used in JSON.
+const char * statName(StatStage stage)
+{
+  return (stage < STAT_STAGE_COUNT) ? STAGE_NAMES[stage] : "";
+}
+
+// Returns a counter's name, as used in JSON.
+const char * statName(StatCounter counter)
+{
+  return (counter < STAT_COUNTER_COUNT) ? COUNTER_NAMES[counter] : "";
+}
+
+
+/* ****************************************************
+\\ Returns the totals so far as a JSON object:
+//
+\\   { "stages": { "open": { "calls": 2, "total_ms": 1.5,
+//                           "max_ms": 1.0 }, .. },
+\\     "counters": { "bytes_decoded": 1024, .. } }
+//
+\\ ****************************************************/
+std::string imageStatsJson(void)
+{
+  const ImageStats TOTALS = imageStats();
+
+  std::string json = "{\"stages\":{";
+  char buf[160];
+
+  for(uint s = 0; s < STAT_STAGE_COUNT; ++s)
+  {
+    const StageStats & STAGE = TOTALS.stages[s];
+    std::snprintf( buf, sizeof(buf), "%s\"%s\":{\"calls\":%llu,\"total_ms\":%.3f,\"max_ms\":%.3f}",
+                   s ? "," : "", STAGE_NAMES[s], static_cast<unsigned long long>(STAGE.calls),
+                   STAGE.total_ns / 1e6, STAGE.max_ns / 1e6 );
+    json += buf;
+  }
+
+  json += "},\"counters\":{";
+
+  for(uint c = 0; c < STAT_COUNTER_COUNT; ++c)
+  {
+    std::snprintf( buf, sizeof(buf), "%s\"%s\":%llu", c ? "," : "", COUNTER_NAMES[c],
+                   static_cast<unsigned long long>(TOTALS.counters[c]) );
+    json += buf;
+  }
+
+  return json + "}}";
+}
+
+
+// Where the exit dump is written. Empty for none.
+static std::string & dumpPath(void)
+{
+  static std::string path;
+  return path;
+}
+
+// Writes the exit dump.
+static void dumpAtExit(void)
+{
+  const std::string JSON = imageStatsJson() + "\n";
+
+  if(dumpPath() == "-") { std::fputs(JSON.c_str(), stderr); return; }
+
+  std::FILE * out = std::fopen(dumpPath().c_str(), "w");
+  if(!out) { std::fprintf(stderr, "Could not write image stats to %s\n", dumpPath().c_str()); return; }
+
+  std::fputs(JSON.c_str(), out);
+  std::fclose(out);
+}
+
+
+/* ****************************************************
+\\ Writes the JSON totals to path when the program
+// exits normally. Calling again changes the path.
+\\
+// @param path: The output file, or "-" for stderr.
+\\
+// ****************************************************/
+void dumpImageStatsAtExit(const std::string & path)
+{
+  // Construct the statics used by the dump before registering
+  // it, so they are destroyed after it runs.
+  std::lock_guard<std::mutex> guard(statsLock());
+  statsBlocks();
+
+  const bool REGISTERED = !dumpPath().empty();
+  dumpPath() = path;
+
+  if(!REGISTERED && !path.empty()) std::atexit(dumpAtExit);
+}
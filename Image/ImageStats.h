@@ -0,0 +1,165 @@
+/* ***************************************************************
+\\ File Name:  ImageStats.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Optional instrumentation for Image: scoped timers for
+\\ each stage (decode, encode, bulk pixel work) and counters for
+// bytes and pixel accesses. Compiled in only with -DIMAGE_STATS;
+\\ otherwise every IMAGE_STAT_ macro expands to nothing.
+// See ImageStats.cpp for more information.
+\\
+// ***************************************************************/
+
+#ifndef IMAGE_STATS_H
+#define IMAGE_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+
+// The timed stages.
+enum StatStage
+{
+  STAT_OPEN,    // openImage / mapImage / fromBuffer, whole call.
+  STAT_DECODE,  // imread / imdecode alone.
+  STAT_SAVE,    // saveImage / encode, whole call.
+  STAT_ENCODE,  // imwrite / imencode alone.
+  STAT_BULK,    // Row, region and whole-image operations.
+  STAT_STAGE_COUNT
+};
+
+// The counters.
+enum StatCounter
+{
+  STAT_BYTES_DECODED,  // Pixel bytes produced by decoding.
+  STAT_BYTES_ENCODED,  // Pixel bytes given to encoders.
+  STAT_PIXEL_READS,    // Per-pixel read calls.
+  STAT_PIXEL_WRITES,   // Per-pixel write calls.
+  STAT_COUNTER_COUNT
+};
+
+
+/* *************************************************
+\\ The totals for one timed stage.
+//
+\\ *************************************************/
+struct StageStats
+{
+  // The number of timed calls, and their
+  // total and longest durations.
+  uint64_t calls, total_ns, max_ns;
+};
+
+
+/* *************************************************
+\\ A snapshot of every stage and counter, summed
+// over all threads.
+\\
+// *************************************************/
+struct ImageStats
+{
+  StageStats stages[STAT_STAGE_COUNT];
+  uint64_t counters[STAT_COUNTER_COUNT];
+};
+
+
+// Returns the totals so far. All zero unless built with IMAGE_STATS.
+ImageStats imageStats(void);
+
+// Zeroes every stage and counter.
+void resetImageStats(void);
+
+// Returns a stage's / counter's name as used in JSON, e.g. "decode".
+const char * statName(StatStage stage);
+const char * statName(StatCounter counter);
+
+// Returns the totals so far as a JSON object.
+std::string imageStatsJson(void);
+
+// Writes the JSON totals to path ("-" for stderr) when the program
+// exits. Also done automatically if CLIMAGE_STATS_JSON names a path.
+void dumpImageStatsAtExit(const std::string & path);
+
+
+/* *************************************************
+\\ One thread's stages and counters. Only the owning
+// thread writes them, so updates never contend;
+\\ imageStats sums every thread's block.
+//
+\\ *************************************************/
+struct ImageStatsBlock
+{
+  std::atomic<uint64_t> calls[STAT_STAGE_COUNT],
+                        total_ns[STAT_STAGE_COUNT],
+                        max_ns[STAT_STAGE_COUNT],
+                        counters[STAT_COUNTER_COUNT];
+};
+
+// Allocates a zeroed block for the calling thread. Blocks are
+// kept (and counted) after their thread exits.
+ImageStatsBlock * newImageStatsBlock(void);
+
+// Returns the calling thread's block.
+inline ImageStatsBlock & imageStatsLocal(void)
+{
+  static thread_local ImageStatsBlock * block = newImageStatsBlock();
+  return *block;
+}
+
+
+/* *************************************************
+\\ Times the enclosing scope as one call of a stage.
+//
+\\ *************************************************/
+class ScopedStatTimer
+{
+  public:
+
+    // Starts timing.
+    explicit ScopedStatTimer(StatStage stage) :
+    stage(stage), start(std::chrono::steady_clock::now()) { return; }
+
+    // Adds the elapsed time to the stage.
+    ~ScopedStatTimer(void)
+    {
+      const uint64_t NS = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - start).count();
+
+      ImageStatsBlock & block = imageStatsLocal();
+      block.calls[stage].fetch_add(1, std::memory_order_relaxed);
+      block.total_ns[stage].fetch_add(NS, std::memory_order_relaxed);
+      if(NS > block.max_ns[stage].load(std::memory_order_relaxed))
+        block.max_ns[stage].store(NS, std::memory_order_relaxed);
+    }
+
+  private:
+
+    ScopedStatTimer(const ScopedStatTimer &) = delete;
+    ScopedStatTimer & operator=(const ScopedStatTimer &) = delete;
+
+    // The stage being timed.
+    const StatStage stage;
+
+    // When the scope was entered.
+    const std::chrono::steady_clock::time_point start;
+};
+
+
+// IMAGE_STAT_TIMER(stage); times the rest of the scope.
+// IMAGE_STAT_ADD(counter, n); adds n to a counter.
+#ifdef IMAGE_STATS
+  #define IMAGE_STAT_CONCAT_(a, b) a##b
+  #define IMAGE_STAT_CONCAT(a, b) IMAGE_STAT_CONCAT_(a, b)
+  #define IMAGE_STAT_TIMER(stage) ScopedStatTimer IMAGE_STAT_CONCAT(stat_timer_, __LINE__)(stage)
+  #define IMAGE_STAT_ADD(counter, n) \
+    imageStatsLocal().counters[counter].fetch_add((n), std::memory_order_relaxed)
+#else
+  #define IMAGE_STAT_TIMER(stage) ((void)0)
+  #define IMAGE_STAT_ADD(counter, n) ((void)0)
+#endif
+
+#endif // IMAGE_STATS_H
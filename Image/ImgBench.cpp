@@ -0,0 +1,689 @@
+/* ***************************************************************
+\\ File Name:  ImgBench.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Microbenchmarks (Google Benchmark) for the Image hot
+\\ paths: per-pixel reads and writes (checked, and unchecked
+// through TypedImage views), intensity, copying, comparison,
+\\ histograms, and file decode/encode per format. Image sizes run
+// from a thumbnail to 8K. Build and run with `make bench`.
+\\
+// Benchmark names end in /size/channels[/format], indexes into
+\\ the tables below. Per-pixel benchmarks report items/s (pixels
+// visited), and file benchmarks bytes/s (of decoded pixels).
+\\
+// ***************************************************************/
+
+#include "Image.h"
+#include "DecodeCache.h"
+#include "ImageDiff.h"
+#include "ImageHistogram.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <utility>
+
+
+// *************************** |
+// Global Constant Definitions |
+// *************************** V
+
+// The benchmarked image sizes: thumbnail, VGA, 1080p, 4K, 8K.
+const static int SIZE_COUNT = 5;
+const static int SIZES[SIZE_COUNT][2] = { {  160,  120 },
+                                          {  640,  480 },
+                                          { 1920, 1080 },
+                                          { 3840, 2160 },
+                                          { 7680, 4320 } };
+
+// The benchmarked file formats, and the channel counts each can
+// store. No supported format holds 2 channels, so neither do the
+// fixtures (they're made by decoding an encoded image).
+const static int FORMAT_COUNT = 4;
+const static char * FORMATS[FORMAT_COUNT] = { "png", "jpg", "pgm", "ppm" };
+const static uint FORMAT_CHANNELS[FORMAT_COUNT] = { (1 << 1) | (1 << 3) | (1 << 4),
+                                                    (1 << 1) | (1 << 3),
+                                                    (1 << 1),
+                                                    (1 << 3) };
+
+// Where fixture files are written.
+const static std::string BENCH_DIR = "/tmp";
+
+
+// ********************* |
+// Fixtures              |
+// ********************* V
+
+/* ****************************************************
+\\ Returns an Image of the given size (index into SIZES)
+// and channel count. Made once per size and count, by
+\\ decoding an uncompressed PNG of a gradient with noise
+// (roughly photographic, so encoders do real work).
+\\
+// ****************************************************/
+static const Image & fixture( int size_idx,
+                              int chans )
+{
+  static std::map<std::pair<int, int>, Image> made;
+
+  const std::pair<int, int> KEY(size_idx, chans);
+  std::map<std::pair<int, int>, Image>::iterator found = made.find(KEY);
+  if(found != made.end()) return found->second;
+
+  const int W = SIZES[size_idx][0],
+            H = SIZES[size_idx][1];
+
+  cv::Mat pixels(H, W, CV_8UC(chans));
+  srand(1);
+  for(int r = 0; r < H; ++r)
+  {
+    uchar * px = pixels.ptr(r);
+    for(int i = 0; i < W * chans; ++i)
+      px[i] = static_cast<uchar>((r * 255 / H + (i / chans) * 255 / W) / 2 + rand() % 16);
+  }
+
+  std::vector<uchar> encoded;
+  std::vector<int> params;
+  params.push_back(CV_IMWRITE_PNG_COMPRESSION);
+  params.push_back(0);
+  cv::imencode(".png", pixels, encoded, params);
+
+  return made.insert(std::make_pair(KEY, Image::fromBuffer(&encoded[0], encoded.size()))).first->second;
+}
+
+
+/* ****************************************************
+\\ Returns the name of the fixture file for a size,
+// channel count and format (index into FORMATS),
+\\ writing it the first time.
+//
+\\ ****************************************************/
+static std::string fixtureFile( int size_idx,
+                                int chans,
+                                int format )
+{
+  const std::string NAME = BENCH_DIR + "/climage_bench_" + std::to_string(size_idx) +
+                           "_" + std::to_string(chans) + "." + FORMATS[format];
+
+  static std::map<std::string, bool> written;
+  if(!written[NAME])
+  {
+    Image out(fixture(size_idx, chans));
+    out.setFilename(NAME);
+    written[NAME] = out.saveImage(EncodeOptions(ENCODE_FAST));
+  }
+
+  return NAME;
+}
+
+
+// Labels a benchmark with its image size and channel count.
+static void label( benchmark::State & state,
+                   const Image & img,
+                   const char * format = nullptr )
+{
+  std::string text = std::to_string(img.getWidth()) + "x" + std::to_string(img.getHeight()) +
+                     " C" + std::to_string(img.getChannels());
+  if(format) text += std::string(" ") + format;
+  state.SetLabel(text);
+}
+
+
+// Registers every size, for each of channel counts 1, 3 and 4.
+static void pixelArgs(benchmark::internal::Benchmark * b)
+{
+  const int CHANS[] = { 1, 3, 4 };
+  for(int s = 0; s < SIZE_COUNT; ++s)
+    for(int c = 0; c < 3; ++c) b->Args({ s, CHANS[c] });
+}
+
+// Registers every size, with the template's channel count.
+template <int C>
+static void sizeArgs(benchmark::internal::Benchmark * b)
+{
+  for(int s = 0; s < SIZE_COUNT; ++s) b->Args({ s, C });
+}
+
+// Registers every size, channel count and format the format can store.
+static void fileArgs(benchmark::internal::Benchmark * b)
+{
+  for(int s = 0; s < SIZE_COUNT; ++s)
+    for(int c = 1; c <= 4; ++c)
+      for(int f = 0; f < FORMAT_COUNT; ++f)
+        if(FORMAT_CHANNELS[f] & (1u << c)) b->Args({ s, c, f });
+}
+
+
+// ********************* |
+// Pixel Reads           |
+// ********************* V
+
+// getArrColors(row, col): one allocation per pixel.
+static void BM_GetArrColors_alloc(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), state.range(1));
+  const uint W = img.getWidth(), H = img.getHeight();
+
+  for(auto _ : state)
+    for(uint r = 0; r < H; ++r)
+      for(uint c = 0; c < W; ++c)
+      {
+        std::unique_ptr<uchar[]> px = img.getArrColors(r, c);
+        benchmark::DoNotOptimize(px.get());
+      }
+
+  state.SetItemsProcessed(state.iterations() * W * H);
+  label(state, img);
+}
+BENCHMARK(BM_GetArrColors_alloc)->Apply(pixelArgs)->Unit(benchmark::kMillisecond);
+
+// getArrColors(row, col, uchar[]): into a caller's array.
+static void BM_GetArrColors(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), state.range(1));
+  const uint W = img.getWidth(), H = img.getHeight();
+  uchar px[4];
+
+  for(auto _ : state)
+    for(uint r = 0; r < H; ++r)
+      for(uint c = 0; c < W; ++c)
+      {
+        img.getArrColors(r, c, px);
+        benchmark::DoNotOptimize(px);
+      }
+
+  state.SetItemsProcessed(state.iterations() * W * H);
+  label(state, img);
+}
+BENCHMARK(BM_GetArrColors)->Apply(pixelArgs)->Unit(benchmark::kMillisecond);
+
+// getArrColors<C>(row, col, cv::Vec): fixed channel count.
+template <int C>
+static void BM_GetArrColors_vec(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), C);
+  const uint W = img.getWidth(), H = img.getHeight();
+  cv::Vec<uchar, C> px;
+
+  for(auto _ : state)
+    for(uint r = 0; r < H; ++r)
+      for(uint c = 0; c < W; ++c)
+      {
+        img.getArrColors(r, c, px);
+        benchmark::DoNotOptimize(px);
+      }
+
+  state.SetItemsProcessed(state.iterations() * W * H);
+  label(state, img);
+}
+BENCHMARK_TEMPLATE(BM_GetArrColors_vec, 1)->Apply(sizeArgs<1>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_GetArrColors_vec, 3)->Apply(sizeArgs<3>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_GetArrColors_vec, 4)->Apply(sizeArgs<4>)->Unit(benchmark::kMillisecond);
+
+// getArrColors_int(row, col): one allocation per pixel.
+static void BM_GetArrColorsInt_alloc(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), state.range(1));
+  const uint W = img.getWidth(), H = img.getHeight();
+
+  for(auto _ : state)
+    for(uint r = 0; r < H; ++r)
+      for(uint c = 0; c < W; ++c)
+      {
+        std::unique_ptr<uint[]> px = img.getArrColors_int(r, c);
+        benchmark::DoNotOptimize(px.get());
+      }
+
+  state.SetItemsProcessed(state.iterations() * W * H);
+  label(state, img);
+}
+BENCHMARK(BM_GetArrColorsInt_alloc)->Apply(pixelArgs)->Unit(benchmark::kMillisecond);
+
+// getArrColors_int(row, col, uint[]): into a caller's array.
+static void BM_GetArrColorsInt(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), state.range(1));
+  const uint W = img.getWidth(), H = img.getHeight();
+  uint px[4];
+
+  for(auto _ : state)
+    for(uint r = 0; r < H; ++r)
+      for(uint c = 0; c < W; ++c)
+      {
+        img.getArrColors_int(r, c, px);
+        benchmark::DoNotOptimize(px);
+      }
+
+  state.SetItemsProcessed(state.iterations() * W * H);
+  label(state, img);
+}
+BENCHMARK(BM_GetArrColorsInt)->Apply(pixelArgs)->Unit(benchmark::kMillisecond);
+
+// getPixelIntensity<C>(row, col).
+template <uint C>
+static void BM_GetPixelIntensity(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), C);
+  const uint W = img.getWidth(), H = img.getHeight();
+
+  for(auto _ : state)
+    for(uint r = 0; r < H; ++r)
+      for(uint c = 0; c < W; ++c)
+        benchmark::DoNotOptimize(img.getPixelIntensity<C>(r, c));
+
+  state.SetItemsProcessed(state.iterations() * W * H);
+  label(state, img);
+}
+BENCHMARK_TEMPLATE(BM_GetPixelIntensity, 1)->Apply(sizeArgs<1>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_GetPixelIntensity, 3)->Apply(sizeArgs<3>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_GetPixelIntensity, 4)->Apply(sizeArgs<4>)->Unit(benchmark::kMillisecond);
+
+
+// TypedImage<C>::at: the channel count checked once, per image.
+template <int C>
+static void BM_TypedRead(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), C);
+  const TypedImage<C, const uchar> VIEW = img.typed<C>();
+  const uint W = VIEW.getWidth(), H = VIEW.getHeight();
+
+  for(auto _ : state)
+    for(uint r = 0; r < H; ++r)
+      for(uint c = 0; c < W; ++c)
+      {
+        cv::Vec<uchar, C> px = VIEW.at(r, c);
+        benchmark::DoNotOptimize(px);
+      }
+
+  state.SetItemsProcessed(state.iterations() * W * H);
+  label(state, img);
+}
+BENCHMARK_TEMPLATE(BM_TypedRead, 1)->Apply(sizeArgs<1>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_TypedRead, 3)->Apply(sizeArgs<3>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_TypedRead, 4)->Apply(sizeArgs<4>)->Unit(benchmark::kMillisecond);
+
+// ********************* |
+// Pixel Writes          |
+// ********************* V
+
+// setPixel<C>(row, col, cv::Vec).
+template <int C>
+static void BM_SetPixel_vec(benchmark::State & state)
+{
+  Image img(fixture(state.range(0), C));
+  const uint W = img.getWidth(), H = img.getHeight();
+  cv::Vec<uchar, C> px;
+
+  for(auto _ : state)
+    for(uint r = 0; r < H; ++r)
+      for(uint c = 0; c < W; ++c)
+      {
+        px[0] = static_cast<uchar>(c);
+        img.setPixel(r, c, px);
+      }
+
+  benchmark::DoNotOptimize(img.row(0).data);
+  state.SetItemsProcessed(state.iterations() * W * H);
+  label(state, img);
+}
+BENCHMARK_TEMPLATE(BM_SetPixel_vec, 1)->Apply(sizeArgs<1>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_SetPixel_vec, 3)->Apply(sizeArgs<3>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_SetPixel_vec, 4)->Apply(sizeArgs<4>)->Unit(benchmark::kMillisecond);
+
+// TypedImage<C>::at, written: no per-pixel checks at all.
+template <int C>
+static void BM_TypedWrite(benchmark::State & state)
+{
+  Image img(fixture(state.range(0), C));
+  const TypedImage<C, uchar> VIEW = img.typed<C>();
+  const uint W = VIEW.getWidth(), H = VIEW.getHeight();
+
+  for(auto _ : state)
+  {
+    for(uint r = 0; r < H; ++r)
+      for(uint c = 0; c < W; ++c) VIEW.at(r, c)[0] = static_cast<uchar>(c);
+
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations() * W * H);
+  label(state, img);
+}
+BENCHMARK_TEMPLATE(BM_TypedWrite, 1)->Apply(sizeArgs<1>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_TypedWrite, 3)->Apply(sizeArgs<3>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_TypedWrite, 4)->Apply(sizeArgs<4>)->Unit(benchmark::kMillisecond);
+
+// transform<C>: the same write as BM_TypedWrite, in parallel row bands.
+template <int C>
+static void BM_Transform(benchmark::State & state)
+{
+  Image img(fixture(state.range(0), C));
+
+  for(auto _ : state)
+  {
+    img.transform<C>([](cv::Vec<uchar, C> px) { px[0] = static_cast<uchar>(255 - px[0]); return px; });
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations() * img.getWidth() * img.getHeight());
+  label(state, img);
+}
+BENCHMARK_TEMPLATE(BM_Transform, 1)->Apply(sizeArgs<1>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Transform, 3)->Apply(sizeArgs<3>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Transform, 4)->Apply(sizeArgs<4>)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// splitChannels then mergeChannels: interleaved to planar and back.
+static void BM_SplitMerge(benchmark::State & state)
+{
+  Image img(fixture(state.range(0), state.range(1)));
+  std::vector<cv::Mat> planes;
+
+  for(auto _ : state)
+  {
+    img.splitChannels(planes);
+    img.mergeChannels(planes);
+  }
+
+  state.SetItemsProcessed(state.iterations() * img.getWidth() * img.getHeight());
+  label(state, img);
+}
+BENCHMARK(BM_SplitMerge)->Apply(pixelArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// getChannel: one channel (the last) copied out as a plane.
+static void BM_GetChannel(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), state.range(1));
+  cv::Mat plane;
+
+  for(auto _ : state)
+  {
+    img.getChannel(img.getChannels() - 1, plane);
+    benchmark::DoNotOptimize(plane.data);
+  }
+
+  state.SetItemsProcessed(state.iterations() * img.getWidth() * img.getHeight());
+  label(state, img);
+}
+BENCHMARK(BM_GetChannel)->Apply(pixelArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Returns a copy of img with its own pixels, so that comparing the
+// two reads both (a plain copy shares them until written).
+static Image privateCopy(const Image & img)
+{
+  Image copy(img);
+  uchar px[4];
+  copy.getArrColors(0, 0, px);
+  copy.setPixel(0, 0, px);
+  return copy;
+}
+
+// imagesEqual on equal Images: the worst case, every row read.
+static void BM_ImagesEqual(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), state.range(1));
+  const Image copy(privateCopy(img));
+
+  for(auto _ : state)
+    benchmark::DoNotOptimize(imagesEqual(img, copy));
+
+  state.SetItemsProcessed(state.iterations() * img.getWidth() * img.getHeight());
+  label(state, img);
+}
+BENCHMARK(BM_ImagesEqual)->Apply(pixelArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// diffImages, with a mask, against a copy with one pixel changed.
+static void BM_DiffImages(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), state.range(1));
+  Image changed(privateCopy(img));
+  const uchar PX[4] = { 0, 0, 0, 0 };
+  changed.setPixel(changed.getHeight() / 2, changed.getWidth() / 2, PX);
+  cv::Mat mask;
+
+  for(auto _ : state)
+    benchmark::DoNotOptimize(diffImages(img, changed, &mask).mismatches);
+
+  state.SetItemsProcessed(state.iterations() * img.getWidth() * img.getHeight());
+  label(state, img);
+}
+BENCHMARK(BM_DiffImages)->Apply(pixelArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// computeHistogram: every channel value counted.
+static void BM_Histogram(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), state.range(1));
+  ImageHistogram hist;
+
+  for(auto _ : state)
+  {
+    computeHistogram(img, hist);
+    benchmark::DoNotOptimize(hist.bins.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * img.getWidth() * img.getHeight());
+  label(state, img);
+}
+BENCHMARK(BM_Histogram)->Apply(pixelArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// getArrColors into per-channel bins: the path computeHistogram replaces.
+static void BM_Histogram_getArrColors(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), state.range(1));
+  const uint W = img.getWidth(), H = img.getHeight(), CHANS = img.getChannels();
+  std::vector<unsigned long long> bins(CHANS * 256);
+  uchar px[4];
+
+  for(auto _ : state)
+  {
+    std::fill(bins.begin(), bins.end(), 0);
+    for(uint r = 0; r < H; ++r)
+      for(uint c = 0; c < W; ++c)
+      {
+        img.getArrColors(r, c, px);
+        for(uint clr = 0; clr < CHANS; ++clr) ++bins[clr * 256 + px[clr]];
+      }
+    benchmark::DoNotOptimize(bins.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * W * H);
+  label(state, img);
+}
+BENCHMARK(BM_Histogram_getArrColors)->Apply(pixelArgs)->Unit(benchmark::kMillisecond);
+
+// setPixel(row, col, const uchar[]).
+static void BM_SetPixel_uchar(benchmark::State & state)
+{
+  Image img(fixture(state.range(0), state.range(1)));
+  const uint W = img.getWidth(), H = img.getHeight();
+  uchar px[4] = { 0, 1, 2, 3 };
+
+  for(auto _ : state)
+    for(uint r = 0; r < H; ++r)
+      for(uint c = 0; c < W; ++c)
+      {
+        px[0] = static_cast<uchar>(c);
+        img.setPixel(r, c, px);
+      }
+
+  benchmark::DoNotOptimize(img.row(0).data);
+  state.SetItemsProcessed(state.iterations() * W * H);
+  label(state, img);
+}
+BENCHMARK(BM_SetPixel_uchar)->Apply(pixelArgs)->Unit(benchmark::kMillisecond);
+
+// setPixel(row, col, const uint[]): range-checked.
+static void BM_SetPixel_uint(benchmark::State & state)
+{
+  Image img(fixture(state.range(0), state.range(1)));
+  const uint W = img.getWidth(), H = img.getHeight();
+  uint px[4] = { 0, 1, 2, 3 };
+
+  for(auto _ : state)
+    for(uint r = 0; r < H; ++r)
+      for(uint c = 0; c < W; ++c)
+      {
+        px[0] = c & 0xFF;
+        img.setPixel(r, c, px);
+      }
+
+  benchmark::DoNotOptimize(img.row(0).data);
+  state.SetItemsProcessed(state.iterations() * W * H);
+  label(state, img);
+}
+BENCHMARK(BM_SetPixel_uint)->Apply(pixelArgs)->Unit(benchmark::kMillisecond);
+
+
+// ********************* |
+// Copying               |
+// ********************* V
+
+// The copy constructor alone: shares the pixels.
+static void BM_CopyConstructor(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), state.range(1));
+
+  for(auto _ : state)
+  {
+    Image copy(img);
+    benchmark::DoNotOptimize(copy);
+  }
+
+  label(state, img);
+}
+BENCHMARK(BM_CopyConstructor)->Apply(pixelArgs);
+
+// A copy, then one write: the write takes a private copy of the pixels.
+static void BM_CopyThenWrite(benchmark::State & state)
+{
+  const Image & img = fixture(state.range(0), state.range(1));
+  const uchar px[4] = { 0, 1, 2, 3 };
+
+  for(auto _ : state)
+  {
+    Image copy(img);
+    copy.setPixel(0, 0, px);
+    benchmark::DoNotOptimize(copy.row(0).data);
+  }
+
+  state.SetBytesProcessed(state.iterations() * img.getWidth() * img.getHeight() * img.getChannels());
+  label(state, img);
+}
+BENCHMARK(BM_CopyThenWrite)->Apply(pixelArgs)->Unit(benchmark::kMicrosecond);
+
+
+// ********************* |
+// File Decode / Encode  |
+// ********************* V
+
+// openImage, per format.
+static void BM_OpenImage(benchmark::State & state)
+{
+  const std::string NAME = fixtureFile(state.range(0), state.range(1), state.range(2));
+
+  for(auto _ : state)
+  {
+    Image img;
+    if(!img.openImage(NAME)) { state.SkipWithError("could not open fixture"); break; }
+    benchmark::DoNotOptimize(img.row(0).data);
+  }
+
+  const Image & img = fixture(state.range(0), state.range(1));
+  state.SetBytesProcessed(state.iterations() * img.getWidth() * img.getHeight() * img.getChannels());
+  label(state, img, FORMATS[state.range(2)]);
+}
+BENCHMARK(BM_OpenImage)->Apply(fileArgs)->Unit(benchmark::kMillisecond);
+
+// reopenImage into one Image, per format: decodes into the same buffer.
+static void BM_ReopenImage(benchmark::State & state)
+{
+  const std::string NAME = fixtureFile(state.range(0), state.range(1), state.range(2));
+  Image img;
+
+  for(auto _ : state)
+  {
+    if(!img.reopenImage(NAME)) { state.SkipWithError("could not open fixture"); break; }
+    benchmark::DoNotOptimize(img.row(0).data);
+  }
+
+  const Image & FIXTURE = fixture(state.range(0), state.range(1));
+  state.SetBytesProcessed(state.iterations() * FIXTURE.getWidth() * FIXTURE.getHeight() * FIXTURE.getChannels());
+  label(state, FIXTURE, FORMATS[state.range(2)]);
+}
+BENCHMARK(BM_ReopenImage)->Apply(fileArgs)->Unit(benchmark::kMillisecond);
+
+// Lazy openImage, per format: reads the header for the dimensions,
+// without decoding (compare BM_OpenImage).
+static void BM_OpenHeader(benchmark::State & state)
+{
+  const std::string NAME = fixtureFile(state.range(0), state.range(1), state.range(2));
+
+  for(auto _ : state)
+  {
+    Image img;
+    if(!img.openImage(NAME, true)) { state.SkipWithError("could not open fixture"); break; }
+    benchmark::DoNotOptimize(img.getWidth() * img.getHeight() * img.getChannels());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  label(state, fixture(state.range(0), state.range(1)), FORMATS[state.range(2)]);
+}
+BENCHMARK(BM_OpenHeader)->Apply(fileArgs)->Unit(benchmark::kMicrosecond);
+
+// openImage with the decode cache on, per format: after the first
+// iteration, each open is a lookup and a pointer copy.
+static void BM_OpenImage_cached(benchmark::State & state)
+{
+  const std::string NAME = fixtureFile(state.range(0), state.range(1), state.range(2));
+  DecodeCache::shared().setBudget(size_t(1) << 30);
+
+  for(auto _ : state)
+  {
+    Image img;
+    if(!img.openImage(NAME)) { state.SkipWithError("could not open fixture"); break; }
+    benchmark::DoNotOptimize(img.getWidth());
+  }
+
+  DecodeCache::shared().setBudget(0);
+
+  const Image & img = fixture(state.range(0), state.range(1));
+  state.SetBytesProcessed(state.iterations() * img.getWidth() * img.getHeight() * img.getChannels());
+  label(state, img, FORMATS[state.range(2)]);
+}
+BENCHMARK(BM_OpenImage_cached)->Apply(fileArgs)->Unit(benchmark::kMicrosecond);
+
+// saveImage, per format, with the default (smallest) encoder settings.
+static void BM_SaveImage(benchmark::State & state)
+{
+  Image img(fixture(state.range(0), state.range(1)));
+  img.setFilename(BENCH_DIR + "/climage_bench_out." + FORMATS[state.range(2)]);
+
+  for(auto _ : state)
+    if(!img.saveImage()) { state.SkipWithError("could not save"); break; }
+
+  state.SetBytesProcessed(state.iterations() * img.getWidth() * img.getHeight() * img.getChannels());
+  label(state, img, FORMATS[state.range(2)]);
+}
+BENCHMARK(BM_SaveImage)->Apply(fileArgs)->Unit(benchmark::kMillisecond);
+
+// hasValidExtension, over a mix of valid, upper case and invalid names.
+static void BM_HasValidExtension(benchmark::State & state)
+{
+  const static std::string NAMES[] = { "scans/page_0001.png", "DCIM/IMG_0042.JPG", "photo.final.jpeg",
+                                       "frames.v2/frame", "notes.txt", "out/mask.pgm" };
+  const size_t COUNT = sizeof(NAMES) / sizeof(NAMES[0]);
+  const Image img;
+
+  for(auto _ : state)
+    for(size_t n = 0; n < COUNT; ++n) benchmark::DoNotOptimize(img.hasValidExtension(NAMES[n]));
+
+  state.SetItemsProcessed(state.iterations() * COUNT);
+}
+BENCHMARK(BM_HasValidExtension);
+
+
+BENCHMARK_MAIN();
@@ -10,7 +10,11 @@
 \\ ***************************************************************/
 
 #include "Image.h"
+#include "ImageBatch.h"
 #include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
 
 using namespace std;
 using namespace cv;
@@ -22,9 +26,37 @@ const string DEFAULT_IMG_FILENAME = "mario.png";
 // Allocate, initialize a new Image.
 Img * setupImage(int argc, char * argv[]);
 
+// Copies many images at once. See the usage below.
+int runBatch(int argc, char * argv[], bool preview);
+
+// Reopens an Image from a truncated copy of its file. True if that fails.
+bool truncatedReopenFails(const string & filename);
+
+// Batch copies a BMP version of a file. True if the copy is saved as a PNG.
+bool batchCopiesBmp(const string & filename);
+
 // Takes the name of an image file for testing. Uses mario.png as default.
+//   Or: --batch [-j threads] [-o output_dir] [-p] files/patterns..
+// Either may be preceded by --headless (never open a window) or
+// --preview (show the image without waiting for a key press).
 int main(int argc, char * argv[])
 {
+  // True if the image should be shown without waiting.
+  bool preview = false;
+
+  // Handle display options, removing them from the arguments.
+  for(; argc > 1; --argc, ++argv)
+  {
+    if(string(argv[1]) == "--headless") Image::setHeadless(true);
+    else if(string(argv[1]) == "--preview") preview = true;
+    else break;
+
+    argv[1] = argv[0];
+  }
+
+  // If batch mode was requested, run it instead of the demo.
+  if(argc > 1 && string(argv[1]) == "--batch") return runBatch(argc, argv, preview);
+
   // ---------------------------------------------------------
   // Setup a new image.
 
@@ -48,14 +80,20 @@ int main(int argc, char * argv[])
   // ---------------------------------------------------------
   // Test #1 - Display the image.
 
-  cout << "\n  Displaying image in a new window.." << endl;
-  // Try to display the new image. Store return value.
-  if(!test_img->displayImage())
+  // If there is no display, skip this test.
+  if(Image::isHeadless()) cout << "\n  Headless; not displaying the image." << endl;
+  else
   {
-    // Display failure alert.
-    cout << "\n  The image could not be displayed! Exiting program.." << endl;
-    // Exit with error code 2.
-    return 2;
+    cout << "\n  Displaying image in a new window.." << endl;
+    // Try to display the new image (waiting for a key
+    // press, unless previewing). Store return value.
+    if(!(preview ? test_img->previewImage() : test_img->displayImage()))
+    {
+      // Display failure alert.
+      cout << "\n  The image could not be displayed! Exiting program.." << endl;
+      // Exit with error code 2.
+      return 2;
+    }
   }
 
   // ---------------------------------------------------------
@@ -95,12 +133,153 @@ int main(int argc, char * argv[])
     std::cout << "\n    SUCCESSFULLY SAVED IMAGE WITH FILENAME : " << copy_img.getFilename() << std::endl;
   else std::cout << "\n    FAILED TO SAVE IMAGE!" << std::endl;
 
+  // ---------------------------------------------------------
+  // Test #4 - Reopen a truncated file.
+
+  cout << "\n  Reopening the image from a truncated copy.." << endl;
+
+  // A failed decode must not leave the old pixels in place.
+  if(!truncatedReopenFails(test_img->getFilename()))
+  {
+    cout << "\n    A truncated file was reopened successfully!" << endl;
+    delete test_img;
+    // Exit with error code 4.
+    return 4;
+  }
+
+  cout << "\n    The truncated file was rejected." << endl;
+
+  // ---------------------------------------------------------
+  // Test #5 - Batch copy an image Image can't save as-is.
+
+  cout << "\n  Batch copying a BMP version of the image.." << endl;
+
+  if(!batchCopiesBmp(test_img->getFilename()))
+  {
+    cout << "\n    The BMP could not be copied!" << endl;
+    delete test_img;
+    // Exit with error code 5.
+    return 5;
+  }
+
+  cout << "\n    The BMP was copied as a PNG." << endl;
+
   delete test_img;
 
   return 0;
 }
 
 
+/* *************************************************
+\\ Opens filename, then reopens the same Image from
+// a copy of the file cut off after its first 24 bytes
+\\ (for a PNG, just after the size in its header), so
+// the buffer it holds would fit the image.
+\\
+// *************************************************/
+bool truncatedReopenFails(const string & filename)
+{
+  // The name of the truncated copy.
+  const string TRUNCATED = "truncated_" + filename.substr(filename.find_last_of("/\\") + 1);
+
+  // Copy the start of the file.
+  {
+    char head[24];
+    ifstream in(filename.c_str(), ios::binary);
+    in.read(head, sizeof(head));
+
+    ofstream out(TRUNCATED.c_str(), ios::binary);
+    out.write(head, in.gcount());
+  }
+
+  // Open the whole file, then reopen the truncated copy into it.
+  Image img(filename);
+  const bool REOPENED = img.reopenImage(TRUNCATED);
+  const bool FAILED = !REOPENED && !img.initialized();
+
+  std::remove(TRUNCATED.c_str());
+  return FAILED;
+}
+
+
+/* *************************************************
+\\ Writes filename as a BMP (a format Image decodes,
+// but doesn't save), and copies it with processBatch,
+\\ with no output directory. The copy should be saved
+// beside it, as a PNG named for its stem.
+\\
+// *************************************************/
+bool batchCopiesBmp(const string & filename)
+{
+  // The BMP, and the name its copy should get.
+  const string BMP = "batch_check.bmp",
+               EXPECTED = "batch_check_1.png";
+
+  if(!imwrite(BMP, imread(filename, IMREAD_UNCHANGED))) return false;
+
+  const vector<BatchResult> RESULTS = processBatch(vector<string>(1, BMP), ImageTransform());
+  const bool COPIED = RESULTS.size() == 1 && RESULTS[0].ok && RESULTS[0].output == EXPECTED;
+
+  std::remove(BMP.c_str());
+  std::remove(EXPECTED.c_str());
+  return COPIED;
+}
+
+
+/* *************************************************
+\\ Saves a copy of every input (as in test #3),
+// using a pool of threads, and prints the result
+\\ for each file. Returns 0 if every file succeeded.
+// Outputs are previewed if preview (or -p) is given.
+\\
+// *************************************************/
+int runBatch(int argc, char * argv[], bool preview)
+{
+  // Batch settings, and the input patterns.
+  BatchOptions options;
+  options.preview = preview;
+  vector<string> patterns;
+
+  // Parse the arguments following --batch.
+  for(int arg = 2; arg < argc; ++arg)
+  {
+    if(string(argv[arg]) == "-j" && arg + 1 < argc) options.threads = atoi(argv[++arg]);
+    else if(string(argv[arg]) == "-o" && arg + 1 < argc) options.output_dir = argv[++arg];
+    else if(string(argv[arg]) == "-p") options.preview = true;
+    else patterns.push_back(argv[arg]);
+  }
+
+  // If no inputs were given, display usage.
+  if(patterns.empty())
+  {
+    cout << "\n  Usage: " << argv[0] << " --batch [-j threads] [-o output_dir] [-p] files.." << endl << endl;
+    return 1;
+  }
+
+  // Copy every input, without any transform.
+  vector<BatchResult> results = processBatch(expandInputs(patterns), ImageTransform(), options);
+
+  // The number of files that failed.
+  size_t failures = 0;
+
+  // Display the result for each file.
+  for(size_t idx = 0; idx < results.size(); ++idx)
+  {
+    const BatchResult & res = results[idx];
+
+    if(res.ok) cout << "\n  OK    " << res.input << " -> " << res.output;
+    else     { cout << "\n  FAIL  " << res.input << " (" << res.error << ")"; ++failures; }
+
+    cout << "  [" << res.seconds * 1000.0 << " ms]";
+  }
+
+  cout << "\n\n  " << (results.size() - failures) << "/" << results.size()
+       << " files processed.\n" << endl;
+
+  return failures ? 3 : 0;
+}
+
+
 /* *************************************************
 \\
 //
@@ -0,0 +1,157 @@
+/* ***************************************************************
+\\ File Name:  MappedPxm.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation for memory-mapped PGM/PPM loading. The
+\\ file header is parsed in place, then the pixel payload is handed
+// to a cv::Mat header without copying. Read-only maps are private,
+\\ so pixel writes make private copies of the touched pages; this
+// lets the usual Image modification functions work on them.
+\\ Writable maps are shared, so writes land in the file.
+//
+\\ Only 8-bit (maxval < 256) P5 and P6 files are mapped. P4 (1-bit)
+// and 16-bit (big-endian) payloads need conversion, and are left to
+\\ cv::imread. As in the file, mapped PPM pixels are in RGB order,
+// whereas cv::imread returns BGR.
+\\
+// ***************************************************************/
+
+#include "MappedPxm.h"
+
+// For the PNM header fields.
+#include "ImageHeader.h"
+
+#include <cctype>
+
+#if defined(__unix__) || defined(__APPLE__)
+  #define MAPPED_PXM_POSIX 1
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+
+// ****************************** |
+// PxmMapping Implementation      |
+// ****************************** V
+
+/* ****************************************************
+\\ Deletes the cv::Mat header and unmaps the file.
+//
+\\ @param mat: The cv::Mat that wrapped the mapping.
+//
+\\ ****************************************************/
+void PxmMapping :: operator()(cv::Mat * mat) const
+{
+  // Delete the header first; it points into the mapping.
+  delete mat;
+
+#ifdef MAPPED_PXM_POSIX
+  // Unmap the file.
+  if(addr) munmap(addr, length);
+#endif
+}
+
+
+/* ****************************************************
+\\ Writes the modified pages of a writable mapping back
+// to the file. Blocks until the write completes.
+\\
+// @return: True if the mapping is writable and synced.
+\\
+// ****************************************************/
+bool PxmMapping :: sync(void) const
+{
+#ifdef MAPPED_PXM_POSIX
+  return writable && addr && msync(addr, length, MS_SYNC) == 0;
+#else
+  return false;
+#endif
+}
+
+
+// ********************* |
+// Mapping               |
+// ********************* V
+
+/* ****************************************************
+\\ Maps a binary 8-bit PGM (P5) or PPM (P6) file, and
+// wraps its payload in a cv::Mat.
+\\
+// @param path: The name of the file to be mapped.
+\\
+// @param writable: If true, the file is opened for
+\\ writing and mapped shared, so pixel writes modify the
+// file. Otherwise the mapping is private.
+\\
+// @return: A cv::Mat whose deleter is a PxmMapping, or
+\\ null if the file is not a mappable PGM/PPM.
+//
+\\ ****************************************************/
+std::shared_ptr<cv::Mat> mapPxm( const std::string & path,
+                                 bool writable )
+{
+#ifdef MAPPED_PXM_POSIX
+  // Open the file.
+  const int FD = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+  if(FD < 0) return std::shared_ptr<cv::Mat>();
+
+  // Get the file size.
+  struct stat st;
+  if(fstat(FD, &st) != 0 || st.st_size < 8) { close(FD); return std::shared_ptr<cv::Mat>(); }
+
+  const size_t LEN = static_cast<size_t>(st.st_size);
+
+  // Map the whole file. The mapping stays valid after the
+  // descriptor is closed. A private mapping may still be
+  // written; the written pages are copied, not stored.
+  void * addr = mmap( nullptr, LEN, PROT_READ | PROT_WRITE,
+                      writable ? MAP_SHARED : MAP_PRIVATE, FD, 0 );
+  close(FD);
+
+  if(addr == MAP_FAILED) return std::shared_ptr<cv::Mat>();
+
+  // Owns the mapping until it's handed to the cv::Mat.
+  PxmMapping mapping(addr, LEN, writable, path);
+
+  // The file, as bytes.
+  const uchar * hdr = static_cast<const uchar *>(addr);
+
+  // The number of channels from the magic number: P5 (gray) or P6 (RGB).
+  const int CHANS = (hdr[0] != 'P') ? 0 : (hdr[1] == '5') ? 1 : (hdr[1] == '6') ? 3 : 0;
+
+  // Parse width, height and maxval.
+  size_t pos = 2;
+  const size_t WIDTH  = CHANS ? parsePnmField(hdr, LEN, pos) : 0,
+               HEIGHT = WIDTH ? parsePnmField(hdr, LEN, pos) : 0,
+               MAXVAL = HEIGHT ? parsePnmField(hdr, LEN, pos) : 0;
+
+  // Exactly one whitespace character separates
+  // maxval from the payload.
+  const bool HEADER_OK = MAXVAL > 0 && MAXVAL < 256 && pos < LEN && isspace(hdr[pos]);
+  ++pos;
+
+  // If the header is invalid, the depth isn't 8-bit,
+  // or the payload is truncated, unmap and report failure.
+  if(!HEADER_OK || (LEN - pos) / (WIDTH * CHANS) < HEIGHT)
+  {
+    mapping(nullptr);
+    return std::shared_ptr<cv::Mat>();
+  }
+
+  // Wrap the payload without copying. The PxmMapping
+  // unmaps the file when the last owner is done.
+  return std::shared_ptr<cv::Mat>( new cv::Mat( static_cast<int>(HEIGHT),
+                                                static_cast<int>(WIDTH),
+                                                CV_8UC(CHANS),
+                                                static_cast<uchar *>(addr) + pos ),
+                                   mapping );
+#else
+  // Memory mapping is not supported on this platform.
+  (void)path; (void)writable;
+  return std::shared_ptr<cv::Mat>();
+#endif
+}
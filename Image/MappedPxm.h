@@ -0,0 +1,64 @@
+/* ***************************************************************
+\\ File Name:  MappedPxm.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Declarations for memory-mapped, zero-copy loading of
+\\ binary PGM (P5) and PPM (P6) files. The payload of these files
+// is raw pixels, so the mapped file can back a cv::Mat directly.
+\\ See MappedPxm.cpp for more information.
+//
+\\ ***************************************************************/
+
+#ifndef MAPPED_PXM_H
+#define MAPPED_PXM_H
+
+#include <memory>
+#include <string>
+
+#include "opencv2/core/core.hpp"
+
+
+/* *************************************************
+\\ Owns a file mapping. Used as the deleter of the
+// std::shared_ptr<cv::Mat> that wraps the mapped
+\\ pixels, so the mapping lives exactly as long as
+// the last Image sharing it. std::get_deleter can
+\\ then tell whether an Image's pixels are mapped.
+//
+\\ *************************************************/
+struct PxmMapping
+{
+  // Initialize all fields with the mapping's info.
+  PxmMapping(void * a, size_t l, bool w, const std::string & p) :
+  addr(a), length(l), writable(w), path(p) { return; }
+
+  // Unmaps the file and deletes the cv::Mat header.
+  void operator()(cv::Mat * mat) const;
+
+  // Writes modified pages of a writable mapping back
+  // to the file. True if successful.
+  bool sync(void) const;
+
+  // Start of the mapping (the start of the file).
+  void * addr;
+
+  // The length of the mapping in bytes.
+  size_t length;
+
+  // True if writes to the pixels go to the file.
+  bool writable;
+
+  // The name of the mapped file.
+  std::string path;
+};
+
+
+// Maps a binary 8-bit PGM or PPM file, and returns a cv::Mat
+// whose data is the file's payload. Null if the file cannot be
+// mapped. If writable, pixel writes go straight to the file.
+std::shared_ptr<cv::Mat> mapPxm( const std::string & path,
+                                 bool writable );
+
+#endif // MAPPED_PXM_H
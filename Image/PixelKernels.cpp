@@ -0,0 +1,1202 @@
+/* ***************************************************************
+\\ File Name:  PixelKernels.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation of the Image row kernels. Every kernel
+\\ has a portable scalar version. On x86, SSE2/SSSE3/AVX2 versions
+// are compiled with target attributes and chosen at runtime, so
+\\ one binary runs everywhere. On ARM, NEON is used when the
+// compiler targets it.
+\\
+// ***************************************************************/
+
+#include "PixelKernels.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define PIXEL_KERNELS_X86 1
+  #include <immintrin.h>
+  #define PK_TARGET(isa) __attribute__((target(isa)))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #define PIXEL_KERNELS_NEON 1
+  #include <arm_neon.h>
+#endif
+
+
+// *************************** |
+// Global Constant Definitions |
+// *************************** V
+
+// Rec. 601 luma weights in 8-bit fixed point. They sum
+// to 256, so (w.B + w.G + w.R + 128) >> 8 never exceeds 255.
+const static uint LUMA_B = 29,
+                  LUMA_G = 150,
+                  LUMA_R = 77;
+
+// The luma weights of a pixel's first and third channels:
+// blue and red, or red and blue in LUMA_RGB_INTENSITY.
+static inline uint lumaFirst(IntensityMode mode) { return mode == LUMA_RGB_INTENSITY ? LUMA_R : LUMA_B; }
+static inline uint lumaThird(IntensityMode mode) { return mode == LUMA_RGB_INTENSITY ? LUMA_B : LUMA_R; }
+
+// Multiplying by this and keeping the high 16 bits divides
+// by 3 exactly, for every sum of three channels (< 2^15).
+const static uint DIV3_MUL = 21846;
+
+// Diff kernels sum squared differences in 32-bit lanes, each
+// gaining at most 4 * 255^2 per 16-byte block. Folding the lanes
+// into 64 bits after this many blocks keeps them from overflowing.
+const static uint SSE_FOLD_BLOCKS = 1 << 14;
+
+
+// ***************** |
+// Scalar Kernels    |
+// ***************** V
+
+/* ****************************************************
+\\ Portable intensity kernel. Used for channel counts
+// without a SIMD kernel, and for the tail of a row.
+\\
+// ****************************************************/
+static void intensityRow_scalar( const uchar * src,
+                                 uchar * dst,
+                                 uint width,
+                                 uint chans,
+                                 IntensityMode mode )
+{
+  // For each pixel in the row..
+  for(uint px = 0; px < width; ++px, src += chans)
+  {
+    // Luma of a BGR(A) (or RGB(A)) pixel.
+    if(mode != MEAN_INTENSITY && chans >= 3)
+      dst[px] = static_cast<uchar>((lumaFirst(mode) * src[0] + LUMA_G * src[1] + lumaThird(mode) * src[2] + 128) >> 8);
+    // The luma of a gray pixel is the gray value.
+    else if(mode != MEAN_INTENSITY)
+      dst[px] = src[0];
+    // Rounded mean of every channel.
+    else
+    {
+      uint sum = 0;
+      for(uint clr = 0; clr < chans; ++clr) sum += src[clr];
+      dst[px] = static_cast<uchar>((sum + chans / 2) / chans);
+    }
+  }
+}
+
+
+/* ****************************************************
+\\ Portable split kernel: copies each channel of pixels
+// first to width - 1 into its own plane. Planes whose
+\\ pointer is null are skipped.
+//
+\\ ****************************************************/
+static void splitRow_scalar( const uchar * src,
+                             uchar * const dst[],
+                             uint first,
+                             uint width,
+                             uint chans )
+{
+  for(uint clr = 0; clr < chans; ++clr)
+  {
+    uchar * plane = dst[clr];
+    if(!plane) continue;
+
+    const uchar * in = src + first * chans + clr;
+    for(uint px = first; px < width; ++px, in += chans) plane[px] = *in;
+  }
+}
+
+
+/* ****************************************************
+\\ Portable merge kernel: the inverse of splitRow_scalar.
+// Channels whose plane pointer is null are left as
+\\ they are.
+//
+\\ ****************************************************/
+static void mergeRow_scalar( const uchar * const src[],
+                             uchar * dst,
+                             uint first,
+                             uint width,
+                             uint chans )
+{
+  for(uint clr = 0; clr < chans; ++clr)
+  {
+    const uchar * plane = src[clr];
+    if(!plane) continue;
+
+    uchar * out = dst + first * chans + clr;
+    for(uint px = first; px < width; ++px, out += chans) *out = plane[px];
+  }
+}
+
+
+/* ****************************************************
+\\ Portable byte-wise diff kernel: adds the absolute
+// differences of values from to to - 1 into diff's
+\\ max_error and squared_error.
+//
+\\ ****************************************************/
+static void diffBytes_scalar( const uchar * a,
+                              const uchar * b,
+                              size_t from,
+                              size_t to,
+                              RowDiff & diff )
+{
+  for(size_t i = from; i < to; ++i)
+  {
+    const uint D = (a[i] > b[i]) ? a[i] - b[i] : b[i] - a[i];
+    if(D > diff.max_error) diff.max_error = D;
+    diff.squared_error += D * D;
+  }
+}
+
+
+/* ****************************************************
+\\ Portable pixel-wise diff kernel: counts the pixels
+// from first to width - 1 that differ, notes the first
+\\ and last of them, and writes their largest channel
+// difference to mask (if not null).
+\\
+// ****************************************************/
+static void diffPixels_scalar( const uchar * a,
+                               const uchar * b,
+                               uchar * mask,
+                               uint first,
+                               uint width,
+                               uint chans,
+                               RowDiff & diff )
+{
+  a += size_t(first) * chans;
+  b += size_t(first) * chans;
+
+  for(uint px = first; px < width; ++px, a += chans, b += chans)
+  {
+    // The largest difference of any of the pixel's channels.
+    uint worst = 0;
+    for(uint clr = 0; clr < chans; ++clr)
+    {
+      const uint D = (a[clr] > b[clr]) ? a[clr] - b[clr] : b[clr] - a[clr];
+      if(D > worst) worst = D;
+    }
+
+    if(!worst) continue;
+
+    ++diff.mismatches;
+    if(px < diff.first) diff.first = px;
+    diff.last = px;
+    if(mask) mask[px] = static_cast<uchar>(worst);
+  }
+}
+
+
+#ifdef PIXEL_KERNELS_X86
+
+// *************** |
+// x86 Kernels     |
+// *************** V
+
+/* ****************************************************
+\\ The CPU features that the x86 kernels depend on.
+// Detected once, on first use.
+\\
+// ****************************************************/
+struct CpuFeatures
+{
+  CpuFeatures(void) :
+  sse2(__builtin_cpu_supports("sse2")),
+  ssse3(__builtin_cpu_supports("ssse3")),
+  avx2(__builtin_cpu_supports("avx2")) { return; }
+
+  const bool sse2, ssse3, avx2;
+};
+
+// Returns the features of the running CPU.
+static const CpuFeatures & cpuFeatures(void)
+{ static const CpuFeatures FEATURES; return FEATURES; }
+
+
+/* ****************************************************
+\\ Reduces 8 pixels, given as 16-bit B, G, R and A
+// lanes, to 8 16-bit intensities. a is ignored for
+\\ three channel pixels.
+//
+\\ ****************************************************/
+PK_TARGET("sse2")
+static inline __m128i intensity_epi16( __m128i b,
+                                       __m128i g,
+                                       __m128i r,
+                                       __m128i a,
+                                       uint chans,
+                                       IntensityMode mode )
+{
+  // (29 B + 150 G + 77 R + 128) >> 8. The sum fits in an
+  // unsigned 16-bit lane, so a logical shift is exact.
+  // (b and r swap weights for RGB pixels.)
+  if(mode != MEAN_INTENSITY)
+  {
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(lumaFirst(mode))),
+                                _mm_mullo_epi16(g, _mm_set1_epi16(LUMA_G)));
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(r, _mm_set1_epi16(lumaThird(mode))));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+  }
+
+  // Sum of the color channels.
+  __m128i sum = _mm_add_epi16(_mm_add_epi16(b, g), r);
+
+  // (B + G + R + A + 2) / 4.
+  if(chans == 4)
+    return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(sum, a), _mm_set1_epi16(2)), 2);
+
+  // (B + G + R + 1) / 3.
+  return _mm_mulhi_epu16(_mm_add_epi16(sum, _mm_set1_epi16(1)), _mm_set1_epi16(DIV3_MUL));
+}
+
+
+/* ****************************************************
+\\ SSE2 kernel for 4 channel pixels. Each 32-bit lane
+// holds one BGRA pixel, so channels are split with
+\\ shifts and masks. 16 pixels per iteration.
+//
+\\ @return: The number of pixels processed.
+//
+\\ ****************************************************/
+PK_TARGET("sse2")
+static uint intensityRow_c4_sse2( const uchar * src,
+                                  uchar * dst,
+                                  uint width,
+                                  IntensityMode mode )
+{
+  const __m128i MASK = _mm_set1_epi32(0xFF);
+  uint px = 0;
+
+  for(; px + 16 <= width; px += 16, src += 64)
+  {
+    // Load 16 BGRA pixels.
+    const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)),
+                  v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16)),
+                  v2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32)),
+                  v3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48));
+
+    // Split the channels of pixels 0-7 (lo) and 8-15 (hi) into 16-bit lanes.
+    #define PK_CHANNEL(v, shift) _mm_and_si128(_mm_srli_epi32(v, shift), MASK)
+    const __m128i lo = intensity_epi16( _mm_packs_epi32(PK_CHANNEL(v0, 0),  PK_CHANNEL(v1, 0)),
+                                        _mm_packs_epi32(PK_CHANNEL(v0, 8),  PK_CHANNEL(v1, 8)),
+                                        _mm_packs_epi32(PK_CHANNEL(v0, 16), PK_CHANNEL(v1, 16)),
+                                        _mm_packs_epi32(PK_CHANNEL(v0, 24), PK_CHANNEL(v1, 24)),
+                                        4, mode );
+    const __m128i hi = intensity_epi16( _mm_packs_epi32(PK_CHANNEL(v2, 0),  PK_CHANNEL(v3, 0)),
+                                        _mm_packs_epi32(PK_CHANNEL(v2, 8),  PK_CHANNEL(v3, 8)),
+                                        _mm_packs_epi32(PK_CHANNEL(v2, 16), PK_CHANNEL(v3, 16)),
+                                        _mm_packs_epi32(PK_CHANNEL(v2, 24), PK_CHANNEL(v3, 24)),
+                                        4, mode );
+    #undef PK_CHANNEL
+
+    // Narrow back to bytes and store.
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + px), _mm_packus_epi16(lo, hi));
+  }
+
+  return px;
+}
+
+
+/* ****************************************************
+\\ Splits 16 BGR pixels (48 bytes) at src into one
+// register per channel, with byte shuffles.
+\\
+// ****************************************************/
+PK_TARGET("ssse3")
+static inline void splitBGR_ssse3( const uchar * src,
+                                   __m128i & b,
+                                   __m128i & g,
+                                   __m128i & r )
+{
+  // Shuffle masks gathering one channel from each of the three
+  // 16-byte loads. -1 zeroes the byte, so the three parts can be or'd.
+  const __m128i B0 = _mm_setr_epi8( 0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+                B1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1),
+                B2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13),
+                G0 = _mm_setr_epi8( 1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+                G1 = _mm_setr_epi8(-1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1),
+                G2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14),
+                R0 = _mm_setr_epi8( 2,  5,  8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+                R1 = _mm_setr_epi8(-1, -1, -1, -1, -1,  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1),
+                R2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15);
+
+  // Load 16 BGR pixels.
+  const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)),
+                v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16)),
+                v2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+
+  // Gather each channel into its own register.
+  b = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, B0), _mm_shuffle_epi8(v1, B1)), _mm_shuffle_epi8(v2, B2));
+  g = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, G0), _mm_shuffle_epi8(v1, G1)), _mm_shuffle_epi8(v2, G2));
+  r = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, R0), _mm_shuffle_epi8(v1, R1)), _mm_shuffle_epi8(v2, R2));
+}
+
+
+/* ****************************************************
+\\ SSSE3 kernel for 3 channel pixels. 16 BGR pixels
+// (48 bytes) are split into B, G and R planes with
+\\ byte shuffles, then reduced as 16-bit lanes.
+//
+\\ @return: The number of pixels processed.
+//
+\\ ****************************************************/
+PK_TARGET("ssse3")
+static uint intensityRow_c3_ssse3( const uchar * src,
+                                   uchar * dst,
+                                   uint width,
+                                   IntensityMode mode )
+{
+  const __m128i ZERO = _mm_setzero_si128();
+  uint px = 0;
+
+  for(; px + 16 <= width; px += 16, src += 48)
+  {
+    // Split 16 BGR pixels into channel registers.
+    __m128i b, g, r;
+    splitBGR_ssse3(src, b, g, r);
+
+    // Reduce pixels 0-7 (lo) and 8-15 (hi) as 16-bit lanes.
+    const __m128i lo = intensity_epi16( _mm_unpacklo_epi8(b, ZERO), _mm_unpacklo_epi8(g, ZERO),
+                                        _mm_unpacklo_epi8(r, ZERO), ZERO, 3, mode ),
+                  hi = intensity_epi16( _mm_unpackhi_epi8(b, ZERO), _mm_unpackhi_epi8(g, ZERO),
+                                        _mm_unpackhi_epi8(r, ZERO), ZERO, 3, mode );
+
+    // Narrow back to bytes and store.
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + px), _mm_packus_epi16(lo, hi));
+  }
+
+  return px;
+}
+
+
+/* ****************************************************
+\\ The AVX2 version of intensity_epi16, on 16 lanes.
+//
+\\ ****************************************************/
+PK_TARGET("avx2")
+static inline __m256i intensity_epi16_avx2( __m256i b,
+                                            __m256i g,
+                                            __m256i r,
+                                            __m256i a,
+                                            IntensityMode mode )
+{
+  // (29 B + 150 G + 77 R + 128) >> 8.
+  if(mode != MEAN_INTENSITY)
+  {
+    __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(lumaFirst(mode))),
+                                   _mm256_mullo_epi16(g, _mm256_set1_epi16(LUMA_G)));
+    sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(r, _mm256_set1_epi16(lumaThird(mode))));
+    return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(128)), 8);
+  }
+
+  // (B + G + R + A + 2) / 4.
+  const __m256i sum = _mm256_add_epi16(_mm256_add_epi16(b, g), _mm256_add_epi16(r, a));
+  return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+}
+
+
+/* ****************************************************
+\\ AVX2 kernel for 4 channel pixels. Same approach as
+// the SSE2 kernel, on 32 pixels per iteration. The
+\\ in-lane packs leave 4-pixel groups out of order,
+// so one cross-lane permute restores them.
+\\
+// @return: The number of pixels processed.
+\\
+// ****************************************************/
+PK_TARGET("avx2")
+static uint intensityRow_c4_avx2( const uchar * src,
+                                  uchar * dst,
+                                  uint width,
+                                  IntensityMode mode )
+{
+  const __m256i MASK  = _mm256_set1_epi32(0xFF),
+                ORDER = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  uint px = 0;
+
+  for(; px + 32 <= width; px += 32, src += 128)
+  {
+    // Load 32 BGRA pixels.
+    const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)),
+                  v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 32)),
+                  v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 64)),
+                  v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 96));
+
+    // Split the channels into 16-bit lanes.
+    #define PK_CHANNEL(v, shift) _mm256_and_si256(_mm256_srli_epi32(v, shift), MASK)
+    const __m256i lo = intensity_epi16_avx2( _mm256_packs_epi32(PK_CHANNEL(v0, 0),  PK_CHANNEL(v1, 0)),
+                                             _mm256_packs_epi32(PK_CHANNEL(v0, 8),  PK_CHANNEL(v1, 8)),
+                                             _mm256_packs_epi32(PK_CHANNEL(v0, 16), PK_CHANNEL(v1, 16)),
+                                             _mm256_packs_epi32(PK_CHANNEL(v0, 24), PK_CHANNEL(v1, 24)),
+                                             mode );
+    const __m256i hi = intensity_epi16_avx2( _mm256_packs_epi32(PK_CHANNEL(v2, 0),  PK_CHANNEL(v3, 0)),
+                                             _mm256_packs_epi32(PK_CHANNEL(v2, 8),  PK_CHANNEL(v3, 8)),
+                                             _mm256_packs_epi32(PK_CHANNEL(v2, 16), PK_CHANNEL(v3, 16)),
+                                             _mm256_packs_epi32(PK_CHANNEL(v2, 24), PK_CHANNEL(v3, 24)),
+                                             mode );
+    #undef PK_CHANNEL
+
+    // Narrow to bytes, restore pixel order, and store.
+    const __m256i out = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi), ORDER);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + px), out);
+  }
+
+  return px;
+}
+
+/* ****************************************************
+\\ SSSE3 split kernel for 3 channel pixels, 16 pixels
+// per iteration (see splitBGR_ssse3).
+\\
+// @return: The number of pixels processed.
+\\
+// ****************************************************/
+PK_TARGET("ssse3")
+static uint splitRow_c3_ssse3( const uchar * src,
+                               uchar * const dst[],
+                               uint width )
+{
+  uint px = 0;
+
+  for(; px + 16 <= width; px += 16, src += 48)
+  {
+    __m128i v[3];
+    splitBGR_ssse3(src, v[0], v[1], v[2]);
+
+    for(uint clr = 0; clr < 3; ++clr)
+      if(dst[clr]) _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[clr] + px), v[clr]);
+  }
+
+  return px;
+}
+
+
+/* ****************************************************
+\\ SSE2 split kernel for 4 channel pixels. As in the
+// intensity kernel, each 32-bit lane holds a pixel;
+\\ a channel is shifted down, masked, and packed back
+// to bytes. 16 pixels per iteration.
+\\
+// @return: The number of pixels processed.
+\\
+// ****************************************************/
+PK_TARGET("sse2")
+static uint splitRow_c4_sse2( const uchar * src,
+                              uchar * const dst[],
+                              uint width )
+{
+  const __m128i MASK = _mm_set1_epi32(0xFF);
+  uint px = 0;
+
+  for(; px + 16 <= width; px += 16, src += 64)
+  {
+    // Load 16 BGRA pixels.
+    const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)),
+                  v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16)),
+                  v2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32)),
+                  v3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48));
+
+    #define PK_CHANNEL(v, shift) _mm_and_si128(_mm_srli_epi32(v, shift), MASK)
+    for(uint clr = 0; clr < 4; ++clr)
+    {
+      if(!dst[clr]) continue;
+
+      // Shift counts must be immediates on some compilers,
+      // so each channel is spelled out.
+      __m128i lo, hi;
+      switch(clr)
+      {
+        case 0:  lo = _mm_packs_epi32(PK_CHANNEL(v0, 0),  PK_CHANNEL(v1, 0));
+                 hi = _mm_packs_epi32(PK_CHANNEL(v2, 0),  PK_CHANNEL(v3, 0));  break;
+        case 1:  lo = _mm_packs_epi32(PK_CHANNEL(v0, 8),  PK_CHANNEL(v1, 8));
+                 hi = _mm_packs_epi32(PK_CHANNEL(v2, 8),  PK_CHANNEL(v3, 8));  break;
+        case 2:  lo = _mm_packs_epi32(PK_CHANNEL(v0, 16), PK_CHANNEL(v1, 16));
+                 hi = _mm_packs_epi32(PK_CHANNEL(v2, 16), PK_CHANNEL(v3, 16)); break;
+        default: lo = _mm_packs_epi32(PK_CHANNEL(v0, 24), PK_CHANNEL(v1, 24));
+                 hi = _mm_packs_epi32(PK_CHANNEL(v2, 24), PK_CHANNEL(v3, 24)); break;
+      }
+
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[clr] + px), _mm_packus_epi16(lo, hi));
+    }
+    #undef PK_CHANNEL
+  }
+
+  return px;
+}
+
+
+/* ****************************************************
+\\ SSSE3 merge kernel for 3 channel pixels. The inverse
+// of splitBGR_ssse3: each 16-byte output is shuffled
+\\ together from the B, G and R registers. 16 pixels
+// per iteration.
+\\
+// @return: The number of pixels processed.
+\\
+// ****************************************************/
+PK_TARGET("ssse3")
+static uint mergeRow_c3_ssse3( const uchar * const src[],
+                               uchar * dst,
+                               uint width )
+{
+  // Shuffle masks placing channel values into each of the three
+  // 16-byte outputs. -1 zeroes the byte, so the parts can be or'd.
+  const __m128i B0 = _mm_setr_epi8( 0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1,  5),
+                G0 = _mm_setr_epi8(-1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1),
+                R0 = _mm_setr_epi8(-1, -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1),
+                B1 = _mm_setr_epi8(-1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10, -1),
+                G1 = _mm_setr_epi8( 5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10),
+                R1 = _mm_setr_epi8(-1,  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1),
+                B2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1),
+                G2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1),
+                R2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+  uint px = 0;
+
+  for(; px + 16 <= width; px += 16, dst += 48)
+  {
+    // Load 16 values of each channel.
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[0] + px)),
+                  g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[1] + px)),
+                  r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[2] + px));
+
+    // Interleave them into 16 BGR pixels.
+    _mm_storeu_si128( reinterpret_cast<__m128i *>(dst),
+                      _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, B0), _mm_shuffle_epi8(g, G0)), _mm_shuffle_epi8(r, R0)) );
+    _mm_storeu_si128( reinterpret_cast<__m128i *>(dst + 16),
+                      _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, B1), _mm_shuffle_epi8(g, G1)), _mm_shuffle_epi8(r, R1)) );
+    _mm_storeu_si128( reinterpret_cast<__m128i *>(dst + 32),
+                      _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, B2), _mm_shuffle_epi8(g, G2)), _mm_shuffle_epi8(r, R2)) );
+  }
+
+  return px;
+}
+
+
+/* ****************************************************
+\\ SSE2 merge kernel for 4 channel pixels. Byte then
+// 16-bit unpacks interleave B with G and R with A,
+\\ then BG with RA. 16 pixels per iteration.
+//
+\\ @return: The number of pixels processed.
+//
+\\ ****************************************************/
+PK_TARGET("sse2")
+static uint mergeRow_c4_sse2( const uchar * const src[],
+                              uchar * dst,
+                              uint width )
+{
+  uint px = 0;
+
+  for(; px + 16 <= width; px += 16, dst += 64)
+  {
+    // Load 16 values of each channel.
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[0] + px)),
+                  g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[1] + px)),
+                  r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[2] + px)),
+                  a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[3] + px));
+
+    // Pair the channels up, then the pairs.
+    const __m128i bg_lo = _mm_unpacklo_epi8(b, g), bg_hi = _mm_unpackhi_epi8(b, g),
+                  ra_lo = _mm_unpacklo_epi8(r, a), ra_hi = _mm_unpackhi_epi8(r, a);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),      _mm_unpacklo_epi16(bg_lo, ra_lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_unpackhi_epi16(bg_lo, ra_lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 32), _mm_unpacklo_epi16(bg_hi, ra_hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 48), _mm_unpackhi_epi16(bg_hi, ra_hi));
+  }
+
+  return px;
+}
+
+/* ****************************************************
+\\ SSE2 equality scan, 16 values per iteration.
+//
+\\ @return: The start of the first block of 16 with a
+// difference, or where the whole blocks end.
+\\
+// ****************************************************/
+PK_TARGET("sse2")
+static size_t firstDiff_sse2( const uchar * a,
+                              const uchar * b,
+                              size_t len )
+{
+  size_t i = 0;
+  for(; i + 16 <= len; i += 16)
+  {
+    const __m128i EQ = _mm_cmpeq_epi8( _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+                                       _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)) );
+    if(_mm_movemask_epi8(EQ) != 0xFFFF) return i;
+  }
+  return i;
+}
+
+
+/* ****************************************************
+\\ SSE2 diff kernel, 16 values per iteration. Blocks
+// that are equal are skipped after one compare. In the
+\\ rest, the absolute differences (|a - b| is the OR of
+// both saturated subtractions) feed the max and the
+\\ sum of squares, and the differing pixels are found:
+// for 1 and 4 channels with byte and 32-bit compares,
+\\ otherwise by the scalar kernel (next_px keeps pixels
+// that straddle two blocks from being counted twice).
+\\
+// @param next_px: Receives the first pixel the kernel
+\\ hasn't examined.
+//
+\\ @return: The number of values processed.
+//
+\\ ****************************************************/
+PK_TARGET("sse2")
+static size_t diffRow_sse2( const uchar * a,
+                            const uchar * b,
+                            uchar * mask,
+                            uint width,
+                            uint chans,
+                            RowDiff & diff,
+                            uint & next_px )
+{
+  const size_t END = (size_t(width) * chans) & ~size_t(15);
+  const __m128i ZERO = _mm_setzero_si128();
+
+  __m128i max_d = ZERO, squares = ZERO;
+  uint blocks = 0;
+  next_px = 0;
+
+  for(size_t i = 0; i < END; i += 16)
+  {
+    const __m128i A = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+                  B = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+
+    const uint EQUAL = _mm_movemask_epi8(_mm_cmpeq_epi8(A, B));
+    if(EQUAL == 0xFFFF) continue;
+
+    // |A - B|, its max, and the sum of its squares.
+    const __m128i D = _mm_or_si128(_mm_subs_epu8(A, B), _mm_subs_epu8(B, A));
+    const __m128i LO = _mm_unpacklo_epi8(D, ZERO),
+                  HI = _mm_unpackhi_epi8(D, ZERO);
+    max_d = _mm_max_epu8(max_d, D);
+    squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(LO, LO), _mm_madd_epi16(HI, HI)));
+
+    if(++blocks == SSE_FOLD_BLOCKS)
+    {
+      uint lanes[4];
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), squares);
+      diff.squared_error += (unsigned long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+      squares = ZERO;
+      blocks = 0;
+    }
+
+    const uint PX = static_cast<uint>(i / chans);
+
+    // One bit per differing pixel, for 1 and 4 channels.
+    uint differs = 0;
+
+    if(chans == 1)
+    {
+      differs = ~EQUAL & 0xFFFF;
+      if(mask) _mm_storeu_si128(reinterpret_cast<__m128i *>(mask + PX), D);
+    }
+    else if(chans == 4)
+    {
+      differs = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(A, B))) & 0xF;
+
+      // The max of each pixel's four differences, in the
+      // low byte of its lane, packed into 4 bytes.
+      if(mask)
+      {
+        __m128i worst = _mm_max_epu8(D, _mm_srli_epi32(D, 8));
+        worst = _mm_max_epu8(worst, _mm_srli_epi32(worst, 16));
+        worst = _mm_and_si128(worst, _mm_set1_epi32(0xFF));
+        worst = _mm_packus_epi16(_mm_packs_epi32(worst, ZERO), ZERO);
+
+        const int PACKED = _mm_cvtsi128_si32(worst);
+        std::memcpy(mask + PX, &PACKED, 4);
+      }
+    }
+    else
+    {
+      // Examine every pixel with a value in the block.
+      const uint LAST = static_cast<uint>((i + 15) / chans);
+      diffPixels_scalar(a, b, mask, (next_px > PX) ? next_px : PX, LAST + 1, chans, diff);
+      next_px = LAST + 1;
+      continue;
+    }
+
+    diff.mismatches += __builtin_popcount(differs);
+    if(PX + __builtin_ctz(differs) < diff.first) diff.first = PX + __builtin_ctz(differs);
+    diff.last = PX + 31 - __builtin_clz(differs);
+  }
+
+  // Fold the sums and the max.
+  uint lanes[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), squares);
+  diff.squared_error += (unsigned long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+  uchar maxes[16];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(maxes), max_d);
+  for(uint k = 0; k < 16; ++k) if(maxes[k] > diff.max_error) diff.max_error = maxes[k];
+
+  // 16-byte blocks hold whole pixels of 1 and 4 channels.
+  if(chans == 1 || chans == 4) next_px = static_cast<uint>(END / chans);
+
+  return END;
+}
+
+#endif // PIXEL_KERNELS_X86
+
+
+#ifdef PIXEL_KERNELS_NEON
+
+// **************** |
+// NEON Kernels     |
+// **************** V
+
+/* ****************************************************
+\\ NEON kernel for 3 and 4 channel pixels. vld3/vld4
+// split the channels while loading, 16 pixels at once.
+\\
+// @return: The number of pixels processed.
+//
+\\ ****************************************************/
+static uint intensityRow_neon( const uchar * src,
+                               uchar * dst,
+                               uint width,
+                               uint chans,
+                               IntensityMode mode )
+{
+  uint px = 0;
+
+  for(; px + 16 <= width; px += 16, src += 16 * chans)
+  {
+    uint8x16_t b, g, r, a = vdupq_n_u8(0);
+
+    // Load 16 pixels, one register per channel.
+    if(chans == 4) { uint8x16x4_t v = vld4q_u8(src); b = v.val[0]; g = v.val[1]; r = v.val[2]; a = v.val[3]; }
+    else           { uint8x16x3_t v = vld3q_u8(src); b = v.val[0]; g = v.val[1]; r = v.val[2]; }
+
+    uint16x8_t lo, hi;
+
+    if(mode != MEAN_INTENSITY)
+    {
+      // 29 B + 150 G + 77 R, rounded and shifted by 8 (b and
+      // r swap weights for RGB pixels).
+      const uint8x8_t W_FIRST = vdup_n_u8(lumaFirst(mode)),
+                      W_THIRD = vdup_n_u8(lumaThird(mode));
+      lo = vmull_u8(vget_low_u8(b), W_FIRST);
+      hi = vmull_u8(vget_high_u8(b), W_FIRST);
+      lo = vmlal_u8(lo, vget_low_u8(g), vdup_n_u8(LUMA_G));
+      hi = vmlal_u8(hi, vget_high_u8(g), vdup_n_u8(LUMA_G));
+      lo = vmlal_u8(lo, vget_low_u8(r), W_THIRD);
+      hi = vmlal_u8(hi, vget_high_u8(r), W_THIRD);
+      vst1q_u8(dst + px, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+      continue;
+    }
+
+    // Sum of the color channels.
+    lo = vaddw_u8(vaddl_u8(vget_low_u8(b), vget_low_u8(g)), vget_low_u8(r));
+    hi = vaddw_u8(vaddl_u8(vget_high_u8(b), vget_high_u8(g)), vget_high_u8(r));
+
+    if(chans == 4)
+    {
+      // (B + G + R + A + 2) / 4.
+      lo = vaddw_u8(lo, vget_low_u8(a));
+      hi = vaddw_u8(hi, vget_high_u8(a));
+      vst1q_u8(dst + px, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+    }
+    else
+    {
+      // (B + G + R + 1) / 3, through a 32-bit multiply by DIV3_MUL.
+      lo = vaddq_u16(lo, vdupq_n_u16(1));
+      hi = vaddq_u16(hi, vdupq_n_u16(1));
+      const uint16x4_t M = vdup_n_u16(DIV3_MUL);
+      const uint16x8_t q_lo = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(lo), M), 16),
+                                           vshrn_n_u32(vmull_u16(vget_high_u16(lo), M), 16)),
+                       q_hi = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(hi), M), 16),
+                                           vshrn_n_u32(vmull_u16(vget_high_u16(hi), M), 16));
+      vst1q_u8(dst + px, vcombine_u8(vmovn_u16(q_lo), vmovn_u16(q_hi)));
+    }
+  }
+
+  return px;
+}
+
+
+/* ****************************************************
+\\ NEON split kernel for 3 and 4 channel pixels. vld3
+// and vld4 de-interleave while loading, 16 pixels at
+\\ once.
+//
+\\ @return: The number of pixels processed.
+//
+\\ ****************************************************/
+static uint splitRow_neon( const uchar * src,
+                           uchar * const dst[],
+                           uint width,
+                           uint chans )
+{
+  uint px = 0;
+
+  for(; px + 16 <= width; px += 16, src += 16 * chans)
+  {
+    uint8x16_t v[4];
+
+    if(chans == 4) { uint8x16x4_t in = vld4q_u8(src); v[0] = in.val[0]; v[1] = in.val[1]; v[2] = in.val[2]; v[3] = in.val[3]; }
+    else           { uint8x16x3_t in = vld3q_u8(src); v[0] = in.val[0]; v[1] = in.val[1]; v[2] = in.val[2]; }
+
+    for(uint clr = 0; clr < chans; ++clr)
+      if(dst[clr]) vst1q_u8(dst[clr] + px, v[clr]);
+  }
+
+  return px;
+}
+
+
+/* ****************************************************
+\\ NEON merge kernel for 3 and 4 channel pixels. vst3
+// and vst4 interleave while storing.
+\\
+// @return: The number of pixels processed.
+\\
+// ****************************************************/
+static uint mergeRow_neon( const uchar * const src[],
+                           uchar * dst,
+                           uint width,
+                           uint chans )
+{
+  uint px = 0;
+
+  for(; px + 16 <= width; px += 16, dst += 16 * chans)
+  {
+    if(chans == 4)
+    {
+      uint8x16x4_t out;
+      for(uint clr = 0; clr < 4; ++clr) out.val[clr] = vld1q_u8(src[clr] + px);
+      vst4q_u8(dst, out);
+    }
+    else
+    {
+      uint8x16x3_t out;
+      for(uint clr = 0; clr < 3; ++clr) out.val[clr] = vld1q_u8(src[clr] + px);
+      vst3q_u8(dst, out);
+    }
+  }
+
+  return px;
+}
+
+/* ****************************************************
+\\ NEON equality scan, 16 values per iteration. As
+// for firstDiff_sse2.
+\\
+// ****************************************************/
+static size_t firstDiff_neon( const uchar * a,
+                              const uchar * b,
+                              size_t len )
+{
+  size_t i = 0;
+  for(; i + 16 <= len; i += 16)
+  {
+    // Every byte of EQ is 0xFF if the blocks are equal.
+    const uint8x16_t EQ = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+    const uint8x8_t BOTH = vand_u8(vget_low_u8(EQ), vget_high_u8(EQ));
+    if(vget_lane_u64(vreinterpret_u64_u8(BOTH), 0) != ~0ull) return i;
+  }
+  return i;
+}
+
+
+/* ****************************************************
+\\ NEON diff kernel, 16 values per iteration. As for
+// diffRow_sse2 (vabdq_u8 gives |a - b| directly), with
+\\ the differing pixels found by the scalar kernel.
+//
+\\ ****************************************************/
+static size_t diffRow_neon( const uchar * a,
+                            const uchar * b,
+                            uchar * mask,
+                            uint width,
+                            uint chans,
+                            RowDiff & diff,
+                            uint & next_px )
+{
+  const size_t END = (size_t(width) * chans) & ~size_t(15);
+
+  uint8x16_t max_d = vdupq_n_u8(0);
+  uint32x4_t squares = vdupq_n_u32(0);
+  uint blocks = 0;
+  next_px = 0;
+
+  for(size_t i = 0; i < END; i += 16)
+  {
+    const uint8x16_t A = vld1q_u8(a + i),
+                     B = vld1q_u8(b + i);
+
+    const uint8x16_t EQ = vceqq_u8(A, B);
+    const uint8x8_t BOTH = vand_u8(vget_low_u8(EQ), vget_high_u8(EQ));
+    if(vget_lane_u64(vreinterpret_u64_u8(BOTH), 0) == ~0ull) continue;
+
+    // |A - B|, its max, and the sum of its squares.
+    const uint8x16_t D = vabdq_u8(A, B);
+    max_d = vmaxq_u8(max_d, D);
+    squares = vpadalq_u16(squares, vmull_u8(vget_low_u8(D), vget_low_u8(D)));
+    squares = vpadalq_u16(squares, vmull_u8(vget_high_u8(D), vget_high_u8(D)));
+
+    if(++blocks == SSE_FOLD_BLOCKS)
+    {
+      uint lanes[4];
+      vst1q_u32(lanes, squares);
+      diff.squared_error += (unsigned long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+      squares = vdupq_n_u32(0);
+      blocks = 0;
+    }
+
+    // Examine every pixel with a value in the block.
+    const uint PX = static_cast<uint>(i / chans),
+               LAST = static_cast<uint>((i + 15) / chans);
+    diffPixels_scalar(a, b, mask, (next_px > PX) ? next_px : PX, LAST + 1, chans, diff);
+    next_px = LAST + 1;
+  }
+
+  // Fold the sums and the max.
+  uint lanes[4];
+  vst1q_u32(lanes, squares);
+  diff.squared_error += (unsigned long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+  uchar maxes[16];
+  vst1q_u8(maxes, max_d);
+  for(uint k = 0; k < 16; ++k) if(maxes[k] > diff.max_error) diff.max_error = maxes[k];
+
+  return END;
+}
+
+#endif // PIXEL_KERNELS_NEON
+
+
+// ******************** |
+// Kernel Dispatchers   |
+// ******************** V
+
+/* ****************************************************
+\\ Reduces a row of interleaved pixels to one intensity
+// value per pixel. The widest kernel supported by the
+\\ CPU handles as much of the row as it can, and the
+// scalar kernel finishes the tail.
+\\
+// @param src: width * chans interleaved channel values.
+\\
+// @param dst: Destination for width intensity values.
+\\
+// @param width: The number of pixels in the row.
+\\
+// @param chans: The number of channels per pixel.
+\\
+// @param mode: Mean or luma (BGR or RGB) intensity.
+\\
+// ****************************************************/
+void intensityRow( const uchar * src,
+                   uchar * dst,
+                   uint width,
+                   uint chans,
+                   IntensityMode mode )
+{
+  // If there is nothing to reduce, return.
+  if(!src || !dst || !chans) return;
+
+  // One channel pixels are their own intensity.
+  if(chans == 1) { std::memcpy(dst, src, width); return; }
+
+  // The number of pixels handled by a SIMD kernel.
+  uint done = 0;
+
+#if defined(PIXEL_KERNELS_X86)
+  const CpuFeatures & CPU = cpuFeatures();
+
+  if(chans == 4 && CPU.avx2) done = intensityRow_c4_avx2(src, dst, width, mode);
+  if(chans == 4 && CPU.sse2) done += intensityRow_c4_sse2( src + done * 4, dst + done,
+                                                           width - done, mode );
+  if(chans == 3 && CPU.ssse3) done = intensityRow_c3_ssse3(src, dst, width, mode);
+#elif defined(PIXEL_KERNELS_NEON)
+  if(chans == 3 || chans == 4) done = intensityRow_neon(src, dst, width, chans, mode);
+#endif
+
+  // Finish the row.
+  intensityRow_scalar(src + done * chans, dst + done, width - done, chans, mode);
+}
+
+
+/* ****************************************************
+\\ Splits a row of interleaved pixels into one plane
+// per channel. As with intensityRow, the widest kernel
+\\ the CPU supports handles most of the row, and the
+// scalar kernel finishes the tail.
+\\
+// @param src: width * chans interleaved channel values.
+\\
+// @param dst: chans plane pointers, each with room for
+\\ width values. Null planes are skipped.
+//
+\\ @param width: The number of pixels in the row.
+//
+\\ @param chans: The number of channels per pixel.
+//
+\\ ****************************************************/
+void splitRow( const uchar * src,
+               uchar * const dst[],
+               uint width,
+               uint chans )
+{
+  // If there is nothing to split, return.
+  if(!src || !dst || !chans) return;
+
+  // One channel pixels are already planar.
+  if(chans == 1) { if(dst[0]) std::memcpy(dst[0], src, width); return; }
+
+  // The number of pixels handled by a SIMD kernel.
+  uint done = 0;
+
+#if defined(PIXEL_KERNELS_X86)
+  const CpuFeatures & CPU = cpuFeatures();
+
+  if(chans == 3 && CPU.ssse3) done = splitRow_c3_ssse3(src, dst, width);
+  if(chans == 4 && CPU.sse2) done = splitRow_c4_sse2(src, dst, width);
+#elif defined(PIXEL_KERNELS_NEON)
+  if(chans == 3 || chans == 4) done = splitRow_neon(src, dst, width, chans);
+#endif
+
+  // Finish the row, from where the kernel stopped.
+  splitRow_scalar(src, dst, done, width, chans);
+}
+
+
+/* ****************************************************
+\\ Interleaves one plane per channel into a row of
+// pixels. The inverse of splitRow.
+\\
+// @param src: chans plane pointers, each holding width
+\\ values. A null plane leaves that channel unchanged
+// (and the row is then merged by the scalar kernel).
+\\
+// @param dst: Destination for width * chans values.
+\\
+// @param width: The number of pixels in the row.
+\\
+// @param chans: The number of channels per pixel.
+\\
+// ****************************************************/
+void mergeRow( const uchar * const src[],
+               uchar * dst,
+               uint width,
+               uint chans )
+{
+  // If there is nothing to merge, return.
+  if(!src || !dst || !chans) return;
+
+  // One channel pixels are already planar.
+  if(chans == 1) { if(src[0]) std::memcpy(dst, src[0], width); return; }
+
+  // The SIMD kernels write every channel, so need every plane.
+  bool all = true;
+  for(uint clr = 0; clr < chans && all; ++clr) all = (src[clr] != nullptr);
+
+  // The number of pixels handled by a SIMD kernel.
+  uint done = 0;
+
+#if defined(PIXEL_KERNELS_X86)
+  const CpuFeatures & CPU = cpuFeatures();
+
+  if(all && chans == 3 && CPU.ssse3) done = mergeRow_c3_ssse3(src, dst, width);
+  if(all && chans == 4 && CPU.sse2) done = mergeRow_c4_sse2(src, dst, width);
+#elif defined(PIXEL_KERNELS_NEON)
+  if(all && (chans == 3 || chans == 4)) done = mergeRow_neon(src, dst, width, chans);
+#endif
+
+  // Finish the row, from where the kernel stopped.
+  mergeRow_scalar(src, dst, done, width, chans);
+}
+
+
+/* ****************************************************
+\\ Finds the first difference between two runs of
+// values. The SIMD scan skips equal blocks, and the
+\\ scalar loop pins down the difference within one.
+//
+\\ @param a, b: len values each.
+//
+\\ @return: The index of the first differing value, or
+// len if there is none.
+\\
+// ****************************************************/
+size_t firstDiff( const uchar * a,
+                  const uchar * b,
+                  size_t len )
+{
+  // If there is nothing to compare, there is no difference.
+  if(!a || !b || a == b) return len;
+
+  size_t i = 0;
+
+#if defined(PIXEL_KERNELS_X86)
+  if(cpuFeatures().sse2) i = firstDiff_sse2(a, b, len);
+#elif defined(PIXEL_KERNELS_NEON)
+  i = firstDiff_neon(a, b, len);
+#endif
+
+  while(i < len && a[i] == b[i]) ++i;
+  return i;
+}
+
+
+/* ****************************************************
+\\ Compares two rows of interleaved pixels. The SIMD
+// kernel handles the whole 16-value blocks, and the
+\\ scalar kernels finish the rest.
+//
+\\ @param a, b: width * chans interleaved channel values.
+//
+\\ @param mask: Null, or room for width values: each
+// pixel's largest channel difference.
+\\
+// @param width: The number of pixels in the row.
+\\
+// @param chans: The number of channels per pixel.
+\\
+// @return: The differences found.
+\\
+// ****************************************************/
+RowDiff diffRow( const uchar * a,
+                 const uchar * b,
+                 uchar * mask,
+                 uint width,
+                 uint chans )
+{
+  RowDiff diff;
+
+  // If there is nothing to compare, there are no differences.
+  if(!a || !b || !chans) return diff;
+
+  // The kernels only write the mask for differing pixels.
+  if(mask) std::memset(mask, 0, width);
+
+  // The values, and the pixels, handled by a SIMD kernel.
+  size_t done = 0;
+  uint next_px = 0;
+
+#if defined(PIXEL_KERNELS_X86)
+  if(cpuFeatures().sse2) done = diffRow_sse2(a, b, mask, width, chans, diff, next_px);
+#elif defined(PIXEL_KERNELS_NEON)
+  done = diffRow_neon(a, b, mask, width, chans, diff, next_px);
+#endif
+
+  // Finish the row. The pixels before the one holding value
+  // done were either examined, or lie in equal blocks.
+  const uint TAIL_PX = static_cast<uint>(done / chans);
+  diffBytes_scalar(a, b, done, size_t(width) * chans, diff);
+  diffPixels_scalar(a, b, mask, (next_px > TAIL_PX) ? next_px : TAIL_PX, width, chans, diff);
+
+  return diff;
+}
@@ -0,0 +1,105 @@
+/* ***************************************************************
+\\ File Name:  PixelKernels.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Declarations for the row kernels used by the Image
+\\ class's whole-image operations, and by ImageDiff. Each kernel
+// works on one scanline of 8-bit channel values, and picks a SIMD
+\\ implementation (SSE2/SSSE3/AVX2 or NEON) when one is available.
+// See PixelKernels.cpp for more information.
+\\
+// ***************************************************************/
+
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+// For uchar and uint.
+#include "opencv2/core/core.hpp"
+
+
+/* *************************************************
+\\ How a pixel's channels are reduced to a single
+// intensity value.
+\\
+// *************************************************/
+enum IntensityMode
+{
+  // The rounded average of every channel.
+  MEAN_INTENSITY,
+  // Rec. 601 luma (0.299 R + 0.587 G + 0.114 B) of
+  // a BGR(A) pixel. Alpha is ignored. For one and two
+  // channel images, the first channel is the luma.
+  LUMA_INTENSITY,
+  // The same luma, of an RGB(A) pixel. Image picks it
+  // for Images stored in RGB order (see Image::isRGB).
+  LUMA_RGB_INTENSITY
+};
+
+
+// Reduces width pixels of chans interleaved channels
+// in src to one intensity value per pixel in dst.
+void intensityRow( const uchar * src,
+                   uchar * dst,
+                   uint width,
+                   uint chans,
+                   IntensityMode mode );
+
+// Copies each channel of width pixels of chans interleaved
+// channels in src into its own plane, dst[clr]. Null planes
+// are skipped.
+void splitRow( const uchar * src,
+               uchar * const dst[],
+               uint width,
+               uint chans );
+
+// Interleaves width values from each plane src[clr] into
+// pixels of chans channels in dst. Channels with a null
+// plane are left unchanged.
+void mergeRow( const uchar * const src[],
+               uchar * dst,
+               uint width,
+               uint chans );
+
+
+/* *************************************************
+\\ The differences diffRow finds between two rows.
+//
+\\ *************************************************/
+struct RowDiff
+{
+  // Initialize all fields as for equal rows.
+  RowDiff(void) :
+  mismatches(0), first(~0u), last(0), max_error(0), squared_error(0) { return; }
+
+       // The pixels with any channel differing, and
+       // the columns of the first and last of them
+       // (first > last if there are none).
+  uint mismatches,
+       first,
+       last,
+       // The largest absolute difference of any
+       // channel value.
+       max_error;
+
+  // The sum of the squared channel differences.
+  unsigned long long squared_error;
+};
+
+// Returns the index of the first of len values that differ
+// between a and b, or len if they are all equal.
+size_t firstDiff( const uchar * a,
+                  const uchar * b,
+                  size_t len );
+
+// Compares width pixels of chans interleaved channels in a
+// and b. If mask isn't null, it receives width values: each
+// pixel's largest absolute channel difference (0 if equal).
+RowDiff diffRow( const uchar * a,
+                 const uchar * b,
+                 uchar * mask,
+                 uint width,
+                 uint chans );
+
+#endif // PIXEL_KERNELS_H
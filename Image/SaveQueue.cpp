@@ -0,0 +1,150 @@
+/* ***************************************************************
+\\ File Name:  SaveQueue.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation of background saving. save() copies the
+\\ Image (sharing its pixels), pushes it onto a BoundedQueue, and
+// returns. Encoder threads pop and save each one, then fulfil its
+\\ promise. The queue is bounded, so a caller producing images
+// faster than they can be encoded is slowed down rather than
+\\ holding an unbounded number of frames in memory:
+//
+\\   at most queue_depth + threads Images are held at once.
+//
+\\ ***************************************************************/
+
+#include "SaveQueue.h"
+
+
+/* ****************************************************
+\\ Starts the encoder threads.
+//
+\\ @param threads: The number of encoder threads. 0
+// means one per hardware thread.
+\\
+// @param queue_depth: The number of saves that may
+\\ wait for a thread before save() blocks.
+//
+\\ ****************************************************/
+SaveQueue :: SaveQueue( uint threads,
+                        size_t queue_depth ) :
+jobs(queue_depth), in_flight(0)
+{
+  if(threads == 0) threads = std::thread::hardware_concurrency();
+  if(threads == 0) threads = 1;
+
+  for(uint t = 0; t < threads; ++t)
+    workers.push_back(std::thread(&SaveQueue::work, this));
+}
+
+
+/* ****************************************************
+\\ Lets the threads finish every queued save, then
+// joins them.
+\\
+// ****************************************************/
+SaveQueue :: ~SaveQueue(void)
+{
+  // Closing stops new saves; the threads drain the rest.
+  jobs.close();
+
+  for(size_t t = 0; t < workers.size(); ++t) workers[t].join();
+}
+
+
+/* ****************************************************
+\\ Queues an Image to be saved.
+//
+\\ @param img: The Image. Its pixels are shared, not
+// copied, until either Image is modified.
+\\
+// @param options: Encoder settings. See EncodeOptions.
+//
+\\ @return: A future holding saveImage's result. False
+// if the queue is shut down.
+\\
+// ****************************************************/
+std::future<bool> SaveQueue :: save( const Image & img,
+                                     const EncodeOptions & options )
+{
+  SaveJob job;
+
+  // Share the pixels. The copy constructor renames the
+  // copy (e.g. x_1.png), so give it back img's name.
+  job.img = img;
+  job.img.setFilename(img.getFilename());
+  job.options = options;
+
+  std::future<bool> result = job.done.get_future();
+
+  { std::lock_guard<std::mutex> guard(lock); ++in_flight; }
+
+  // Blocks while the queue is full. If it has been
+  // closed, the save is dropped, and reported as failed.
+  if(!jobs.push(std::move(job)))
+  {
+    std::promise<bool> dropped;
+    dropped.set_value(false);
+    result = dropped.get_future();
+
+    std::lock_guard<std::mutex> guard(lock);
+    if(--in_flight == 0) idle.notify_all();
+  }
+
+  return result;
+}
+
+
+/* ****************************************************
+\\ Blocks until no saves are queued or in progress.
+// Saves queued by other threads meanwhile are waited
+\\ for too.
+//
+\\ ****************************************************/
+void SaveQueue :: flush(void)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  idle.wait(guard, [this] { return in_flight == 0; });
+}
+
+
+// Returns the number of saves queued or in progress.
+size_t SaveQueue :: pending(void) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return in_flight;
+}
+
+
+/* ****************************************************
+\\ (Private) - The body of each encoder thread: saves
+// queued Images until the queue is closed and drained.
+\\ Errors (including exceptions) reach the caller
+// through the job's future.
+\\
+// ****************************************************/
+void SaveQueue :: work(void)
+{
+  for(SaveJob job; jobs.pop(job); )
+  {
+    // The result of the save, or the exception it threw.
+    bool saved = false;
+    std::exception_ptr error;
+
+    try { saved = job.img.saveImage(job.options); }
+    catch(...) { error = std::current_exception(); }
+
+    // Let go of the pixels before reporting the save finished,
+    // so a caller writing to its Image after get() doesn't
+    // find them shared, and copy them.
+    job.img = Image();
+
+    if(error) job.done.set_exception(error);
+    else job.done.set_value(saved);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if(--in_flight == 0) idle.notify_all();
+  }
+}
@@ -0,0 +1,99 @@
+/* ***************************************************************
+\\ File Name:  SaveQueue.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Declarations for saving Images in the background. A
+\\ save is queued and returns a future at once; a pool of encoder
+// threads does the encoding and writing, so the caller can move on
+\\ to its next image. See SaveQueue.cpp for more information.
+//
+\\ ***************************************************************/
+
+#ifndef SAVE_QUEUE_H
+#define SAVE_QUEUE_H
+
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Image.h"
+#include "BoundedQueue.h"
+
+
+/* *************************************************
+\\ A bounded pool of encoder threads. Each queued save
+// holds a copy-on-write copy of its Image, so only a
+\\ reference to the pixels is kept: the caller may go
+// on modifying its Image (which then takes its own
+\\ copy) without affecting what is written. Writable
+// mappings are the exception (see Image::mapImage);
+\\ flush before modifying one that is queued.
+//
+\\ *************************************************/
+class SaveQueue
+{
+  public:
+
+    // Starts threads encoder threads (0 means one per hardware
+    // thread). At most queue_depth saves wait for a thread;
+    // save blocks while that many are waiting.
+    explicit SaveQueue( uint threads = 0,
+                        size_t queue_depth = 4 );
+
+    // Finishes every queued save, then stops the threads.
+    ~SaveQueue(void);
+
+    // Queues img to be saved to its filename, as saveImage
+    // would. The future is true once it has been written. If
+    // the name has no valid extension, ".png" is appended to
+    // the saved copy's name only. The future is false if the
+    // queue has been shut down.
+    std::future<bool> save( const Image & img,
+                            const EncodeOptions & options = EncodeOptions() );
+
+    // Blocks until every save queued so far has finished.
+    void flush(void);
+
+    // Returns the number of saves queued or in progress.
+    size_t pending(void) const;
+
+  private:
+
+    // A queued save.
+    struct SaveJob
+    {
+      // The Image to be saved (sharing the caller's pixels).
+      Image img;
+
+      // Encoder settings.
+      EncodeOptions options;
+
+      // Receives the result of saveImage.
+      std::promise<bool> done;
+    };
+
+    // Not copyable; the threads refer to the queue.
+    SaveQueue(const SaveQueue &) = delete;
+    SaveQueue & operator=(const SaveQueue &) = delete;
+
+    // The body of each encoder thread.
+    void work(void);
+
+    // Saves waiting for a thread.
+    BoundedQueue<SaveJob> jobs;
+
+    // The encoder threads.
+    std::vector<std::thread> workers;
+
+    // The number of saves queued or in progress,
+    // guarded by lock, and signaled when it reaches 0.
+    size_t in_flight;
+    mutable std::mutex lock;
+    std::condition_variable idle;
+};
+
+#endif // SAVE_QUEUE_H
@@ -0,0 +1,846 @@
+/* ***************************************************************
+\\ File Name:  Stego.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation of LSB steganography. The carrier is
+\\ treated as a sequence of slots: one slot per carrying channel
+// value (every channel in channel_mask, row by row), each holding
+\\ options.bits payload bits, least significant bit first. Payload
+// bit j is in slot j / bits.
+\\
+// When every channel carries payload and bits divides 8, slot k is
+\\ simply byte k of a row, and one payload byte covers 8 / bits
+// consecutive carrier bytes. Those rows are processed a payload
+\\ byte at a time with 64-bit SWAR: a lookup table spreads a byte
+// over its carrier bytes on embed, and a mask/multiply gathers it
+\\ back on extract. Other layouts use a per-slot bit cursor.
+//
+\\ Each row's first payload bit follows from its index, so rows are
+// embedded in parallel (Image::parallelForRows), and extracted in
+\\ parallel whenever rows begin on payload byte boundaries.
+//
+\\ ***************************************************************/
+
+#include "Stego.h"
+
+#include <cstring>
+#include <stdint.h>
+
+// The SWAR kernels treat byte k of a 64-bit word as bits 8k..8k+7,
+// which only holds on little endian targets.
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  #define STEGO_SWAR 0
+#else
+  #define STEGO_SWAR 1
+#endif
+
+
+// *************************** |
+// Global Constant Definitions |
+// *************************** V
+
+// The size of the payload buffer used by the stream functions.
+const static size_t STREAM_CHUNK_BYTES = 64 * 1024;
+
+// Set in the length prefix of the last carrier of a stream.
+const static uint64_t STREAM_LAST_CARRIER = uint64_t(1) << 63;
+
+
+// ********************* |
+// Carrier Layout        |
+// ********************* V
+
+/* *************************************************
+\\ How slots map onto the bytes of a carrier row.
+//
+\\ *************************************************/
+struct SlotLayout
+{
+  // Builds the layout of a carrier with the given options.
+  SlotLayout(const Image & carrier, const StegoOptions & options);
+
+  // True if the carrier and options can be used.
+  bool valid(void) const { return per_px > 0; }
+
+       // The number of LSBs carried by each slot.
+  uint bits,
+       // The number of channels per pixel.
+       chans,
+       // The number of carrying channels per pixel.
+       per_px;
+
+  // The number of slots in each row.
+  size_t per_row;
+
+  // The number of rows in the carrier.
+  uint rows;
+
+  // True if every channel carries, so slot k is byte k of a row.
+  bool dense;
+
+  // The channel index of each carrying channel, in order.
+  uint chan_of[32];
+};
+
+
+/* ****************************************************
+\\ Builds the layout of a carrier.
+//
+\\ @param carrier: The carrier Image.
+//
+\\ @param options: The bits and channel mask.
+//
+\\ ****************************************************/
+SlotLayout :: SlotLayout( const Image & carrier,
+                          const StegoOptions & options ) :
+bits(options.bits), chans(carrier.getChannels()), per_px(0),
+per_row(0), rows(carrier.getHeight()), dense(false)
+{
+  // If the carrier or bit count is invalid, leave the layout invalid.
+  // Only 8-bit carriers are supported.
+  if(!carrier.initialized() || carrier.getDepth() != CV_8U || bits < 1 || bits > 8 || chans > 32) return;
+
+  // Find the carrying channels.
+  for(uint clr = 0; clr < chans; ++clr)
+    if(options.channel_mask & (1u << clr)) chan_of[per_px++] = clr;
+
+  per_row = static_cast<size_t>(carrier.getWidth()) * per_px;
+  dense = (per_px == chans);
+}
+
+
+// ********************* |
+// Bit Cursor Helpers    |
+// ********************* V
+
+/* ****************************************************
+\\ Reads n (<= 8) bits of a buffer, starting at bit pos.
+//
+\\ ****************************************************/
+static inline uint readBits( const uchar * buf,
+                             size_t len,
+                             size_t pos,
+                             uint n )
+{
+  const size_t BYTE = pos >> 3;
+  const uint WINDOW = buf[BYTE] | ((BYTE + 1 < len) ? (buf[BYTE + 1] << 8) : 0);
+
+  return (WINDOW >> (pos & 7)) & ((1u << n) - 1);
+}
+
+
+/* ****************************************************
+\\ Ors n (<= 8) bits into a zeroed buffer at bit pos.
+//
+\\ ****************************************************/
+static inline void writeBits( uchar * buf,
+                              size_t len,
+                              size_t pos,
+                              uint n,
+                              uint value )
+{
+  const size_t BYTE = pos >> 3;
+  const uint SHIFT = pos & 7;
+
+  buf[BYTE] |= static_cast<uchar>(value << SHIFT);
+  if(SHIFT + n > 8 && BYTE + 1 < len) buf[BYTE + 1] |= static_cast<uchar>(value >> (8 - SHIFT));
+}
+
+
+// ********************* |
+// SWAR Kernels          |
+// ********************* V
+
+/* *************************************************
+\\ For each payload byte, its bits spread over the
+// LSBs of 8 / BITS carrier bytes, for BITS of
+\\ 1, 2 and 4. Built once, on first use.
+//
+\\ *************************************************/
+template <uint BITS>
+struct SpreadTable
+{
+  SpreadTable(void)
+  {
+    for(uint b = 0; b < 256; ++b)
+    {
+      spread[b] = 0;
+      for(uint k = 0; k < 8 / BITS; ++k)
+        spread[b] |= static_cast<uint64_t>((b >> (k * BITS)) & ((1u << BITS) - 1)) << (8 * k);
+    }
+  }
+
+  // The carrier LSBs for each payload byte.
+  uint64_t spread[256];
+};
+
+// Returns the table for BITS.
+template <uint BITS>
+static const SpreadTable<BITS> & spreadTable(void)
+{ static const SpreadTable<BITS> TABLE; return TABLE; }
+
+
+/* ****************************************************
+\\ Embeds whole payload bytes into a dense row, one
+// payload byte per 8 / BITS carrier bytes.
+\\
+// @return: The number of payload bytes embedded.
+\\
+// ****************************************************/
+template <uint BITS>
+static size_t embedDense( uchar * row,
+                          size_t row_bytes,
+                          const uchar * payload,
+                          size_t payload_bytes )
+{
+  // Carrier bytes per payload byte, and the LSBs they carry.
+  const uint K = 8 / BITS;
+  const uint64_t LSBS = spreadTable<BITS>().spread[0xFF];
+  const uint64_t * SPREAD = spreadTable<BITS>().spread;
+
+  size_t done = 0;
+
+  for(; (done + 1) * K <= row_bytes && done < payload_bytes; ++done, row += K)
+  {
+    // Replace the LSBs of the next K carrier bytes.
+    uint64_t carrier = 0;
+    std::memcpy(&carrier, row, K);
+    carrier = (carrier & ~LSBS) | SPREAD[payload[done]];
+    std::memcpy(row, &carrier, K);
+  }
+
+  return done;
+}
+
+// Embeds at 8 bits per channel: the payload replaces the row.
+template <>
+size_t embedDense<8>( uchar * row,
+                      size_t row_bytes,
+                      const uchar * payload,
+                      size_t payload_bytes )
+{
+  const size_t DONE = (row_bytes < payload_bytes) ? row_bytes : payload_bytes;
+  std::memcpy(row, payload, DONE);
+  return DONE;
+}
+
+
+/* ****************************************************
+\\ Extracts whole payload bytes from a dense row. The
+// inverse of embedDense.
+\\
+// @return: The number of payload bytes extracted.
+\\
+// ****************************************************/
+template <uint BITS>
+static size_t extractDense( const uchar * row,
+                            size_t row_bytes,
+                            uchar * out,
+                            size_t out_bytes )
+{
+  // Carrier bytes per payload byte, and the LSBs they carry.
+  const uint K = 8 / BITS;
+  const uint64_t LSBS = spreadTable<BITS>().spread[0xFF];
+
+  size_t done = 0;
+
+  for(; (done + 1) * K <= row_bytes && done < out_bytes; ++done, row += K)
+  {
+    // Isolate the LSBs of the next K carrier bytes.
+    uint64_t carrier = 0;
+    std::memcpy(&carrier, row, K);
+    carrier &= LSBS;
+
+    // Gather them into one byte. For one bit per byte, a single
+    // multiply moves bit 8k to bit 56 + k, with no carries.
+    if(BITS == 1) out[done] = static_cast<uchar>((carrier * 0x0102040810204080ULL) >> 56);
+    else
+    {
+      uint byte = 0;
+      for(uint k = 0; k < K; ++k) byte |= static_cast<uint>((carrier >> (8 * k)) & 0xFF) << (k * BITS);
+      out[done] = static_cast<uchar>(byte);
+    }
+  }
+
+  return done;
+}
+
+// Extracts at 8 bits per channel: the row is the payload.
+template <>
+size_t extractDense<8>( const uchar * row,
+                        size_t row_bytes,
+                        uchar * out,
+                        size_t out_bytes )
+{
+  const size_t DONE = (row_bytes < out_bytes) ? row_bytes : out_bytes;
+  std::memcpy(out, row, DONE);
+  return DONE;
+}
+
+
+// ********************* |
+// Row Processing        |
+// ********************* V
+
+/* ****************************************************
+\\ Embeds payload bits into the slots [s0, s1) of one
+// carrier row.
+\\
+// @param row: The carrier row.
+\\
+// @param L: The carrier's slot layout.
+\\
+// @param s0, s1: The range of slots in the row.
+\\
+// @param payload, len: The payload.
+\\
+// @param pos: The payload bit held by slot s0.
+\\ Advanced past the embedded bits.
+//
+\\ ****************************************************/
+static void embedRow( uchar * row,
+                      const SlotLayout & L,
+                      size_t s0,
+                      size_t s1,
+                      const uchar * payload,
+                      size_t len,
+                      size_t & pos )
+{
+  const size_t LEN_BITS = len * 8;
+  const bool SWAR = STEGO_SWAR && L.dense && (8 % L.bits == 0);
+
+  // Carrying channel index and pixel of slot s0.
+  uint u = static_cast<uint>(s0 % L.per_px);
+  size_t px = s0 / L.per_px;
+
+  for(size_t s = s0; s < s1 && pos < LEN_BITS; )
+  {
+    // On byte boundaries of the payload, embed whole bytes at once.
+    if(SWAR && (pos & 7) == 0 && s1 - s >= 8 / L.bits)
+    {
+      const size_t ROW_BYTES = s1 - s, BYTES = (LEN_BITS - pos) >> 3;
+      size_t done = 0;
+
+      switch(L.bits)
+      {
+        case 1: done = embedDense<1>(row + s, ROW_BYTES, payload + (pos >> 3), BYTES); break;
+        case 2: done = embedDense<2>(row + s, ROW_BYTES, payload + (pos >> 3), BYTES); break;
+        case 4: done = embedDense<4>(row + s, ROW_BYTES, payload + (pos >> 3), BYTES); break;
+        case 8: done = embedDense<8>(row + s, ROW_BYTES, payload + (pos >> 3), BYTES); break;
+      }
+
+      s += done * 8 / L.bits;
+      pos += done * 8;
+      u = static_cast<uint>(s % L.per_px);
+      px = s / L.per_px;
+      if(done) continue;
+    }
+
+    // Embed one slot. The last slot may carry fewer bits.
+    const uint N = (LEN_BITS - pos < L.bits) ? static_cast<uint>(LEN_BITS - pos) : L.bits,
+               MASK = (1u << N) - 1;
+    uchar & value = row[px * L.chans + L.chan_of[u]];
+
+    value = static_cast<uchar>((value & ~MASK) | readBits(payload, len, pos, N));
+    pos += N;
+
+    // Move to the next slot.
+    ++s;
+    if(++u == L.per_px) { u = 0; ++px; }
+  }
+}
+
+
+/* ****************************************************
+\\ Extracts payload bits from the slots [s0, s1) of one
+// carrier row. The inverse of embedRow. out must be
+\\ zeroed.
+//
+\\ ****************************************************/
+static void extractRow( const uchar * row,
+                        const SlotLayout & L,
+                        size_t s0,
+                        size_t s1,
+                        uchar * out,
+                        size_t len,
+                        size_t & pos )
+{
+  const size_t LEN_BITS = len * 8;
+  const bool SWAR = STEGO_SWAR && L.dense && (8 % L.bits == 0);
+
+  // Carrying channel index and pixel of slot s0.
+  uint u = static_cast<uint>(s0 % L.per_px);
+  size_t px = s0 / L.per_px;
+
+  for(size_t s = s0; s < s1 && pos < LEN_BITS; )
+  {
+    // On byte boundaries of the payload, extract whole bytes at once.
+    if(SWAR && (pos & 7) == 0 && s1 - s >= 8 / L.bits)
+    {
+      const size_t ROW_BYTES = s1 - s, BYTES = (LEN_BITS - pos) >> 3;
+      size_t done = 0;
+
+      switch(L.bits)
+      {
+        case 1: done = extractDense<1>(row + s, ROW_BYTES, out + (pos >> 3), BYTES); break;
+        case 2: done = extractDense<2>(row + s, ROW_BYTES, out + (pos >> 3), BYTES); break;
+        case 4: done = extractDense<4>(row + s, ROW_BYTES, out + (pos >> 3), BYTES); break;
+        case 8: done = extractDense<8>(row + s, ROW_BYTES, out + (pos >> 3), BYTES); break;
+      }
+
+      s += done * 8 / L.bits;
+      pos += done * 8;
+      u = static_cast<uint>(s % L.per_px);
+      px = s / L.per_px;
+      if(done) continue;
+    }
+
+    // Extract one slot. The last slot may carry fewer bits.
+    const uint N = (LEN_BITS - pos < L.bits) ? static_cast<uint>(LEN_BITS - pos) : L.bits;
+
+    writeBits(out, len, pos, N, row[px * L.chans + L.chan_of[u]] & ((1u << N) - 1));
+    pos += N;
+
+    // Move to the next slot.
+    ++s;
+    if(++u == L.per_px) { u = 0; ++px; }
+  }
+}
+
+
+/* ****************************************************
+\\ Embeds a payload into a carrier, starting at slot
+// first_slot.
+\\
+// @return: False (carrier unchanged) if the options
+\\ are invalid or the payload doesn't fit.
+//
+\\ ****************************************************/
+static bool embedAt( Image & carrier,
+                     const uchar * payload,
+                     size_t len,
+                     size_t first_slot,
+                     const StegoOptions & options )
+{
+  const SlotLayout L(carrier, options);
+
+  // The slots the payload needs, rounded up.
+  const size_t SLOTS = (len * 8 + L.bits - 1) / (L.bits ? L.bits : 1);
+
+  // If the payload doesn't fit, report failure.
+  if(!L.valid() || (len && !payload) || first_slot + SLOTS > L.per_row * L.rows) return false;
+
+  // If there is nothing to embed, the carrier is unchanged.
+  if(!len) return true;
+
+  // The payload bit each row starts at follows from its index, so
+  // the rows are independent: embed them in parallel, from the row
+  // holding first_slot until the payload runs out.
+  const size_t FIRST_ROW = first_slot / L.per_row;
+
+  carrier.parallelForRows([&](uint r, ImageRow<uchar> pixels)
+  {
+    if(r < FIRST_ROW) return;
+
+    const size_t S0 = (r == FIRST_ROW) ? first_slot % L.per_row : 0;
+    size_t pos = (r * L.per_row + S0 - first_slot) * L.bits;
+
+    if(pos < len * 8) embedRow(pixels.data, L, S0, L.per_row, payload, len, pos);
+  });
+
+  // Report success.
+  return true;
+}
+
+
+/* ****************************************************
+\\ Extracts a payload from a carrier, starting at slot
+// first_slot. The inverse of embedAt.
+\\
+// ****************************************************/
+static bool extractAt( const Image & carrier,
+                       uchar * out,
+                       size_t len,
+                       size_t first_slot,
+                       const StegoOptions & options )
+{
+  const SlotLayout L(carrier, options);
+
+  // The slots the payload occupies, rounded up.
+  const size_t SLOTS = (len * 8 + L.bits - 1) / (L.bits ? L.bits : 1);
+
+  // If the carrier is too small, report failure.
+  if(!L.valid() || (len && !out) || first_slot + SLOTS > L.per_row * L.rows) return false;
+
+  // Bits are or'd into out.
+  if(len) std::memset(out, 0, len);
+
+  // If there is nothing to extract, report success.
+  if(!len) return true;
+
+  const size_t FIRST_ROW = first_slot / L.per_row;
+
+  // Bits are or'd into out, so rows may only run in parallel
+  // if each starts on a byte of its own: every row after the
+  // first must begin on a payload byte boundary.
+  if((L.per_row * L.bits) % 8 == 0 && (first_slot * L.bits) % 8 == 0)
+  {
+    carrier.parallelForRows([&](uint r, ImageRow<const uchar> pixels)
+    {
+      if(r < FIRST_ROW) return;
+
+      const size_t S0 = (r == FIRST_ROW) ? first_slot % L.per_row : 0;
+      size_t pos = (r * L.per_row + S0 - first_slot) * L.bits;
+
+      if(pos < len * 8) extractRow(pixels.data, L, S0, L.per_row, out, len, pos);
+    });
+
+    // Report success.
+    return true;
+  }
+
+  // The next payload bit to extract.
+  size_t pos = 0;
+
+  // Extract row by row, starting in the row holding first_slot.
+  for(uint r = static_cast<uint>(FIRST_ROW); pos < len * 8 && r < L.rows; ++r)
+  {
+    const size_t S0 = (r == FIRST_ROW) ? first_slot % L.per_row : 0;
+    extractRow(carrier.row(r).data, L, S0, L.per_row, out, len, pos);
+  }
+
+  // Report success.
+  return true;
+}
+
+
+// ********************* |
+// Public Interface      |
+// ********************* V
+
+/* ****************************************************
+\\ Returns the number of payload bytes a carrier holds,
+// after the length prefix of stegoEmbedMessage.
+\\
+// @param carrier: The carrier Image.
+\\
+// @param options: The bits and channel mask.
+\\
+// ****************************************************/
+size_t stegoCapacity( const Image & carrier,
+                      const StegoOptions & options )
+{
+  const SlotLayout L(carrier, options);
+  if(!L.valid()) return 0;
+
+  // Slots taken by the length prefix.
+  const size_t HEADER_SLOTS = (STEGO_HEADER_BYTES * 8 + L.bits - 1) / L.bits;
+  if(L.per_row * L.rows <= HEADER_SLOTS) return 0;
+
+  // Every other slot holds options.bits payload bits.
+  return ((L.per_row * L.rows - HEADER_SLOTS) * L.bits) / 8;
+}
+
+
+/* ****************************************************
+\\ Hides a payload in a carrier's low bits.
+//
+\\ @param carrier: The carrier. Copy-on-write: copies of
+// it don't see the payload.
+\\
+// @param payload, len: The bytes to hide.
+\\
+// @param options: The bits and channel mask.
+\\
+// @return: True if the payload was embedded.
+\\
+// ****************************************************/
+bool stegoEmbed( Image & carrier,
+                 const uchar * payload,
+                 size_t len,
+                 const StegoOptions & options )
+{
+  return embedAt(carrier, payload, len, 0, options);
+}
+
+
+/* ****************************************************
+\\ Recovers a payload hidden by stegoEmbed.
+//
+\\ @param carrier: The carrier.
+//
+\\ @param out, len: Destination for len payload bytes.
+//
+\\ @param options: Must match those used to embed.
+//
+\\ @return: True if len bytes were extracted.
+//
+\\ ****************************************************/
+bool stegoExtract( const Image & carrier,
+                   uchar * out,
+                   size_t len,
+                   const StegoOptions & options )
+{
+  return extractAt(carrier, out, len, 0, options);
+}
+
+
+/* ****************************************************
+\\ Encodes a length prefix (8 bytes, little endian).
+//
+\\ ****************************************************/
+static void encodeLength( uint64_t len,
+                          uchar header[STEGO_HEADER_BYTES] )
+{
+  for(uint b = 0; b < STEGO_HEADER_BYTES; ++b)
+    header[b] = static_cast<uchar>(len >> (8 * b));
+}
+
+
+/* ****************************************************
+\\ Decodes a length prefix written by encodeLength.
+//
+\\ ****************************************************/
+static uint64_t decodeLength(const uchar header[STEGO_HEADER_BYTES])
+{
+  uint64_t len = 0;
+  for(uint b = 0; b < STEGO_HEADER_BYTES; ++b) len |= static_cast<uint64_t>(header[b]) << (8 * b);
+  return len;
+}
+
+
+/* ****************************************************
+\\ Hides a payload preceded by its length, as 8 bytes
+// (little endian). The payload starts in the slot
+\\ after the length.
+//
+\\ @return: True if the message was embedded.
+//
+\\ ****************************************************/
+bool stegoEmbedMessage( Image & carrier,
+                        const std::vector<uchar> & message,
+                        const StegoOptions & options )
+{
+  // If the bit count is invalid, report failure.
+  if(options.bits < 1 || options.bits > 8) return false;
+
+  // Slots taken by the length prefix.
+  const size_t HEADER_SLOTS = (STEGO_HEADER_BYTES * 8 + options.bits - 1) / options.bits;
+
+  // Slots taken by the message.
+  const size_t MESSAGE_SLOTS = (message.size() * 8 + options.bits - 1) / options.bits;
+  const SlotLayout L(carrier, options);
+
+  // If the message doesn't fit, report failure (before
+  // writing anything, so the carrier is unchanged).
+  if(!L.valid() || HEADER_SLOTS + MESSAGE_SLOTS > L.per_row * L.rows) return false;
+
+  // Encode the length.
+  uchar header[STEGO_HEADER_BYTES];
+  encodeLength(message.size(), header);
+
+  // Embed the length, then the message.
+  return embedAt(carrier, header, STEGO_HEADER_BYTES, 0, options) &&
+         embedAt(carrier, message.empty() ? header : &message[0], message.size(), HEADER_SLOTS, options);
+}
+
+
+/* ****************************************************
+\\ Recovers a payload hidden by stegoEmbedMessage.
+//
+\\ @param message: Replaced with the message.
+//
+\\ @return: False if the carrier holds no valid length
+// prefix (e.g. it holds no message).
+\\
+// ****************************************************/
+bool stegoExtractMessage( const Image & carrier,
+                          std::vector<uchar> & message,
+                          const StegoOptions & options )
+{
+  // If the bit count is invalid, report failure.
+  if(options.bits < 1 || options.bits > 8) return false;
+
+  // Slots taken by the length prefix.
+  const size_t HEADER_SLOTS = (STEGO_HEADER_BYTES * 8 + options.bits - 1) / options.bits;
+
+  // Decode the length.
+  uchar header[STEGO_HEADER_BYTES];
+  if(!extractAt(carrier, header, STEGO_HEADER_BYTES, 0, options)) return false;
+
+  const uint64_t len = decodeLength(header);
+
+  // If the length can't be right, report failure.
+  if(len > stegoCapacity(carrier, options)) return false;
+
+  // Extract the message.
+  message.resize(static_cast<size_t>(len));
+  return extractAt(carrier, message.empty() ? header : &message[0], message.size(), HEADER_SLOTS, options);
+}
+
+
+/* ****************************************************
+\\ Hides a payload from a stream across a sequence of
+// carriers. Each carrier holds a length prefix (as in
+\\ stegoEmbedMessage) and then as much of the payload as
+// fits. The prefix of the carrier the stream ends in has
+\\ its top bit (STREAM_LAST_CARRIER) set, so extraction
+// knows where to stop. An empty stream still takes one
+\\ carrier, to hold that mark. The payload is read
+// STREAM_CHUNK_BYTES at a time, straight into the
+\\ carrier. Once a carrier is full (or the stream ends),
+// its length is written and it is saved, before the
+\\ next carrier is opened.
+//
+\\ @param payload: The stream to hide.
+//
+\\ @param next_carrier: Opens each carrier, and sets the
+// name it is saved as.
+\\
+// @param options: The bits and channel mask.
+\\
+// @param bytes_embedded: If given, set to the number of
+\\ payload bytes hidden.
+//
+\\ @return: True if the whole stream was hidden. False
+// if the carriers ran out, or one couldn't be saved.
+\\
+// ****************************************************/
+bool stegoEmbedStream( std::istream & payload,
+                       const CarrierSource & next_carrier,
+                       const StegoOptions & options,
+                       size_t * bytes_embedded )
+{
+  if(bytes_embedded) *bytes_embedded = 0;
+
+  // If the bit count is invalid, report failure.
+  if(options.bits < 1 || options.bits > 8) return false;
+
+  // Slots taken by each carrier's length prefix.
+  const size_t HEADER_SLOTS = (STEGO_HEADER_BYTES * 8 + options.bits - 1) / options.bits;
+
+  // Chunks are a multiple of bits bytes (a whole number of
+  // slots), so each one starts right after the last.
+  const size_t CHUNK = STREAM_CHUNK_BYTES - STREAM_CHUNK_BYTES % options.bits;
+  std::vector<uchar> buf(CHUNK);
+
+  // Until the stream is drained..
+  for(bool last = false; !last; )
+  {
+    // Open the next carrier. If there is none, report failure.
+    Image carrier;
+    if(!next_carrier(carrier)) return false;
+
+    // The payload bytes this carrier can hold after its prefix.
+    const SlotLayout L(carrier, options);
+    if(!L.valid() || L.per_row * L.rows <= HEADER_SLOTS) return false;
+    const size_t CAPACITY = (L.per_row * L.rows - HEADER_SLOTS) * options.bits / 8;
+
+    // Fill the carrier a chunk at a time.
+    size_t stored = 0, slot = HEADER_SLOTS;
+    while(stored < CAPACITY && payload)
+    {
+      const size_t WANT = (CAPACITY - stored < CHUNK) ? CAPACITY - stored : CHUNK;
+
+      payload.read(reinterpret_cast<char *>(&buf[0]), WANT);
+      const size_t GOT = static_cast<size_t>(payload.gcount());
+
+      if(GOT && !embedAt(carrier, &buf[0], GOT, slot, options)) return false;
+
+      stored += GOT;
+      slot += GOT * 8 / options.bits;
+
+      // A short read means the stream has ended.
+      if(GOT < WANT) break;
+    }
+
+    // Write the carrier's length prefix, marked if nothing
+    // is left for another carrier, and save it.
+    last = payload.peek() == std::istream::traits_type::eof();
+
+    uchar header[STEGO_HEADER_BYTES];
+    encodeLength(last ? stored | STREAM_LAST_CARRIER : stored, header);
+    if(!embedAt(carrier, header, STEGO_HEADER_BYTES, 0, options) || !carrier.saveImage()) return false;
+
+    if(bytes_embedded) *bytes_embedded += stored;
+  }
+
+  // Report success.
+  return true;
+}
+
+
+/* ****************************************************
+\\ Recovers a payload hidden by stegoEmbedStream. Each
+// carrier's share is extracted STREAM_CHUNK_BYTES at a
+\\ time and written out, so only one carrier is ever in
+// memory. Carriers are opened up to the one marked last
+\\ (see stegoEmbedStream); any after it are never opened.
+\\
+// @param payload: Receives the hidden payload.
+\\
+// @param next_carrier: Opens each carrier, in order.
+\\
+// @param options: Must match those used to embed.
+\\
+// @param bytes_extracted: If given, set to the number of
+\\ payload bytes recovered.
+//
+\\ @return: True if every carrier up to the last was read.
+// False if the carriers run out before it, a carrier
+\\ holds no valid prefix, or the output stream fails.
+\\
+// ****************************************************/
+bool stegoExtractStream( std::ostream & payload,
+                         const CarrierSource & next_carrier,
+                         const StegoOptions & options,
+                         size_t * bytes_extracted )
+{
+  if(bytes_extracted) *bytes_extracted = 0;
+
+  // If the bit count is invalid, report failure.
+  if(options.bits < 1 || options.bits > 8) return false;
+
+  // Slots taken by each carrier's length prefix.
+  const size_t HEADER_SLOTS = (STEGO_HEADER_BYTES * 8 + options.bits - 1) / options.bits;
+
+  // Whole-slot chunks, as in stegoEmbedStream.
+  const size_t CHUNK = STREAM_CHUNK_BYTES - STREAM_CHUNK_BYTES % options.bits;
+  std::vector<uchar> buf(CHUNK);
+
+  // For each carrier..
+  for(Image carrier; next_carrier(carrier); carrier = Image())
+  {
+    // Read the length of this carrier's share.
+    uchar header[STEGO_HEADER_BYTES];
+    if(!extractAt(carrier, header, STEGO_HEADER_BYTES, 0, options)) return false;
+
+    const uint64_t PREFIX = decodeLength(header);
+    const uint64_t LEN = PREFIX & ~STREAM_LAST_CARRIER;
+
+    // If the length can't be right, report failure.
+    if(LEN > stegoCapacity(carrier, options)) return false;
+
+    // Extract the share a chunk at a time.
+    size_t slot = HEADER_SLOTS;
+    for(uint64_t done = 0; done < LEN; )
+    {
+      const size_t N = (LEN - done < CHUNK) ? static_cast<size_t>(LEN - done) : CHUNK;
+
+      if(!extractAt(carrier, &buf[0], N, slot, options)) return false;
+      if(!payload.write(reinterpret_cast<const char *>(&buf[0]), N)) return false;
+
+      done += N;
+      slot += N * 8 / options.bits;
+      if(bytes_extracted) *bytes_extracted += N;
+    }
+
+    // If this was the last carrier, report success.
+    if(PREFIX & STREAM_LAST_CARRIER) return true;
+  }
+
+  // The carriers ran out before the last; report failure.
+  return false;
+}
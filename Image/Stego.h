@@ -0,0 +1,109 @@
+/* ***************************************************************
+\\ File Name:  Stego.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Declarations for least-significant-bit steganography
+\\ on Images. Payloads are hidden in the low bits of the carrier's
+// channel values, a whole scanline at a time.
+\\ See Stego.cpp for more information.
+//
+\\ ***************************************************************/
+
+#ifndef STEGO_H
+#define STEGO_H
+
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "Image.h"
+
+
+// The size of the length prefix written by stegoEmbedMessage.
+const uint STEGO_HEADER_BYTES = 8;
+
+
+/* *************************************************
+\\ Where in the carrier a payload is hidden. Both
+// sides of an embed/extract must use the same
+\\ options.
+//
+\\ *************************************************/
+struct StegoOptions
+{
+  // Initialize all fields with the specified layout.
+  StegoOptions(uint b = 1, uint m = 0xFF) :
+  bits(b), channel_mask(m) { return; }
+
+       // Number of low bits used in each carrying
+       // channel value, 1 to 8.
+  uint bits,
+       // Bit i set means channel i carries payload
+       // (in memory order, so bit 0 is blue for BGR
+       // images). Bits past the last channel are ignored.
+       channel_mask;
+};
+
+
+// Returns the number of payload bytes a carrier can hold
+// behind a length prefix (see stegoEmbedMessage). stegoEmbed,
+// having no prefix, fits a few more. 0 if the carrier is
+// uninitialized or the options invalid.
+size_t stegoCapacity( const Image & carrier,
+                      const StegoOptions & options = StegoOptions() );
+
+// Hides len bytes of payload in the carrier. False (carrier
+// unchanged) if it doesn't fit, or the options are invalid.
+bool stegoEmbed( Image & carrier,
+                 const uchar * payload,
+                 size_t len,
+                 const StegoOptions & options = StegoOptions() );
+
+// Recovers len bytes of payload from the carrier into out.
+bool stegoExtract( const Image & carrier,
+                   uchar * out,
+                   size_t len,
+                   const StegoOptions & options = StegoOptions() );
+
+// Hides a payload with a length prefix, so it can be
+// extracted without knowing its size.
+bool stegoEmbedMessage( Image & carrier,
+                        const std::vector<uchar> & message,
+                        const StegoOptions & options = StegoOptions() );
+
+// Recovers a payload hidden by stegoEmbedMessage.
+bool stegoExtractMessage( const Image & carrier,
+                          std::vector<uchar> & message,
+                          const StegoOptions & options = StegoOptions() );
+
+
+// Opens the next carrier of a stream into carrier (which is
+// uninitialized), naming it for saving when embedding. Returns
+// false when there are no carriers left.
+typedef std::function<bool(Image & carrier)> CarrierSource;
+
+// Hides a payload read from a stream across as many carriers as
+// it needs (at least one). Each is saved as soon as it's full, so
+// only one is in memory at a time. Carriers must be saved in a
+// lossless format. How many carriers were used depends on each
+// one's capacity, so bytes_embedded alone doesn't tell how many
+// to supply on extraction; count the calls to next_carrier.
+bool stegoEmbedStream( std::istream & payload,
+                       const CarrierSource & next_carrier,
+                       const StegoOptions & options = StegoOptions(),
+                       size_t * bytes_embedded = nullptr );
+
+// Recovers a payload hidden by stegoEmbedStream, writing it to a
+// stream. next_carrier must supply the carriers in the same order.
+// Extraction stops at the last carrier embedded (its prefix says
+// so), so further carriers may be offered; false if the carriers
+// run out first.
+bool stegoExtractStream( std::ostream & payload,
+                         const CarrierSource & next_carrier,
+                         const StegoOptions & options = StegoOptions(),
+                         size_t * bytes_extracted = nullptr );
+
+#endif // STEGO_H
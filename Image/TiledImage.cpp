@@ -0,0 +1,463 @@
+/* ***************************************************************
+\\ File Name:  TiledImage.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation of tiled image access. The source Image
+\\ is usually a mapping of its file, so a tile's pages are read
+// from disk only when the tile is first loaded. Loaded tiles are
+\\ copied into a least-recently-used cache, capped by cache_bytes.
+// Modified tiles are written back to the source when evicted, or
+\\ on flush.
+//
+\\ transformTiles keeps the results of two tile rows pending before
+// committing them, so every tile's halo sees the original pixels.
+\\ Its working set is the cache, plus two rows of results.
+//
+\\ ***************************************************************/
+
+#include "TiledImage.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+
+/* ****************************************************
+\\ Initializes tile settings with their defaults.
+//
+\\ ****************************************************/
+TileOptions :: TileOptions(void) :
+tile_width(512), tile_height(512), halo(0), cache_bytes(64 << 20)
+{
+  return;
+}
+
+
+/* ****************************************************
+\\ Initializes an empty TiledImage. Zero tile sizes are
+// treated as 1.
+\\
+// @param options: Tile size, halo and cache budget.
+\\
+// ****************************************************/
+TiledImage :: TiledImage(const TileOptions & options) :
+options(options), cached_bytes(0)
+{
+  if(this->options.tile_width == 0) this->options.tile_width = 1;
+  if(this->options.tile_height == 0) this->options.tile_height = 1;
+}
+
+
+/* ****************************************************
+\\ Opens an image file for tiled access. Binary PGM/PPM
+// files are mapped; anything else is decoded whole.
+\\
+// @param filename: The name of the image file.
+\\
+// @param writable: If true (and the file is mapped),
+\\ flushed tiles are written straight to the file.
+//
+\\ @return: True if the image was opened.
+//
+\\ ****************************************************/
+bool TiledImage :: open( const std::string & filename,
+                         bool writable )
+{
+  // If an image is already open, report failure.
+  if(initialized()) return false;
+
+  // Only PGM/PPM files (going by their content, not their name)
+  // can be mapped. Try to map those, and decode anything else.
+  const int FORMAT = Image::sniffFile(filename);
+  const bool MAPPABLE = (FORMAT == FORMAT_PGM || FORMAT == FORMAT_PPM);
+
+  return (MAPPABLE && source.mapImage(filename, writable)) || source.openImage(filename);
+}
+
+
+/* ****************************************************
+\\ Returns the number of tile columns.
+//
+\\ ****************************************************/
+uint TiledImage :: tilesAcross(void) const
+{
+  return (getWidth() + options.tile_width - 1) / options.tile_width;
+}
+
+
+/* ****************************************************
+\\ Returns the number of tile rows.
+//
+\\ ****************************************************/
+uint TiledImage :: tilesDown(void) const
+{
+  return (getHeight() + options.tile_height - 1) / options.tile_height;
+}
+
+
+/* ****************************************************
+\\ Returns the area of a tile, in image coordinates.
+// Tiles in the last column/row are cropped.
+\\
+// @param tx, ty: The tile's column and row.
+\\
+// @return: The tile's area. Empty if it doesn't exist.
+\\
+// ****************************************************/
+cv::Rect TiledImage :: tileArea( uint tx,
+                                 uint ty ) const
+{
+  if(tx >= tilesAcross() || ty >= tilesDown()) return cv::Rect();
+
+  const uint X = tx * options.tile_width,
+             Y = ty * options.tile_height;
+
+  return cv::Rect( X, Y,
+                   std::min(options.tile_width, getWidth() - X),
+                   std::min(options.tile_height, getHeight() - Y) );
+}
+
+
+/* ****************************************************
+\\ Shares the pixels of a tile.
+//
+\\ @param tx, ty: The tile's column and row.
+//
+\\ @param tile: Set to the tile's pixels.
+//
+\\ @return: False if the tile doesn't exist, or
+// couldn't be loaded.
+\\
+// ****************************************************/
+bool TiledImage :: readTile( uint tx,
+                             uint ty,
+                             cv::Mat & tile )
+{
+  CachedTile * entry = fetch(tx, ty);
+  if(!entry) return false;
+
+  tile = entry->pixels;
+  return true;
+}
+
+
+/* ****************************************************
+\\ Replaces the pixels of a tile. If the tile isn't
+// cached, it isn't loaded first; src is cached as-is.
+\\
+// @param tx, ty: The tile's column and row.
+\\
+// @param src: The new pixels, of the tile's size, with
+\\ the image's type (getType()).
+//
+\\ @return: False if the tile doesn't exist, or src
+// doesn't match it.
+\\
+// ****************************************************/
+bool TiledImage :: writeTile( uint tx,
+                              uint ty,
+                              const cv::Mat & src )
+{
+  const cv::Rect AREA = tileArea(tx, ty);
+
+  // If src doesn't match the tile, report failure.
+  if( AREA.area() == 0 || src.type() != getType() ||
+      src.cols != AREA.width || src.rows != AREA.height ) return false;
+
+  const size_t KEY = static_cast<size_t>(ty) * tilesAcross() + tx;
+
+  // Replace the cached pixels (rather than writing into
+  // them, so Mats shared by readTile are unaffected).
+  std::unordered_map<size_t, CachedTile>::iterator found = cache.find(KEY);
+
+  CachedTile * entry;
+  if(found != cache.end())
+  {
+    entry = &found->second;
+    entry->pixels = src.clone();
+    lru.splice(lru.begin(), lru, entry->lru_pos);
+  }
+  else if(!(entry = insert(KEY, src.clone()))) return false;
+
+  entry->dirty = true;
+  return true;
+}
+
+
+/* ****************************************************
+\\ Copies a rectangle of the image from the tiles it
+// overlaps. Each tile is copied as soon as it is
+\\ fetched, so the area may exceed the cache budget.
+//
+\\ @param area: The rectangle, in image coordinates.
+//
+\\ @param dst: Receives the pixels.
+//
+\\ @return: False if the area isn't within the image,
+\\ or a tile couldn't be loaded.
+//
+\\ ****************************************************/
+bool TiledImage :: readRegion( const cv::Rect & area,
+                               cv::Mat & dst )
+{
+  // If the area isn't within the image, report failure.
+  const cv::Rect IMAGE(0, 0, getWidth(), getHeight());
+  if(area.area() == 0 || (area & IMAGE) != area) return false;
+
+  dst.create(area.height, area.width, getType());
+
+  // The tiles overlapped by the area.
+  const uint TX0 = area.x / options.tile_width,
+             TY0 = area.y / options.tile_height,
+             TX1 = (area.x + area.width - 1) / options.tile_width,
+             TY1 = (area.y + area.height - 1) / options.tile_height;
+
+  for(uint ty = TY0; ty <= TY1; ++ty)
+    for(uint tx = TX0; tx <= TX1; ++tx)
+    {
+      CachedTile * entry = fetch(tx, ty);
+      if(!entry) return false;
+
+      // Copy the overlap, from tile to dst coordinates.
+      const cv::Rect TILE = tileArea(tx, ty),
+                     PART = TILE & area;
+
+      entry->pixels(PART - TILE.tl()).copyTo(dst(PART - area.tl()));
+    }
+
+  return true;
+}
+
+
+/* ****************************************************
+\\ Applies an operation to every tile, in raster order.
+// Results are held back until the tile row below has
+\\ been transformed, since that row's halos still need
+// the original pixels. The halo is limited to the tile
+\\ size, so it never reaches more than one row up.
+//
+\\ @param op: The operation.
+//
+\\ @return: False if op failed (or returned a result of
+// the wrong size), or a tile couldn't be loaded. Rows
+\\ committed before the failure keep their results.
+//
+\\ ****************************************************/
+bool TiledImage :: transformTiles(const TileOp & op)
+{
+  // If no image is open, report failure.
+  if(!initialized() || !op) return false;
+
+  const uint HALO = std::min(options.halo, std::min(options.tile_width, options.tile_height));
+  const cv::Rect IMAGE(0, 0, getWidth(), getHeight());
+
+  // Results of the previous and current tile rows, by column.
+  typedef std::vector< std::pair<uint, cv::Mat> > Results;
+  Results above, current;
+
+  for(uint ty = 0; ty < tilesDown(); ++ty)
+  {
+    for(uint tx = 0; tx < tilesAcross(); ++tx)
+    {
+      TileInfo info;
+      info.tx = tx;
+      info.ty = ty;
+      info.area = tileArea(tx, ty);
+
+      // The tile and its halo, cropped to the image.
+      const cv::Rect HALOED = cv::Rect( info.area.x - HALO, info.area.y - HALO,
+                                        info.area.width + 2 * HALO,
+                                        info.area.height + 2 * HALO ) & IMAGE;
+      info.inner = info.area - HALOED.tl();
+
+      cv::Mat in;
+      if(!readRegion(HALOED, in)) return false;
+
+      // Start the result from the tile's current pixels.
+      cv::Mat out = in(info.inner).clone();
+
+      if(!op(in, out, info)) return false;
+
+      // If the result doesn't fit the tile, report failure.
+      if(out.type() != in.type() || out.size() != info.area.size()) return false;
+
+      current.push_back(std::make_pair(tx, out));
+    }
+
+    // Row ty's halos are done with the row above; commit it.
+    for(size_t r = 0; r < above.size(); ++r)
+      if(!writeTile(above[r].first, ty - 1, above[r].second)) return false;
+
+    above.swap(current);
+    current.clear();
+  }
+
+  // Commit the last row.
+  for(size_t r = 0; r < above.size(); ++r)
+    if(!writeTile(above[r].first, tilesDown() - 1, above[r].second)) return false;
+
+  return true;
+}
+
+
+/* ****************************************************
+\\ Writes every modified tile to the source Image. The
+// tiles stay cached.
+\\
+// @return: False if a tile couldn't be written.
+\\
+// ****************************************************/
+bool TiledImage :: flush(void)
+{
+  for(std::unordered_map<size_t, CachedTile>::iterator it = cache.begin(); it != cache.end(); ++it)
+    if(!writeBack(it->first, it->second)) return false;
+
+  return true;
+}
+
+
+/* ****************************************************
+\\ Flushes modified tiles, then saves the source Image
+// (which syncs a writable mapping in place).
+\\
+// @param options: Encoder settings.
+\\
+// @return: True if the image was saved.
+\\
+// ****************************************************/
+bool TiledImage :: saveImage(const EncodeOptions & options)
+{
+  return flush() && source.saveImage(options);
+}
+
+
+/* ****************************************************
+\\ (Private) - Finds a tile in the cache, or loads it
+// from the source Image. For a mapped file, this is
+\\ when the tile's pages are first read from disk.
+//
+\\ @param tx, ty: The tile's column and row.
+//
+\\ @return: The tile's cache entry, or null if the tile
+\\ doesn't exist or couldn't be cached.
+//
+\\ ****************************************************/
+TiledImage :: CachedTile * TiledImage :: fetch( uint tx,
+                                                uint ty )
+{
+  const cv::Rect AREA = tileArea(tx, ty);
+  if(AREA.area() == 0) return nullptr;
+
+  const size_t KEY = static_cast<size_t>(ty) * tilesAcross() + tx;
+
+  // If the tile is cached, mark it most recently used.
+  std::unordered_map<size_t, CachedTile>::iterator found = cache.find(KEY);
+  if(found != cache.end())
+  {
+    ++stats.hits;
+    lru.splice(lru.begin(), lru, found->second.lru_pos);
+    return &found->second;
+  }
+
+  ++stats.misses;
+
+  // Copy the tile out of the source, a row at a time. The
+  // const view keeps the source from being detached.
+  const Image & SOURCE = source;
+  const size_t ROW_BYTES = AREA.width * SOURCE.getPixelBytes(),
+               COL_OFFSET = AREA.x * SOURCE.getPixelBytes();
+
+  cv::Mat pixels(AREA.height, AREA.width, getType());
+  for(int r = 0; r < AREA.height; ++r)
+    std::memcpy(pixels.ptr(r), SOURCE.row(AREA.y + r).data + COL_OFFSET, ROW_BYTES);
+
+  return insert(KEY, pixels);
+}
+
+
+/* ****************************************************
+\\ (Private) - Adds a clean tile to the cache as the
+// most recently used, evicting others to make room.
+\\
+// @param key: The tile's key.
+\\
+// @param pixels: The tile's pixels (not copied).
+\\
+// @return: The new entry, or null if an evicted tile
+\\ couldn't be written back.
+//
+\\ ****************************************************/
+TiledImage :: CachedTile * TiledImage :: insert( size_t key,
+                                                 const cv::Mat & pixels )
+{
+  const size_t BYTES = pixels.total() * pixels.elemSize();
+  if(!makeRoom(BYTES)) return nullptr;
+
+  lru.push_front(key);
+
+  CachedTile & entry = cache[key];
+  entry.pixels = pixels;
+  entry.dirty = false;
+  entry.lru_pos = lru.begin();
+
+  cached_bytes += BYTES;
+  return &entry;
+}
+
+
+/* ****************************************************
+\\ (Private) - Evicts least recently used tiles (writing
+// back modified ones) until incoming bytes fit within
+\\ the budget, or the cache is empty.
+//
+\\ @param incoming: The size of the tile being added.
+//
+\\ @return: False if a tile couldn't be written back.
+\\
+// ****************************************************/
+bool TiledImage :: makeRoom(size_t incoming)
+{
+  while(!lru.empty() && cached_bytes + incoming > options.cache_bytes)
+  {
+    const size_t KEY = lru.back();
+    CachedTile & entry = cache[KEY];
+
+    if(!writeBack(KEY, entry)) return false;
+
+    cached_bytes -= entry.pixels.total() * entry.pixels.elemSize();
+    cache.erase(KEY);
+    lru.pop_back();
+    ++stats.evictions;
+  }
+
+  return true;
+}
+
+
+/* ****************************************************
+\\ (Private) - Writes a modified tile to the source
+// Image. For a writable mapping, this writes the file.
+\\
+// @param key: The tile's key.
+\\
+// @param entry: The tile's cache entry.
+\\
+// @return: True if the tile is now clean.
+\\
+// ****************************************************/
+bool TiledImage :: writeBack( size_t key,
+                              CachedTile & entry )
+{
+  if(!entry.dirty) return true;
+
+  const cv::Rect AREA = tileArea(key % tilesAcross(), key / tilesAcross());
+
+  if(!source.setRegion( AREA.y, AREA.x, AREA.height, AREA.width,
+                        entry.pixels.data, static_cast<uint>(entry.pixels.step) )) return false;
+
+  entry.dirty = false;
+  ++stats.write_backs;
+  return true;
+}
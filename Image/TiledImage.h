@@ -0,0 +1,223 @@
+/* ***************************************************************
+\\ File Name:  TiledImage.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Declarations for tiled processing of images too large
+\\ to work on whole. Pixels are read and written a fixed-size tile
+// at a time, through a cache with a byte budget, so the working
+\\ set is a setting rather than the whole frame.
+// See TiledImage.cpp for more information.
+\\
+// ***************************************************************/
+
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "Image.h"
+
+
+/* *************************************************
+\\ Settings for a TiledImage.
+//
+\\ *************************************************/
+struct TileOptions
+{
+  // Initialize all fields with their defaults.
+  TileOptions(void);
+
+       // The size of each tile, in pixels. Edge
+       // tiles are cropped to the image.
+  uint tile_width,
+       tile_height,
+       // Pixels of neighbouring data around each tile
+       // passed to transformTiles. At most the smaller
+       // of the tile sizes.
+       halo;
+
+  // The most tile data to keep cached, in bytes. At
+  // least one tile is always kept.
+  size_t cache_bytes;
+};
+
+
+/* *************************************************
+\\ Where a tile given to a TileOp lies.
+//
+\\ *************************************************/
+struct TileInfo
+{
+  // The tile's column and row in the tile grid.
+  uint tx, ty;
+
+  // The tile, in image coordinates.
+  cv::Rect area;
+
+  // The tile, within the haloed input.
+  cv::Rect inner;
+};
+
+
+/* *************************************************
+\\ Tile cache counters.
+//
+\\ *************************************************/
+struct TileStats
+{
+  // Initialize all counters to 0.
+  TileStats(void) : hits(0), misses(0), evictions(0), write_backs(0) { return; }
+
+         // Tile lookups served from / loaded into the cache.
+  size_t hits,
+         misses,
+         // Tiles dropped to stay within the budget.
+         evictions,
+         // Modified tiles written to the source Image.
+         write_backs;
+};
+
+
+// An operation on one tile. in is the tile plus its halo (cropped
+// to the image); out is the tile, initialized to its current
+// pixels, and receives the result. False stops transformTiles.
+typedef std::function<bool(const cv::Mat & in, cv::Mat & out, const TileInfo & info)> TileOp;
+
+
+/* *************************************************
+\\ An Image accessed a tile at a time. Binary PGM/PPM
+// files are memory-mapped, so only the tiles in use
+\\ are ever read from disk. Other formats are decoded
+// whole (OpenCV has no partial decode), but are still
+\\ processed tile by tile.
+//
+\\ Tiles hold pixels in the source's channel order
+// (RGB for mapped PPMs; see isRGB).
+\\
+// *************************************************/
+class TiledImage
+{
+  public:
+
+    // Initializes an empty TiledImage.
+    explicit TiledImage(const TileOptions & options = TileOptions());
+
+    // Opens an image file. If writable and the file can be
+    // mapped, tile writes reach the file on flush.
+    bool open( const std::string & filename,
+               bool writable = false );
+
+    // True if an image is open.
+    bool initialized(void) const { return source.initialized(); }
+
+    // Returns the size of the whole image.
+    uint getWidth(void) const { return source.getWidth(); }
+    uint getHeight(void) const { return source.getHeight(); }
+    uint getChannels(void) const { return source.getChannels(); }
+    // Returns the OpenCV type of the pixels (e.g. CV_16UC3).
+    int getType(void) const { return CV_MAKETYPE(source.getDepth(), getChannels()); }
+    bool isRGB(void) const { return source.isRGB(); }
+
+    // Returns the size of the tile grid.
+    uint tilesAcross(void) const;
+    uint tilesDown(void) const;
+
+    // Returns the area of a tile, in image coordinates.
+    // Empty if the tile doesn't exist.
+    cv::Rect tileArea( uint tx,
+                       uint ty ) const;
+
+    // Sets tile to the pixels of a tile, loading it if needed.
+    // The pixels are shared with the cache; use writeTile to
+    // change them.
+    bool readTile( uint tx,
+                   uint ty,
+                   cv::Mat & tile );
+
+    // Replaces the pixels of a tile. src must be the tile's size
+    // and type. Written to the source on eviction or flush.
+    bool writeTile( uint tx,
+                    uint ty,
+                    const cv::Mat & src );
+
+    // Copies any rectangle of the image into dst, from
+    // the tiles it overlaps.
+    bool readRegion( const cv::Rect & area,
+                     cv::Mat & dst );
+
+    // Applies op to every tile, in raster order. Each tile's
+    // halo holds the original pixels, even where neighbours
+    // have already been transformed.
+    bool transformTiles(const TileOp & op);
+
+    // Writes every modified tile to the source Image.
+    bool flush(void);
+
+    // Flushes, then saves the source Image to its file.
+    bool saveImage(const EncodeOptions & options = EncodeOptions());
+
+    // Returns the cache counters, and the bytes cached.
+    const TileStats & getStats(void) const { return stats; }
+    size_t cachedBytes(void) const { return cached_bytes; }
+
+  private:
+
+    // A cached tile.
+    struct CachedTile
+    {
+      // The tile's pixels.
+      cv::Mat pixels;
+
+      // True if the pixels differ from the source.
+      bool dirty;
+
+      // The tile's position in the lru list.
+      std::list<size_t>::iterator lru_pos;
+    };
+
+    // Not copyable; the cache refers to source.
+    TiledImage(const TiledImage &) = delete;
+    TiledImage & operator=(const TiledImage &) = delete;
+
+    // Returns a tile's cache entry, loading it (and evicting
+    // others) if needed. Null if the tile doesn't exist.
+    CachedTile * fetch( uint tx,
+                        uint ty );
+
+    // Adds a tile to the cache, evicting others to make room.
+    // Null if an evicted tile couldn't be written back.
+    CachedTile * insert( size_t key,
+                         const cv::Mat & pixels );
+
+    // Evicts least recently used tiles until incoming
+    // more bytes fit within the budget.
+    bool makeRoom(size_t incoming);
+
+    // Writes a tile to the source Image, if it is dirty.
+    bool writeBack( size_t key,
+                    CachedTile & entry );
+
+    // Settings, as given to the constructor.
+    TileOptions options;
+
+    // The whole image (usually a mapping of its file).
+    Image source;
+
+    // Cached tiles by key (ty * tilesAcross() + tx), and
+    // keys from most to least recently used.
+    std::unordered_map<size_t, CachedTile> cache;
+    std::list<size_t> lru;
+
+    // Bytes of pixel data in cache.
+    size_t cached_bytes;
+
+    // Cache counters.
+    TileStats stats;
+};
+
+#endif // TILED_IMAGE_H
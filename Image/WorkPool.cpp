@@ -0,0 +1,217 @@
+/* ***************************************************************
+\\ File Name:  WorkPool.cpp
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Implementation of the loop pool. A loop's chunks are
+\\ dealt out as one contiguous share per thread:
+//
+\\   [ share 0 | share 1 | .. | caller's share ]
+//
+\\ Each thread claims chunks from the front of its own share with
+// an atomic increment, then moves on to the next share along, and
+\\ claims from there, until every share is used up. Shares stay
+// in cache on their owner until it runs out, while uneven chunks
+\\ (e.g. a pool thread preempted mid-loop) are picked up by the
+// rest: no thread idles while work remains.
+\\
+// ***************************************************************/
+
+#include "WorkPool.h"
+
+
+// True on a thread running a loop body, so loops started from
+// inside a body run serially instead of waiting on themselves.
+static thread_local bool in_loop = false;
+
+
+/* ****************************************************
+\\ Starts the pool threads, which wait for a loop.
+//
+\\ @param threads: The total number of threads loops
+// run on, including the caller. 0 means one per
+\\ hardware thread.
+//
+\\ ****************************************************/
+WorkPool :: WorkPool(uint threads) :
+shares(threads ? threads : (std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1)),
+count(0), grain(1), body(nullptr), generation(0), stopping(false), busy(0)
+{
+  for(uint t = 0; t + 1 < shares.size(); ++t)
+    workers.push_back(std::thread(&WorkPool::work, this, t));
+}
+
+
+/* ****************************************************
+\\ Stops the pool threads. Loops can't be running, as
+// the pool is in use until parallelFor returns.
+\\
+// ****************************************************/
+WorkPool :: ~WorkPool(void)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  start.notify_all();
+
+  for(size_t t = 0; t < workers.size(); ++t) workers[t].join();
+}
+
+
+/* ****************************************************
+\\ Runs a loop over [0, count) on every thread.
+//
+\\ @param count: The number of iterations.
+//
+\\ @param grain: The most iterations per call of body.
+// Larger chunks cost less to hand out; smaller ones
+\\ balance better.
+//
+\\ @param body: Called once per chunk, from any thread.
+// Chunks may run in any order, and concurrently.
+\\
+// ****************************************************/
+void WorkPool :: parallelFor( size_t count_param,
+                              size_t grain_param,
+                              const RangeBody & body_param )
+{
+  if(count_param == 0) return;
+  if(grain_param == 0) grain_param = 1;
+
+  const size_t CHUNKS = (count_param + grain_param - 1) / grain_param;
+
+  // With one chunk, one thread, or from inside a loop,
+  // there is nothing to share; run the loop here. As on
+  // the pool, every chunk runs, and the first exception
+  // is rethrown once they have.
+  if(CHUNKS == 1 || workers.empty() || in_loop)
+  {
+    std::exception_ptr thrown;
+
+    for(size_t begin = 0; begin < count_param; begin += grain_param)
+    {
+      try { body_param(begin, (count_param - begin < grain_param) ? count_param : begin + grain_param); }
+      catch(...) { if(!thrown) thrown = std::current_exception(); }
+    }
+
+    if(thrown) std::rethrow_exception(thrown);
+    return;
+  }
+
+  std::lock_guard<std::mutex> my_turn(turn);
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Deal out the chunks, as evenly as possible.
+    const size_t N = shares.size();
+    for(size_t t = 0, first = 0; t < N; ++t)
+    {
+      const size_t LAST = CHUNKS * (t + 1) / N;
+      shares[t].next.store(first, std::memory_order_relaxed);
+      shares[t].end = LAST;
+      first = LAST;
+    }
+
+    count = count_param;
+    grain = grain_param;
+    body = &body_param;
+    error = nullptr;
+    busy = static_cast<uint>(workers.size());
+    ++generation;
+  }
+  start.notify_all();
+
+  // Run chunks here too; the caller's share is the last.
+  runChunks(static_cast<uint>(shares.size() - 1));
+
+  // Wait for the pool threads to finish theirs.
+  std::exception_ptr thrown;
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return busy == 0; });
+
+    body = nullptr;
+    thrown = error;
+    error = nullptr;
+  }
+
+  if(thrown) std::rethrow_exception(thrown);
+}
+
+
+/* ****************************************************
+\\ Returns the pool shared by every Image. It lives
+// until the program exits (never destroyed, so Images
+\\ used from static destructors still find it).
+//
+\\ ****************************************************/
+WorkPool & WorkPool :: shared(void)
+{
+  static WorkPool * pool = new WorkPool();
+  return *pool;
+}
+
+
+/* ****************************************************
+\\ (Private) - The body of each pool thread: joins each
+// loop as it starts, until the pool stops.
+\\
+// @param id: The thread's share of each loop.
+//
+\\ ****************************************************/
+void WorkPool :: work(uint id)
+{
+  unsigned long seen = 0;
+
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      start.wait(guard, [this, seen] { return stopping || generation != seen; });
+
+      if(stopping) return;
+      seen = generation;
+    }
+
+    runChunks(id);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if(--busy == 0) done.notify_one();
+  }
+}
+
+
+/* ****************************************************
+\\ (Private) - Runs chunks of the current loop until
+// every share is used up: first share id's own, then
+\\ each following share in turn.
+//
+\\ ****************************************************/
+void WorkPool :: runChunks(uint id)
+{
+  const size_t N = shares.size();
+  in_loop = true;
+
+  for(size_t k = 0; k < N; ++k)
+  {
+    Share & share = shares[(id + k) % N];
+
+    for(size_t chunk; (chunk = share.next.fetch_add(1, std::memory_order_relaxed)) < share.end; )
+    {
+      const size_t BEGIN = chunk * grain,
+                   END = (count - BEGIN < grain) ? count : BEGIN + grain;
+
+      try { (*body)(BEGIN, END); }
+      catch(...)
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if(!error) error = std::current_exception();
+      }
+    }
+  }
+
+  in_loop = false;
+}
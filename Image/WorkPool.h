@@ -0,0 +1,123 @@
+/* ***************************************************************
+\\ File Name:  WorkPool.h
+// Created By: Nick G. Toth
+\\ E-Mail:     ntoth@pdx.edu
+// Date:       July 2nd, 2017
+\\
+// Overview: Declarations for a pool of threads that runs loops in
+\\ parallel. Image::parallelForRows and Image::transform split an
+// Image into bands of rows, and run them here. See WorkPool.cpp
+\\ for more information.
+//
+\\ ***************************************************************/
+
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Processes the chunk of a loop from begin up to (not including) end.
+typedef std::function<void(size_t begin, size_t end)> RangeBody;
+
+
+/* *************************************************
+\\ A fixed set of threads which, together with the
+// calling thread, run each iteration of a loop once.
+\\ The iterations are split into chunks, and each
+// thread starts on its own share of them; threads
+\\ that finish early steal chunks from the others.
+//
+\\ One loop runs at a time; concurrent callers wait
+// their turn. A loop started from inside a loop body
+\\ runs serially on the calling thread.
+//
+\\ *************************************************/
+class WorkPool
+{
+  public:
+
+    // Starts threads - 1 threads (the caller is the last).
+    // 0 means one per hardware thread.
+    explicit WorkPool(uint threads = 0);
+
+    // Stops the threads, and waits for them to exit.
+    ~WorkPool(void);
+
+    // Calls body over [0, count), in chunks of at most grain
+    // iterations (0 is treated as 1), and returns once every
+    // chunk is done. An exception thrown by body is rethrown
+    // here (the remaining chunks are still run).
+    void parallelFor( size_t count,
+                      size_t grain,
+                      const RangeBody & body );
+
+    // Returns the number of threads loops run on,
+    // including the caller.
+    uint size(void) const { return static_cast<uint>(workers.size()) + 1; }
+
+    // Returns the pool shared by every Image, sized to the
+    // hardware. Started on first use.
+    static WorkPool & shared(void);
+
+  private:
+
+    // One thread's share of the chunks. Chunks are claimed from
+    // the front, by the owner and thieves alike. Shares are padded
+    // to two cache lines, so the next counters of neighbouring
+    // shares never share a line, however the vector is aligned
+    // (C++11 new ignores alignas beyond the default).
+    struct Share
+    {
+      std::atomic<size_t> next;
+      size_t end;
+      char pad[128 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+    };
+
+    // Not copyable; the threads refer to the pool.
+    WorkPool(const WorkPool &) = delete;
+    WorkPool & operator=(const WorkPool &) = delete;
+
+    // The body of each pool thread.
+    void work(uint id);
+
+    // Runs chunks, starting with share id's, until none are left.
+    void runChunks(uint id);
+
+    // The pool threads.
+    std::vector<std::thread> workers;
+
+    // The current loop: its shares (one per thread, the caller's
+    // last), size, grain and body.
+    std::vector<Share> shares;
+    size_t count, grain;
+    const RangeBody * body;
+
+    // The first exception thrown by the current loop's body.
+    std::exception_ptr error;
+
+    // Incremented as each loop is started. Pool threads
+    // wait for it to change, or for the pool to stop.
+    unsigned long generation;
+    bool stopping;
+
+    // The number of pool threads still running the current loop.
+    uint busy;
+
+    // Guards every member above. Signaled when a loop is
+    // started (start), or a pool thread finishes it (done).
+    std::mutex lock;
+    std::condition_variable start, done;
+
+    // Held by the caller for the whole of a loop.
+    std::mutex turn;
+};
+
+#endif // WORK_POOL_H